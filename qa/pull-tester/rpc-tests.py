@@ -119,6 +119,8 @@ testScripts = [
     'mempool_spendcoinbase.py',
     'mempool_reorg.py',
     'mempool_limit.py',
+    'mempool_persist.py',
+    'sendrawtransactions.py',
     'httpbasics.py',
     'multi_rpc.py',
     'zapwallettxes.py',
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014-2016 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test mempool persistence.
+#
+# By default, skeincoind will dump mempool on shutdown and
+# then reload it on startup. This can be overridden with
+# the -persistmempool=0 command line option.
+#
+# Test is as follows:
+#
+#  - start node0, node1 and node2. Send 5 transactions from node2,
+#    prioritise one of them on node0.
+#  - restart node0 and node1, node1 with -persistmempool=0. Verify
+#    that node0 reloads the transactions with their entry times and
+#    fee delta, and that node1 has an empty mempool. The transactions
+#    come from node2's wallet so that neither wallet puts them back.
+#
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 3
+        self.setup_clean_chain = False
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir)
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 1, 2)
+        self.is_network_split = False
+        self.sync_all()
+
+    def wait_for_mempool_size(self, node, size, timeout=10):
+        deadline = time.time() + timeout
+        while len(node.getrawmempool()) != size:
+            assert(time.time() < deadline)
+            time.sleep(0.25)
+
+    def run_test(self):
+        # Mine a single block to get out of IBD
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        # Send 5 transactions from node2 (to its own address)
+        for i in range(5):
+            self.nodes[2].sendtoaddress(self.nodes[2].getnewaddress(), Decimal("10"))
+        self.sync_all()
+        assert_equal(len(self.nodes[0].getrawmempool()), 5)
+        assert_equal(len(self.nodes[1].getrawmempool()), 5)
+
+        txid = self.nodes[0].getrawmempool()[0]
+        self.nodes[0].prioritisetransaction(txid, 0, 1000)
+        entry = self.nodes[0].getmempoolentry(txid)
+
+        # Stop all nodes and start node0 and node1 again, unconnected. Verify
+        # that node0 has the transactions in its mempool and node1 does not.
+        stop_nodes(self.nodes)
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-persistmempool=0"]))
+        self.wait_for_mempool_size(self.nodes[0], 5)
+        assert_equal(len(self.nodes[1].getrawmempool()), 0)
+
+        reloaded = self.nodes[0].getmempoolentry(txid)
+        assert_equal(reloaded['time'], entry['time'])
+        assert_equal(reloaded['modifiedfee'], entry['modifiedfee'])
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
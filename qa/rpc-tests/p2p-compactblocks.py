@@ -719,6 +719,49 @@ class CompactBlocksTest(BitcoinTestFramework):
                 l.last_cmpctblock.header_and_shortids.header.calc_sha256()
                 assert_equal(l.last_cmpctblock.header_and_shortids.header.sha256, block.sha256)
 
+    # Test that a block extending the tip is sent to high-bandwidth peers as
+    # soon as its header and transactions check out, before it is connected:
+    # a block spending a missing output is announced although it never
+    # becomes the tip. peer_node, which has node as a high-bandwidth peer,
+    # hears of the block only through that early announcement; it must find
+    # the block invalid without banning or disconnecting node (BIP 152).
+    def test_relay_before_connect(self, node, listeners, peer_node):
+        # A block mined on node makes peer_node ask it for high-bandwidth
+        # announcements before the block is fetched
+        node.generate(1)
+        sync_blocks(self.nodes)
+
+        tip = node.getbestblockhash()
+        block = self.build_block_on_tip(node)
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(0xdead, 0), b''))
+        tx.vout.append(CTxOut(1000, CScript([OP_TRUE])))
+        tx.rehash()
+        block.vtx.append(tx)
+        block.hashMerkleRoot = block.calc_merkle_root()
+        block.solve()
+
+        [l.clear_block_announcement() for l in listeners]
+        node.submitblock(ToHex(block))
+        assert_equal(node.getbestblockhash(), tip)
+
+        for l in listeners:
+            assert(l.wait_for_block_announcement(block.sha256))
+        with mininode_lock:
+            for l in listeners:
+                assert(l.last_cmpctblock is not None)
+                l.last_cmpctblock.header_and_shortids.header.calc_sha256()
+                assert_equal(l.last_cmpctblock.header_and_shortids.header.sha256, block.sha256)
+
+        def peer_found_block_invalid():
+            return any(t['hash'] == block.hash and t['status'] == 'invalid' for t in peer_node.getchaintips())
+        assert(wait_until(peer_found_block_invalid, timeout=30))
+        assert_equal(peer_node.getbestblockhash(), tip)
+        assert_equal(peer_node.listbanned(), [])
+        outbound = [p for p in peer_node.getpeerinfo() if not p['inbound']]
+        assert_equal(len(outbound), 1)
+        assert_equal(outbound[0]['banscore'], 0)
+
     # Test that we don't get disconnected if we relay a compact block with valid header,
     # but invalid transactions.
     def test_invalid_tx_in_compactblock(self, node, test_node, use_segwit):
@@ -884,6 +927,9 @@ class CompactBlocksTest(BitcoinTestFramework):
         self.test_end_to_end_block_relay(self.nodes[0], [self.segwit_node, self.test_node, self.old_node])
         self.test_end_to_end_block_relay(self.nodes[1], [self.segwit_node, self.test_node, self.old_node])
 
+        print("\tTesting relay to high-bandwidth peers before connecting...")
+        self.test_relay_before_connect(self.nodes[1], [self.segwit_node, self.old_node, self.test_node], self.nodes[0])
+
         print("\tTesting handling of invalid compact blocks...")
         self.test_invalid_tx_in_compactblock(self.nodes[0], self.test_node, False)
         self.test_invalid_tx_in_compactblock(self.nodes[1], self.segwit_node, False)
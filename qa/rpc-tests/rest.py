@@ -274,6 +274,33 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(response_header_json_str)
         assert_equal(len(json_obj), 5) #now we should have 5 header objects
 
+        # /rest/blockhashbyheight/ #
+        bb_height = self.nodes[0].getblock(bb_hash)['height']
+        json_string = http_get_call(url.hostname, url.port, '/rest/blockhashbyheight/'+str(bb_height)+self.FORMAT_SEPARATOR+'json')
+        assert_equal(json.loads(json_string)['blockhash'], bb_hash)
+        response = http_get_call(url.hostname, url.port, '/rest/blockhashbyheight/'+str(bb_height + 1000)+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 404)
+
+        # /rest/headersbyheight/ and /rest/blocks/ stream a height range #
+        response = http_get_call(url.hostname, url.port, '/rest/headersbyheight/'+str(bb_height)+'/5'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(response.getheader('transfer-encoding'), 'chunked')
+        headers_str = response.read()
+        assert_equal(len(headers_str), 5*80)
+        assert_equal(headers_str[0:80], response_header_str)
+
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(bb_height)+'/6'+self.FORMAT_SEPARATOR+'hex', True)
+        assert_equal(response.status, 200)
+        blocks_hex = response.read().decode('utf-8').rstrip()
+        expected_hex = ''
+        for height in range(bb_height, bb_height + 6):
+            expected_hex += self.nodes[0].getblock(self.nodes[0].getblockhash(height), False)
+        assert_equal(blocks_hex, expected_hex)
+
+        # the range ends at the tip
+        response = http_get_call(url.hostname, url.port, '/rest/headersbyheight/'+str(bb_height)+'/1000'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(len(response.read()), (self.nodes[0].getblockcount() - bb_height + 1)*80)
+
         # do tx test
         tx_hash = block_json_obj['tx'][0]['txid']
         json_string = http_get_call(url.hostname, url.port, '/rest/tx/'+tx_hash+self.FORMAT_SEPARATOR+"json")
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014-2016 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the sendrawtransactions batch RPC.
+#
+# Test is as follows:
+#
+#  - submit a batch to node0 with 20 transactions, a child of the
+#    first of them, a transaction that does not decode, a double
+#    spend and a transaction with missing inputs. Verify the result
+#    of each and that the accepted ones reach node1.
+#  - resubmit the batch after mining it, and verify that the
+#    transactions with unspent outputs are reported to be in the
+#    block chain.
+#  - verify that a batch over the limit is refused as a whole.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class SendRawTransactionsTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+        self.setup_clean_chain = False
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def spend(self, node, inputs, amount, prevtxs=None):
+        raw = node.createrawtransaction(inputs, {node.getnewaddress(): amount})
+        signed = node.signrawtransaction(raw, prevtxs)
+        assert(signed["complete"])
+        return signed["hex"]
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(1)
+        self.sync_all()
+
+        utxos = [u for u in node.listunspent() if u["amount"] > 1][:21]
+        batch = []
+        for utxo in utxos[:20]:
+            batch.append(self.spend(node, [{"txid": utxo["txid"], "vout": utxo["vout"]}], utxo["amount"] - Decimal("0.1")))
+
+        # A child of the first transaction of the batch
+        parent = node.decoderawtransaction(batch[0])
+        prevtx = {"txid": parent["txid"], "vout": 0, "scriptPubKey": parent["vout"][0]["scriptPubKey"]["hex"], "amount": parent["vout"][0]["value"]}
+        batch.append(self.spend(node, [{"txid": parent["txid"], "vout": 0}], parent["vout"][0]["value"] - Decimal("0.1"), [prevtx]))
+
+        # Garbage, a double spend of the second one, and missing inputs
+        batch.append("00")
+        utxo = utxos[1]
+        batch.append(self.spend(node, [{"txid": utxo["txid"], "vout": utxo["vout"]}], utxo["amount"] - Decimal("0.05")))
+        batch.append(self.spend(node, [{"txid": "11" * 32, "vout": 0}], Decimal("1"), [dict(prevtx, txid="11" * 32)]))
+
+        results = node.sendrawtransactions(batch)
+        assert_equal(len(results), len(batch))
+        for i in range(21):
+            assert_equal(results[i]["txid"], node.decoderawtransaction(batch[i])["txid"])
+            assert("error" not in results[i])
+        assert_equal(results[21], {"error": {"code": -22, "message": "TX decode failed"}})
+        assert_equal(results[22]["error"]["code"], -26)
+        assert_equal(results[23]["error"], {"code": -25, "message": "Missing inputs"})
+
+        mempool = node.getrawmempool()
+        assert_equal(len(mempool), 21)
+        sync_mempools(self.nodes)
+        assert_equal(sorted(self.nodes[1].getrawmempool()), sorted(mempool))
+
+        # Transactions already in the mempool are accepted again
+        results = node.sendrawtransactions(batch[:21])
+        assert_equal([r for r in results if "error" in r], [])
+
+        node.generate(1)
+        self.sync_all()
+        # The first one is fully spent by its child, so it is not
+        # known to be in the chain anymore
+        results = node.sendrawtransactions(batch[1:21])
+        for result in results:
+            assert_equal(result["error"]["code"], -27)
+
+        assert_raises_message(JSONRPCException, "Too many transactions", node.sendrawtransactions, ["00"] * 10001)
+
+if __name__ == '__main__':
+    SendRawTransactionsTest().main()
@@ -84,3 +84,15 @@ bool State::KeepRunning()
 
     return false;
 }
+
+void State::PauseTiming()
+{
+    pauseTime = gettimedouble();
+}
+
+void State::ResumeTiming()
+{
+    double paused = gettimedouble() - pauseTime;
+    lastTime += paused;
+    beginTime += paused;
+}
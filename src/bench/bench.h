@@ -40,17 +40,20 @@ namespace benchmark {
         std::string name;
         double maxElapsed;
         double beginTime;
-        double lastTime, minTime, maxTime, countMaskInv;
+        double lastTime, minTime, maxTime, countMaskInv, pauseTime;
         int64_t count;
         int64_t countMask;
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
+        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), pauseTime(0), count(0) {
             minTime = std::numeric_limits<double>::max();
             maxTime = std::numeric_limits<double>::min();
             countMask = 1;
             countMaskInv = 1./(countMask + 1);
         }
         bool KeepRunning();
+        //! Leave the setup between PauseTiming and ResumeTiming out of the measurement
+        void PauseTiming();
+        void ResumeTiming();
     };
 
     typedef boost::function<void(State&)> BenchFunction;
@@ -3,19 +3,50 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "mempool_replay.h"
 
+#include "chainparams.h"
+#include "clientversion.h"
 #include "key.h"
 #include "main.h"
+#include "streams.h"
 #include "util.h"
 
+#include <stdio.h>
+
 int
 main(int argc, char** argv)
 {
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    ParseParameters(argc, argv);
+    SelectParams(CBaseChainParams::MAIN);
 
-    benchmark::BenchRunner::RunAll();
+    if (mapArgs.count("-mempoolreplay")) {
+        // Replay a trace recorded by -mempoolrecord instead of the benchmarks
+        std::string strFile = GetArg("-mempoolreplay", "");
+        CAutoFile filein(fopen(strFile.c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            fprintf(stderr, "Error: cannot open mempool trace %s\n", strFile.c_str());
+            ECC_Stop();
+            return 1;
+        }
+        CMempoolTraceHeader header;
+        std::vector<CMempoolTraceRecord> vRecords;
+        try {
+            ReadMempoolTrace(filein, header, vRecords);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "Error: reading mempool trace %s: %s\n", strFile.c_str(), e.what());
+            ECC_Stop();
+            return 1;
+        }
+        MempoolReplayTimes times;
+        ReplayMempoolTrace(header, vRecords, times);
+        PrintMempoolReplayTimes(times);
+    } else {
+        benchmark::BenchRunner::RunAll();
+    }
 
     ECC_Stop();
 }
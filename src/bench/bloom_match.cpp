@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bloom.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/script.h"
+
+#include <limits>
+#include <vector>
+
+// Transactions relayed to many peers with bloom filters, as the trickle of
+// an SPV-serving node sees them
+static const int FILTERED_PEERS = 500;
+
+static std::vector<unsigned char> RandomBytes(size_t nSize)
+{
+    std::vector<unsigned char> vch(nSize);
+    GetRandBytes(vch.data(), nSize);
+    return vch;
+}
+
+static std::vector<CTransaction> MakeTransactions()
+{
+    std::vector<CTransaction> vTxs;
+    for (int n = 0; n < 20; n++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+            mtx.vin[i].prevout = COutPoint(GetRandHash(), i);
+            mtx.vin[i].scriptSig = CScript() << RandomBytes(72) << RandomBytes(33);
+        }
+        mtx.vout.resize(2);
+        for (unsigned int i = 0; i < mtx.vout.size(); i++)
+            mtx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << RandomBytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        vTxs.push_back(CTransaction(mtx));
+    }
+    return vTxs;
+}
+
+static std::vector<CBloomFilter> MakeFilters()
+{
+    std::vector<CBloomFilter> vFilters;
+    for (int f = 0; f < FILTERED_PEERS; f++) {
+        // A wallet's worth of addresses and a low false positive rate
+        CBloomFilter filter(100, 0.0001, GetRand(std::numeric_limits<uint32_t>::max()), BLOOM_UPDATE_ALL);
+        for (int i = 0; i < 50; i++)
+            filter.insert(RandomBytes(20));
+        vFilters.push_back(filter);
+    }
+    return vFilters;
+}
+
+static void BloomMatchPerFilter(benchmark::State& state)
+{
+    std::vector<CTransaction> vTxs = MakeTransactions();
+    std::vector<CBloomFilter> vFilters = MakeFilters();
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        const CTransaction& tx = vTxs[n++ % vTxs.size()];
+        for (size_t f = 0; f < vFilters.size(); f++)
+            vFilters[f].IsRelevantAndUpdate(tx);
+    }
+}
+
+static void BloomMatchSharedElements(benchmark::State& state)
+{
+    std::vector<CTransaction> vTxs = MakeTransactions();
+    std::vector<CBloomFilter> vFilters = MakeFilters();
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        const CBloomTxElements elements(vTxs[n++ % vTxs.size()]);
+        for (size_t f = 0; f < vFilters.size(); f++)
+            vFilters[f].IsRelevantAndUpdate(elements);
+    }
+}
+
+static void BloomMatchBatch(benchmark::State& state)
+{
+    std::vector<CTransaction> vTxs = MakeTransactions();
+    std::vector<CBloomFilter> vFilters = MakeFilters();
+    std::vector<CBloomFilter*> vpFilters;
+    for (size_t f = 0; f < vFilters.size(); f++)
+        vpFilters.push_back(&vFilters[f]);
+    std::vector<bool> vMatch;
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        const CBloomTxElements elements(vTxs[n++ % vTxs.size()]);
+        CBloomFilter::MatchBatch(elements, vpFilters, vMatch);
+    }
+}
+
+BENCHMARK(BloomMatchPerFilter);
+BENCHMARK(BloomMatchSharedElements);
+BENCHMARK(BloomMatchBatch);
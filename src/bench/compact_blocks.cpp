@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "blockencodings.h"
+#include "mempool_util.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "txmempool.h"
+
+#include <memory>
+#include <vector>
+
+// A compact block of BLOCK_TXS transactions, the best paying ones of a
+// mempool of MEMPOOL_TXS, which received them among the others
+static const int MEMPOOL_TXS = 20000;
+static const int BLOCK_TXS = 2000;
+static const int BLOCK_TX_SPACING = MEMPOOL_TXS / BLOCK_TXS;
+
+static void CompactBlockReconstruct(benchmark::State& state, bool fMissingTx)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    std::vector<CTransaction> vTxs;
+    uint32_t nState = 5;
+    {
+        LOCK(pool.cs);
+        for (int i = 0; i < MEMPOOL_TXS; i++) {
+            vTxs.push_back(BenchTransaction(COutPoint(uint256S("0x4"), i), 1));
+            CAmount nFee = i % BLOCK_TX_SPACING == 0 ? 100000 : 100 + BenchRand(nState) % 1000;
+            AddToPool(pool, CTxMemPoolEntry(vTxs.back(), nFee, 0, 0, 1, true, 0, false, 1, LockPoints()));
+        }
+    }
+
+    CBlock block;
+    block.nBits = 0x207fffff;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    block.vtx.push_back(CTransaction(coinbase));
+    for (int i = 0; i < MEMPOOL_TXS; i += BLOCK_TX_SPACING)
+        block.vtx.push_back(vTxs[i]);
+    // A transaction the mempool never saw, as is common in partial reconstruction
+    if (fMissingTx)
+        block.vtx.push_back(BenchTransaction(COutPoint(uint256S("0x5"), 0), 1));
+    CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+
+    std::vector<std::pair<uint256, std::shared_ptr<const CTransaction> > > extra_txn;
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partialBlock(&pool);
+        partialBlock.InitData(cmpctblock, extra_txn);
+    }
+}
+
+static void CompactBlockReconstructFull(benchmark::State& state)
+{
+    CompactBlockReconstruct(state, false);
+}
+
+static void CompactBlockReconstructMissingTx(benchmark::State& state)
+{
+    CompactBlockReconstruct(state, true);
+}
+
+BENCHMARK(CompactBlockReconstructFull);
+BENCHMARK(CompactBlockReconstructMissingTx);
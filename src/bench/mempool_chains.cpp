@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "mempool_util.h"
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "txmempool.h"
+
+#include <vector>
+
+// A long chain of unconfirmed transactions, as batch payouts that each
+// spend the change of the one before make
+static const int CHAIN_LENGTH = 500;
+
+static std::vector<CTransaction> MakeChain(int nLength)
+{
+    std::vector<CTransaction> vChain;
+    uint256 hashPrev = uint256S("0x1");
+    for (int i = 0; i < nLength; i++) {
+        vChain.push_back(BenchTransaction(COutPoint(hashPrev, 0), 2));
+        hashPrev = vChain.back().GetHash();
+    }
+    return vChain;
+}
+
+static CTxMemPoolEntry MakeEntry(const CTransaction& tx)
+{
+    return CTxMemPoolEntry(tx, 1000, 0, 0, 1, false, 0, false, 1, LockPoints());
+}
+
+static void MempoolAddChain(benchmark::State& state)
+{
+    std::vector<CTransaction> vChain = MakeChain(CHAIN_LENGTH / 5);
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        LOCK(pool.cs);
+        for (size_t i = 0; i < vChain.size(); i++)
+            AddToPool(pool, MakeEntry(vChain[i]));
+    }
+}
+
+static void MempoolAncestorsDeepChain(benchmark::State& state)
+{
+    std::vector<CTransaction> vChain = MakeChain(CHAIN_LENGTH + 1);
+    CTxMemPool pool(CFeeRate(1000));
+    LOCK(pool.cs);
+    for (int i = 0; i < CHAIN_LENGTH; i++)
+        AddToPool(pool, MakeEntry(vChain[i]));
+    const CTxMemPoolEntry entry = MakeEntry(vChain.back());
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries setAncestors;
+        std::string dummy;
+        pool.CalculateMemPoolAncestors(entry, setAncestors, NO_LIMIT, NO_LIMIT, NO_LIMIT, NO_LIMIT, dummy);
+        assert(setAncestors.size() == (size_t)CHAIN_LENGTH);
+    }
+}
+
+static void MempoolDescendantsDeepChain(benchmark::State& state)
+{
+    std::vector<CTransaction> vChain = MakeChain(CHAIN_LENGTH);
+    CTxMemPool pool(CFeeRate(1000));
+    LOCK(pool.cs);
+    for (int i = 0; i < CHAIN_LENGTH; i++)
+        AddToPool(pool, MakeEntry(vChain[i]));
+    CTxMemPool::txiter root = pool.mapTx.find(vChain[0].GetHash());
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries setDescendants;
+        pool.CalculateDescendants(root, setDescendants);
+        assert(setDescendants.size() == (size_t)CHAIN_LENGTH);
+    }
+}
+
+BENCHMARK(MempoolAddChain);
+BENCHMARK(MempoolAncestorsDeepChain);
+BENCHMARK(MempoolDescendantsDeepChain);
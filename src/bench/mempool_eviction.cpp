@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "mempool_util.h"
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "txmempool.h"
+
+#include <memory>
+#include <vector>
+
+// A mempool after a flood: many small packages at similar low fee rates,
+// some of them parents bumped by a child, among fewer well-paying ones,
+// and well-paying parents each spent by many cheap children
+static const int FLOOD_PACKAGES = 1000;
+static const int FLOOD_CHAIN_LENGTH = 3;
+static const int FLOOD_FANOUTS = 60;
+static const int FLOOD_FANOUT_WIDTH = 24;
+
+struct FloodTx
+{
+    CTransaction tx;
+    CAmount nFee;
+    FloodTx(const CTransaction& _tx, CAmount _nFee) : tx(_tx), nFee(_nFee) {}
+};
+
+static std::vector<FloodTx> MakeFlood()
+{
+    uint32_t nState = 7;
+    std::vector<FloodTx> vFlood;
+    for (int i = 0; i < FLOOD_PACKAGES; i++) {
+        COutPoint prevout(uint256S("0x2"), i);
+        for (int j = 0; j < FLOOD_CHAIN_LENGTH; j++) {
+            CAmount nFee = 100 + BenchRand(nState) % 1000;
+            if (i % 10 == 0)
+                nFee *= 50;
+            vFlood.push_back(FloodTx(BenchTransaction(prevout, 1), nFee));
+            prevout = COutPoint(vFlood.back().tx.GetHash(), 0);
+        }
+    }
+    for (int i = 0; i < FLOOD_FANOUTS; i++) {
+        vFlood.push_back(FloodTx(BenchTransaction(COutPoint(uint256S("0x3"), i), FLOOD_FANOUT_WIDTH), 5000 + BenchRand(nState) % 50000));
+        uint256 hashParent = vFlood.back().tx.GetHash();
+        for (int j = 0; j < FLOOD_FANOUT_WIDTH; j++) {
+            vFlood.push_back(FloodTx(BenchTransaction(COutPoint(hashParent, j), 1), 100 + BenchRand(nState) % 1000));
+        }
+    }
+    return vFlood;
+}
+
+static void FillPool(CTxMemPool& pool, const std::vector<FloodTx>& vFlood)
+{
+    LOCK(pool.cs);
+    for (size_t i = 0; i < vFlood.size(); i++)
+        AddToPool(pool, CTxMemPoolEntry(vFlood[i].tx, vFlood[i].nFee, i, 0, 1, false, 0, false, 1, LockPoints()));
+}
+
+// Shrinking the pool to a quarter of its size in one call, as when a flood
+// is followed by a block's worth of better transactions or a lower -maxmempool.
+// Only the trim is timed.
+static void MempoolEvictFlood(benchmark::State& state)
+{
+    std::vector<FloodTx> vFlood = MakeFlood();
+    std::unique_ptr<CTxMemPool> pool;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        pool.reset(new CTxMemPool(CFeeRate(1000)));
+        FillPool(*pool, vFlood);
+        state.ResumeTiming();
+        pool->TrimToSize(pool->DynamicMemoryUsage() / 4);
+    }
+}
+
+BENCHMARK(MempoolEvictFlood);
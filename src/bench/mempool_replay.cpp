@@ -0,0 +1,208 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempool_replay.h"
+
+#include "bench.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "mempool_util.h"
+#include "miner.h"
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <memory>
+
+//! The confirmation targets estimated after each block
+static const int REPLAY_ESTIMATE_TARGETS[] = {2, 6, 25};
+
+static void ReplayTransaction(CTxMemPool& pool, const CMempoolTraceHeader& header, const CMempoolTraceRecord& record)
+{
+    LOCK(pool.cs);
+    const CTransaction& tx = record.tx;
+    if (pool.exists(tx.GetHash()))
+        return;
+
+    // What it replaced in the node's mempool
+    std::list<CTransaction> removed;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+        auto it = pool.mapNextTx.find(txin.prevout);
+        if (it != pool.mapNextTx.end())
+            pool.removeRecursive(*it->second, removed);
+    }
+
+    CTxMemPoolEntry entry(tx, record.nFee, record.nTime, record.dPriority, record.nHeight,
+                          pool.HasNoInputsOf(tx), record.inChainInputValue,
+                          record.fSpendsCoinbase, record.nSigOpsCost, LockPoints());
+    AddToPool(pool, entry, true);
+
+    pool.Expire(record.nTime - header.nMempoolExpiry);
+    pool.TrimToSize(header.nMaxMempoolSize);
+}
+
+void ReplayMempoolTrace(const CMempoolTraceHeader& header, const std::vector<CMempoolTraceRecord>& vRecords, MempoolReplayTimes& times)
+{
+    CFeeRate minRelayFee(DEFAULT_MIN_RELAY_TX_FEE);
+    CTxMemPool pool(minRelayFee);
+
+    BOOST_FOREACH(const CMempoolTraceRecord& record, vRecords) {
+        int64_t nStart = GetTimeMicros();
+        switch (record.nType) {
+        case MEMPOOL_TRACE_TX:
+            ReplayTransaction(pool, header, record);
+            times.vTx.push_back(GetTimeMicros() - nStart);
+            break;
+        case MEMPOOL_TRACE_BLOCK: {
+            // The template a miner would have built just before the block
+            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params(), pool).SelectTransactions(record.nHeight, record.nTime, true));
+            times.vTemplate.push_back(GetTimeMicros() - nStart);
+
+            nStart = GetTimeMicros();
+            std::list<CTransaction> conflicts;
+            pool.removeForBlock(record.vtx, record.nHeight, conflicts, true);
+            times.vBlock.push_back(GetTimeMicros() - nStart);
+
+            for (unsigned int i = 0; i < sizeof(REPLAY_ESTIMATE_TARGETS) / sizeof(REPLAY_ESTIMATE_TARGETS[0]); i++) {
+                nStart = GetTimeMicros();
+                pool.estimateSmartFee(REPLAY_ESTIMATE_TARGETS[i]);
+                times.vEstimate.push_back(GetTimeMicros() - nStart);
+            }
+            break;
+        }
+        case MEMPOOL_TRACE_DISCONNECT:
+            pool.UpdateTransactionsFromBlock(record.vHashUpdate);
+            times.vDisconnect.push_back(GetTimeMicros() - nStart);
+            break;
+        }
+    }
+}
+
+static void PrintTimes(const std::string& strName, std::vector<int64_t>& vTimes)
+{
+    std::cout << strName << "," << vTimes.size();
+    if (vTimes.empty()) {
+        std::cout << ",,,,\n";
+        return;
+    }
+    std::sort(vTimes.begin(), vTimes.end());
+    static const int percentiles[] = {50, 90, 99};
+    for (unsigned int i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+        std::cout << "," << vTimes[std::min(vTimes.size() - 1, vTimes.size() * percentiles[i] / 100)];
+    std::cout << "," << vTimes.back() << "\n";
+}
+
+void PrintMempoolReplayTimes(MempoolReplayTimes& times)
+{
+    std::cout << "#Operation,count,p50,p90,p99,max (microseconds)\n";
+    PrintTimes("tx", times.vTx);
+    PrintTimes("template", times.vTemplate);
+    PrintTimes("block", times.vBlock);
+    PrintTimes("estimate", times.vEstimate);
+    PrintTimes("disconnect", times.vDisconnect);
+}
+
+// A synthetic trace, for when no recorded one is at hand: every block,
+// SYNTHETIC_TXS_PER_BLOCK transactions arrive, some of them in chains, and
+// the block confirms fewer than that of the oldest ones, so the mempool
+// grows. One block is reorged out, its transactions going back to the
+// mempool ahead of their in-mempool children, and mined again.
+static const unsigned int SYNTHETIC_BLOCKS = 30;
+static const unsigned int SYNTHETIC_TXS_PER_BLOCK = 120;
+static const unsigned int SYNTHETIC_CONFIRMED_PER_BLOCK = 90;
+static const unsigned int SYNTHETIC_CHAIN_LENGTH = 3;
+static const unsigned int SYNTHETIC_REORG_BLOCK = 20;
+
+static std::vector<CMempoolTraceRecord> MakeSyntheticTrace()
+{
+    std::vector<CMempoolTraceRecord> vRecords;
+    std::list<CTransaction> pending;
+    uint32_t nState = 11;
+    int64_t nTime = 1500000000;
+    unsigned int nFunding = 0;
+    CTransaction prev;
+
+    for (unsigned int nHeight = 1; nHeight <= SYNTHETIC_BLOCKS; nHeight++) {
+        for (unsigned int i = 0; i < SYNTHETIC_TXS_PER_BLOCK; i++) {
+            CMempoolTraceRecord record;
+            record.nType = MEMPOOL_TRACE_TX;
+            record.nTime = nTime++;
+            record.nHeight = nHeight - 1;
+            if (i % SYNTHETIC_CHAIN_LENGTH == 0)
+                record.tx = BenchTransaction(COutPoint(uint256S("0x3"), nFunding++), 2);
+            else
+                record.tx = BenchTransaction(COutPoint(prev.GetHash(), 0), 2);
+            record.nFee = 200 + BenchRand(nState) % 5000;
+            record.inChainInputValue = i % SYNTHETIC_CHAIN_LENGTH == 0 ? 20000 : 0;
+            record.nSigOpsCost = 4;
+            vRecords.push_back(record);
+            pending.push_back(record.tx);
+            prev = record.tx;
+        }
+
+        CMempoolTraceRecord block;
+        block.nType = MEMPOOL_TRACE_BLOCK;
+        block.nTime = nTime;
+        block.nHeight = nHeight;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+        coinbase.vout.resize(1);
+        block.vtx.push_back(CTransaction(coinbase));
+        // The oldest arrivals, so parents are confirmed before their children
+        for (unsigned int i = 0; i < SYNTHETIC_CONFIRMED_PER_BLOCK && !pending.empty(); i++) {
+            block.vtx.push_back(pending.front());
+            pending.pop_front();
+        }
+        vRecords.push_back(block);
+
+        if (nHeight == SYNTHETIC_REORG_BLOCK) {
+            CMempoolTraceRecord disconnect;
+            disconnect.nType = MEMPOOL_TRACE_DISCONNECT;
+            disconnect.nTime = nTime;
+            disconnect.nHeight = nHeight - 1;
+            for (unsigned int i = 1; i < block.vtx.size(); i++) {
+                CMempoolTraceRecord record;
+                record.nType = MEMPOOL_TRACE_TX;
+                record.nTime = nTime;
+                record.nHeight = nHeight - 1;
+                record.tx = block.vtx[i];
+                record.nFee = 1000;
+                record.nSigOpsCost = 4;
+                vRecords.push_back(record);
+                disconnect.vHashUpdate.push_back(block.vtx[i].GetHash());
+            }
+            vRecords.push_back(disconnect);
+            vRecords.push_back(block);
+        }
+    }
+    return vRecords;
+}
+
+static void MempoolReplay(benchmark::State& state)
+{
+    // Go through a trace file as a recorded trace would
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    file << CMempoolTraceHeader(DEFAULT_MAX_MEMPOOL_SIZE * 1000000, DEFAULT_MEMPOOL_EXPIRY * 60 * 60);
+    BOOST_FOREACH(const CMempoolTraceRecord& record, MakeSyntheticTrace())
+        file << record;
+    rewind(file.Get());
+    CMempoolTraceHeader header;
+    std::vector<CMempoolTraceRecord> vRecords;
+    ReadMempoolTrace(file, header, vRecords);
+
+    while (state.KeepRunning()) {
+        MempoolReplayTimes times;
+        ReplayMempoolTrace(header, vRecords, times);
+    }
+}
+
+BENCHMARK(MempoolReplay);
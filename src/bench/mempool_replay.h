@@ -0,0 +1,38 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_MEMPOOL_REPLAY_H
+#define BITCOIN_BENCH_MEMPOOL_REPLAY_H
+
+#include "txmempooltrace.h"
+
+#include <stdint.h>
+#include <vector>
+
+/** The latency of every operation of a replayed mempool trace, in microseconds */
+struct MempoolReplayTimes
+{
+    //! Accepting a transaction, with its conflicts, expiry and trimming
+    std::vector<int64_t> vTx;
+    //! Selecting the transactions of a block template before each block
+    std::vector<int64_t> vTemplate;
+    //! Removing the transactions of a block and updating the fee estimator
+    std::vector<int64_t> vBlock;
+    //! Fee estimates after each block
+    std::vector<int64_t> vEstimate;
+    //! Updating the descendants of the transactions a reorg put back
+    std::vector<int64_t> vDisconnect;
+};
+
+/**
+ * Replay a mempool trace against a fresh mempool, its fee estimator and the
+ * block assembler, with the mempool limits in header, adding the latency of
+ * each operation to times.
+ */
+void ReplayMempoolTrace(const CMempoolTraceHeader& header, const std::vector<CMempoolTraceRecord>& vRecords, MempoolReplayTimes& times);
+
+/** Print the count and the 50th, 90th, 99th percentile and maximum latency of each operation */
+void PrintMempoolReplayTimes(MempoolReplayTimes& times);
+
+#endif // BITCOIN_BENCH_MEMPOOL_REPLAY_H
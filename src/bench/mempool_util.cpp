@@ -0,0 +1,37 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempool_util.h"
+
+#include "script/script.h"
+#include "txmempool.h"
+
+uint32_t BenchRand(uint32_t& nState)
+{
+    nState = nState * 1103515245 + 12345;
+    return nState >> 8;
+}
+
+CTransaction BenchTransaction(const COutPoint& prevout, unsigned int nOutputs)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = prevout;
+    mtx.vin[0].scriptSig = CScript() << OP_1;
+    mtx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        mtx.vout[i].nValue = 10000;
+        mtx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return CTransaction(mtx);
+}
+
+void AddToPool(CTxMemPool& pool, const CTxMemPoolEntry& entry, bool fCurrentEstimate)
+{
+    AssertLockHeld(pool.cs);
+    CTxMemPool::setEntries setAncestors;
+    std::string dummy;
+    pool.CalculateMemPoolAncestors(entry, setAncestors, NO_LIMIT, NO_LIMIT, NO_LIMIT, NO_LIMIT, dummy);
+    pool.addUnchecked(entry.GetTx().GetHash(), entry, setAncestors, fCurrentEstimate);
+}
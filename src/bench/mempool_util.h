@@ -0,0 +1,28 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_MEMPOOL_UTIL_H
+#define BITCOIN_BENCH_MEMPOOL_UTIL_H
+
+#include "primitives/transaction.h"
+
+#include <limits>
+#include <stdint.h>
+
+class CTxMemPool;
+class CTxMemPoolEntry;
+
+//! No limit on the ancestors and descendants of the transactions a benchmark adds
+static const uint64_t NO_LIMIT = std::numeric_limits<uint64_t>::max();
+
+/** A deterministic generator, so every run of a benchmark sees the same transactions */
+uint32_t BenchRand(uint32_t& nState);
+
+/** A transaction spending prevout to nOutputs outputs anyone can spend */
+CTransaction BenchTransaction(const COutPoint& prevout, unsigned int nOutputs);
+
+/** Add entry to pool below its in-mempool ancestors, whatever their number. Requires pool.cs. */
+void AddToPool(CTxMemPool& pool, const CTxMemPoolEntry& entry, bool fCurrentEstimate = false);
+
+#endif // BITCOIN_BENCH_MEMPOOL_UTIL_H
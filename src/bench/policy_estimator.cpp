@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "mempool_util.h"
+#include "policy/fees.h"
+#include "primitives/transaction.h"
+#include "txmempool.h"
+
+#include <vector>
+
+// A trace of a busy mempool: every block, TRACE_TXS_PER_BLOCK transactions
+// enter it, and each is mined after a number of blocks that shrinks as its
+// fee rate grows. Some wait longer than the estimator tracks.
+static const unsigned int TRACE_BLOCKS = 150;
+static const unsigned int TRACE_TXS_PER_BLOCK = 200;
+//! The transactions that enter the mempool between two estimatesmartfee calls
+static const unsigned int TRACE_TXS_PER_ESTIMATE = 10;
+
+struct TraceTx
+{
+    CTxMemPoolEntry entry;
+    unsigned int nConfirmHeight;
+    TraceTx(const CTxMemPoolEntry& _entry, unsigned int _nConfirmHeight) : entry(_entry), nConfirmHeight(_nConfirmHeight) {}
+};
+
+static std::vector<std::vector<TraceTx> > MakeTrace()
+{
+    uint32_t nState = 42;
+    std::vector<std::vector<TraceTx> > vTrace(TRACE_BLOCKS);
+    for (unsigned int nHeight = 1; nHeight < TRACE_BLOCKS; nHeight++) {
+        for (unsigned int i = 0; i < TRACE_TXS_PER_BLOCK; i++) {
+            CTransaction tx = BenchTransaction(COutPoint(uint256S("0x1"), nHeight * TRACE_TXS_PER_BLOCK + i), 1);
+
+            // Fee rates from 1 to about 500 satoshis per byte
+            unsigned int nFeeRate = 1 + (BenchRand(nState) % 100) * (BenchRand(nState) % 100) / 20;
+            CAmount nFee = nFeeRate * ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nDelay = 1 + BenchRand(nState) % (1 + 1000 / (nFeeRate + 20));
+            CTxMemPoolEntry entry(tx, nFee, 0, 0, nHeight, true, 0, false, 1, LockPoints());
+            unsigned int nConfirmHeight = nHeight + nDelay;
+            if (nConfirmHeight < TRACE_BLOCKS)
+                vTrace[nConfirmHeight].push_back(TraceTx(entry, nConfirmHeight));
+            vTrace[nHeight].push_back(TraceTx(entry, nConfirmHeight));
+        }
+    }
+    return vTrace;
+}
+
+/**
+ * Replay the trace into estimator: vTrace[h] holds the transactions mined in
+ * block h, followed by those entering the mempool after it.
+ */
+static void ReplayTrace(const std::vector<std::vector<TraceTx> >& vTrace, CBlockPolicyEstimator& estimator, const CTxMemPool& pool)
+{
+    int nAnswerFound;
+    unsigned int nEstimates = 0;
+    for (unsigned int nHeight = 1; nHeight < vTrace.size(); nHeight++) {
+        std::vector<CTxMemPoolEntry> vMined;
+        for (size_t i = 0; i < vTrace[nHeight].size(); i++) {
+            const TraceTx& traceTx = vTrace[nHeight][i];
+            if (traceTx.nConfirmHeight == nHeight) {
+                estimator.removeTx(traceTx.entry.GetTx().GetHash());
+                vMined.push_back(traceTx.entry);
+            }
+        }
+        estimator.processBlock(nHeight, vMined, true);
+
+        for (size_t i = 0; i < vTrace[nHeight].size(); i++) {
+            const TraceTx& traceTx = vTrace[nHeight][i];
+            if (traceTx.nConfirmHeight == nHeight)
+                continue;
+            estimator.processTransaction(traceTx.entry, true);
+            if (i % TRACE_TXS_PER_ESTIMATE == 0)
+                estimator.estimateSmartFee(1 + nEstimates++ % MAX_BLOCK_CONFIRMS, &nAnswerFound, pool);
+        }
+    }
+}
+
+static void PolicyEstimatorReplay(benchmark::State& state)
+{
+    std::vector<std::vector<TraceTx> > vTrace = MakeTrace();
+    CTxMemPool pool(CFeeRate(1000));
+    while (state.KeepRunning()) {
+        CBlockPolicyEstimator estimator(CFeeRate(1000));
+        ReplayTrace(vTrace, estimator, pool);
+    }
+}
+
+static void PolicyEstimatorSmartFeeAllTargets(benchmark::State& state)
+{
+    std::vector<std::vector<TraceTx> > vTrace = MakeTrace();
+    CTxMemPool pool(CFeeRate(1000));
+    CBlockPolicyEstimator estimator(CFeeRate(1000));
+    ReplayTrace(vTrace, estimator, pool);
+
+    int nAnswerFound;
+    while (state.KeepRunning()) {
+        for (unsigned int nTarget = 1; nTarget <= MAX_BLOCK_CONFIRMS; nTarget++)
+            estimator.estimateSmartFee(nTarget, &nAnswerFound, pool);
+    }
+}
+
+BENCHMARK(PolicyEstimatorReplay);
+BENCHMARK(PolicyEstimatorSmartFeeAllTargets);
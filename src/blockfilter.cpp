@@ -0,0 +1,282 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+
+namespace {
+
+/** Appends bits to a byte vector, most significant bit first */
+class CBitWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    unsigned char chBuffer;
+    int nBits; //!< Number of bits used in chBuffer
+
+public:
+    CBitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), chBuffer(0), nBits(0) {}
+
+    /** Write the nCount low bits of nData (nCount <= 64) */
+    void Write(uint64_t nData, int nCount)
+    {
+        while (nCount > 0) {
+            int nChunk = std::min(8 - nBits, nCount);
+            chBuffer |= ((nData >> (nCount - nChunk)) & ((1 << nChunk) - 1)) << (8 - nBits - nChunk);
+            nBits += nChunk;
+            nCount -= nChunk;
+            if (nBits == 8) {
+                vch.push_back(chBuffer);
+                chBuffer = 0;
+                nBits = 0;
+            }
+        }
+    }
+
+    /** Write out the last partial byte, padded with zero bits */
+    void Flush()
+    {
+        if (nBits > 0) {
+            vch.push_back(chBuffer);
+            chBuffer = 0;
+            nBits = 0;
+        }
+    }
+};
+
+/** Reads bits from a byte vector, most significant bit first */
+class CBitReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t nPos;
+    int nBits; //!< Number of bits of vch[nPos] already consumed
+
+public:
+    CBitReader(const std::vector<unsigned char>& vchIn, size_t nPosIn) : vch(vchIn), nPos(nPosIn), nBits(0) {}
+
+    /** Read nCount bits (nCount <= 64). Throws std::ios_base::failure past the end. */
+    uint64_t Read(int nCount)
+    {
+        uint64_t nData = 0;
+        while (nCount > 0) {
+            if (nPos >= vch.size())
+                throw std::ios_base::failure("CBitReader::Read(): end of data");
+            int nChunk = std::min(8 - nBits, nCount);
+            nData = (nData << nChunk) | ((vch[nPos] >> (8 - nBits - nChunk)) & ((1 << nChunk) - 1));
+            nBits += nChunk;
+            nCount -= nChunk;
+            if (nBits == 8) {
+                nPos++;
+                nBits = 0;
+            }
+        }
+        return nData;
+    }
+};
+
+void GolombRiceEncode(CBitWriter& writer, uint8_t nP, uint64_t x)
+{
+    // Quotient in unary (q ones and a zero), remainder in P bits
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nCount = std::min<uint64_t>(q, 64);
+        writer.Write(~0ULL, nCount);
+        q -= nCount;
+    }
+    writer.Write(0, 1);
+    writer.Write(x, nP);
+}
+
+uint64_t GolombRiceDecode(CBitReader& reader, uint8_t nP)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        q++;
+    return (q << nP) + reader.Read(nP);
+}
+
+/** Map x uniformly into [0, n), i.e. the high 64 bits of x * n */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+    uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF);
+    return ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+#endif
+}
+
+} // anon namespace
+
+CGCSFilter::CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn) :
+    nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn), nN(0), nF(0)
+{
+    vchEncoded.push_back(0); // N as a CompactSize
+}
+
+CGCSFilter::CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+                       const std::vector<unsigned char>& vchEncodedIn) :
+    nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn), vchEncoded(vchEncodedIn)
+{
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nCount = ReadCompactSize(ss);
+    nN = nCount;
+    nF = (uint64_t)nN * nM;
+
+    // Decode all values so a malformed filter is rejected here rather than on first use
+    CBitReader reader(vchEncoded, vchEncoded.size() - ss.size());
+    for (uint32_t i = 0; i < nN; i++)
+        GolombRiceDecode(reader, nP);
+}
+
+CGCSFilter::CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+                       const ElementSet& elements) :
+    nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn)
+{
+    if (elements.size() > MAX_SIZE)
+        throw std::invalid_argument("CGCSFilter: too many elements");
+    nN = elements.size();
+    nF = (uint64_t)nN * nM;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nN);
+    vchEncoded.assign(ss.begin(), ss.end());
+
+    std::vector<uint64_t> vHashed = BuildHashedSet(elements);
+    CBitWriter writer(vchEncoded);
+    uint64_t nLast = 0;
+    for (size_t i = 0; i < vHashed.size(); i++) {
+        GolombRiceEncode(writer, nP, vHashed[i] - nLast);
+        nLast = vHashed[i];
+    }
+    writer.Flush();
+}
+
+uint64_t CGCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(nSipHashK0, nSipHashK1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+std::vector<uint64_t> CGCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (ElementSet::const_iterator it = elements.begin(); it != elements.end(); ++it)
+        vHashed.push_back(HashToRange(*it));
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+bool CGCSFilter::MatchInternal(const std::vector<uint64_t>& vQuery) const
+{
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(ss);
+    CBitReader reader(vchEncoded, vchEncoded.size() - ss.size());
+
+    // Walk the filter and the sorted query in step
+    uint64_t nValue = 0;
+    size_t nQuery = 0;
+    for (uint32_t i = 0; i < nN; i++) {
+        nValue += GolombRiceDecode(reader, nP);
+        while (true) {
+            if (nQuery == vQuery.size())
+                return false;
+            if (vQuery[nQuery] == nValue)
+                return true;
+            if (vQuery[nQuery] > nValue)
+                break;
+            nQuery++;
+        }
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const Element& element) const
+{
+    if (nN == 0)
+        return false;
+    return MatchInternal(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CGCSFilter::MatchAny(const ElementSet& elements) const
+{
+    if (nN == 0)
+        return false;
+    return MatchInternal(BuildHashedSet(elements));
+}
+
+static CGCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockundo)
+{
+    CGCSFilter::ElementSet elements;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            const CScript& script = tx.vout[j].scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.insert(CGCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+    for (unsigned int i = 0; i < blockundo.vtxundo.size(); i++) {
+        const CTxUndo& txundo = blockundo.vtxundo[i];
+        for (unsigned int j = 0; j < txundo.vprevout.size(); j++) {
+            const CScript& script = txundo.vprevout[j].txout.scriptPubKey;
+            if (script.empty())
+                continue;
+            elements.insert(CGCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+    return elements;
+}
+
+CBlockFilter::CBlockFilter(uint8_t nFilterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vchFilter) :
+    nFilterType(nFilterTypeIn), hashBlock(hashBlockIn)
+{
+    Init(vchFilter);
+}
+
+CBlockFilter::CBlockFilter(const CBlock& block, const CBlockUndo& blockundo) :
+    nFilterType(BLOCK_FILTER_BASIC), hashBlock(block.GetHash())
+{
+    // The filter is keyed by the block hash so that its false positives differ per block
+    filter = CGCSFilter(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8),
+                        BASIC_FILTER_P, BASIC_FILTER_M, BasicFilterElements(block, blockundo));
+}
+
+void CBlockFilter::Init(const std::vector<unsigned char>& vchFilter)
+{
+    if (nFilterType != BLOCK_FILTER_BASIC)
+        throw std::ios_base::failure("CBlockFilter: unknown filter type");
+    filter = CGCSFilter(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8),
+                        BASIC_FILTER_P, BASIC_FILTER_M, vchFilter);
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vch = GetEncodedFilter();
+    return Hash(vch.begin(), vch.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& hashPrevHeader) const
+{
+    const uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(), hashPrevHeader.end());
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set: a compact probabilistic filter over a set of byte
+ * vectors (BIP 158). Elements are hashed with SipHash into the range
+ * [0, N * M), sorted, and the differences between successive values are
+ * Golomb-Rice coded with parameter P. False positives occur with
+ * probability 1/M; there are no false negatives.
+ */
+class CGCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    uint32_t nN;
+    uint64_t nF; //!< Range of the hashed values (N * M)
+    std::vector<unsigned char> vchEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    /** Test whether any of the sorted hashed values is in the filter */
+    bool MatchInternal(const std::vector<uint64_t>& vQuery) const;
+
+public:
+    /** Construct an empty filter */
+    CGCSFilter(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, uint8_t nPIn = 0, uint32_t nMIn = 0);
+
+    /** Reconstruct a filter from its encoding. Throws std::ios_base::failure if it is malformed. */
+    CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+               const std::vector<unsigned char>& vchEncodedIn);
+
+    /** Build a filter over a set of elements */
+    CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+               const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    /** Whether the element may be in the set (false positives are possible) */
+    bool Match(const Element& element) const;
+
+    /** Whether any of the elements may be in the set. Cheaper than calling Match for each one. */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+enum BlockFilterType
+{
+    BLOCK_FILTER_BASIC = 0,
+};
+
+//! Golomb-Rice parameter of basic block filters
+static const uint8_t BASIC_FILTER_P = 19;
+//! Inverse false positive rate of basic block filters
+static const uint32_t BASIC_FILTER_M = 784931;
+
+/**
+ * Compact filter over the scripts a block touches: the scriptPubKeys of its
+ * outputs and of the outputs its inputs spend. Light clients download these
+ * instead of having the server match every transaction against their
+ * bloom filter.
+ */
+class CBlockFilter
+{
+private:
+    uint8_t nFilterType;
+    uint256 hashBlock;
+    CGCSFilter filter;
+
+    void Init(const std::vector<unsigned char>& vchFilter);
+
+public:
+    CBlockFilter() : nFilterType(BLOCK_FILTER_BASIC) {}
+
+    /** Reconstruct a filter from its encoding. Throws std::ios_base::failure if it is malformed. */
+    CBlockFilter(uint8_t nFilterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vchFilter);
+
+    /** Compute the basic filter of a block */
+    CBlockFilter(const CBlock& block, const CBlockUndo& blockundo);
+
+    uint8_t GetFilterType() const { return nFilterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const CGCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Hash of the encoded filter */
+    uint256 GetHash() const;
+
+    /** Filter header, committing to this filter and the header of the previous block's filter */
+    uint256 ComputeHeader(const uint256& hashPrevHeader) const;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 32 + ::GetSerializeSize(GetEncodedFilter(), nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ser_writedata8(s, nFilterType);
+        hashBlock.Serialize(s, nType, nVersion);
+        ::Serialize(s, GetEncodedFilter(), nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        std::vector<unsigned char> vchFilter;
+        nFilterType = ser_readdata8(s);
+        hashBlock.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, vchFilter, nType, nVersion);
+        Init(vchFilter);
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -5,6 +5,7 @@
 #include "bloom.h"
 
 #include "primitives/transaction.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "script/script.h"
 #include "script/standard.h"
@@ -133,61 +134,38 @@ bool CBloomFilter::IsWithinSizeConstraints() const
     return vData.size() <= MAX_BLOOM_FILTER_SIZE && nHashFuncs <= MAX_HASH_FUNCS;
 }
 
-bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
+CBloomTxElements::CBloomTxElements(const CTransaction& tx) : hash(tx.GetHash())
 {
-    bool fFound = false;
-    // Match if the filter contains the hash of tx
-    //  for finding tx when they appear in a block
-    if (isFull)
-        return true;
-    if (isEmpty)
-        return false;
-    const uint256& hash = tx.GetHash();
-    if (contains(hash))
-        fFound = true;
+    Add(hash.begin(), hash.end(), 0);
 
+    vPubKeyOutput.resize(tx.vout.size());
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
-        const CTxOut& txout = tx.vout[i];
-        // Match if the filter contains any arbitrary script data element in any scriptPubKey in tx
-        // If this matches, also add the specific output that was matched.
-        // This means clients don't have to update the filter themselves when a new relevant tx 
-        // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
+        const CScript& scriptPubKey = tx.vout[i].scriptPubKey;
+        CScript::const_iterator pc = scriptPubKey.begin();
         vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end())
+        while (pc < scriptPubKey.end())
         {
             opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
+            if (!scriptPubKey.GetOp(pc, opcode, data))
                 break;
-            if (data.size() != 0 && contains(data))
-            {
-                fFound = true;
-                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
-                    insert(COutPoint(hash, i));
-                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY)
-                {
-                    txnouttype type;
-                    vector<vector<unsigned char> > vSolutions;
-                    if (Solver(txout.scriptPubKey, type, vSolutions) &&
-                            (type == TX_PUBKEY || type == TX_MULTISIG))
-                        insert(COutPoint(hash, i));
-                }
-                break;
-            }
+            if (data.size() != 0)
+                Add(data.data(), data.data() + data.size(), i);
         }
+        txnouttype type;
+        vector<vector<unsigned char> > vSolutions;
+        vPubKeyOutput[i] = Solver(scriptPubKey, type, vSolutions) && (type == TX_PUBKEY || type == TX_MULTISIG);
     }
 
-    if (fFound)
-        return true;
-
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    nInputsBegin = vElements.size();
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
-            return true;
+        const CTxIn& txin = tx.vin[i];
+        unsigned char outpoint[36];
+        memcpy(outpoint, txin.prevout.hash.begin(), 32);
+        WriteLE32(outpoint + 32, txin.prevout.n);
+        Add(outpoint, outpoint + 36, i);
 
-        // Match if the filter contains any arbitrary script data element in any scriptSig in tx
         CScript::const_iterator pc = txin.scriptSig.begin();
         vector<unsigned char> data;
         while (pc < txin.scriptSig.end())
@@ -195,12 +173,143 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
             opcodetype opcode;
             if (!txin.scriptSig.GetOp(pc, opcode, data))
                 break;
-            if (data.size() != 0 && contains(data))
-                return true;
+            if (data.size() != 0)
+                Add(data.data(), data.data() + data.size(), i);
         }
     }
+}
+
+void CBloomTxElements::Add(const unsigned char* pBegin, const unsigned char* pEnd, uint32_t nIndex)
+{
+    Element element;
+    element.nBegin = vData.size();
+    element.nSize = pEnd - pBegin;
+    element.nIndex = nIndex;
+    vData.insert(vData.end(), pBegin, pEnd);
+    vElements.push_back(element);
+}
+
+bool CBloomFilter::ContainsHashes(const uint32_t* pHashes) const
+{
+    const uint32_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < nHashFuncs; i++)
+    {
+        uint32_t nIndex = pHashes[i] % nBits;
+        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+            return false;
+    }
+    return true;
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
+{
+    // Skip extracting the elements if the result does not depend on them
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    return IsRelevantAndUpdate(CBloomTxElements(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomTxElements& elements)
+{
+    std::vector<CBloomFilter*> vFilters(1, this);
+    std::vector<bool> vMatch;
+    MatchBatch(elements, vFilters, vMatch);
+    return vMatch[0];
+}
+
+void CBloomFilter::MatchBatch(const CBloomTxElements& elements, const std::vector<CBloomFilter*>& vFilters, std::vector<bool>& vMatch)
+{
+    const size_t nFilters = vFilters.size();
+    vMatch.assign(nFilters, false);
+    // Filters whose result is decided and which have nothing left to update
+    std::vector<bool> vDone(nFilters, false);
+    for (size_t f = 0; f < nFilters; f++)
+    {
+        if (vFilters[f]->isFull)
+            vMatch[f] = true;
+        if (vFilters[f]->isFull || vFilters[f]->isEmpty)
+            vDone[f] = true;
+    }
+
+    // The hash functions of the filters not done yet, side by side: those of
+    // vActive[j] start at vLaneBegin[j]. Rebuilt when a filter is done.
+    std::vector<size_t> vActive;
+    std::vector<size_t> vLaneBegin;
+    std::vector<uint32_t> vSeeds;
+    std::vector<uint32_t> vHashes;
+    bool fRebuild = true;
+    // Output an update-filter was last matched on, to go on with the next output
+    std::vector<uint32_t> vMatchedOutput(nFilters, (uint32_t)-1);
+
+    for (size_t e = 0; e < elements.vElements.size(); e++)
+    {
+        const CBloomTxElements::Element& element = elements.vElements[e];
+        const bool fOutput = e > 0 && e < elements.nInputsBegin;
+        const bool fInput = e >= elements.nInputsBegin;
+        if (e == elements.nInputsBegin)
+        {
+            // Inputs are only checked for filters no output matched
+            for (size_t f = 0; f < nFilters; f++)
+            {
+                if (vMatch[f] && !vDone[f])
+                {
+                    vDone[f] = true;
+                    fRebuild = true;
+                }
+            }
+        }
+        if (fRebuild)
+        {
+            vActive.clear();
+            vLaneBegin.clear();
+            vSeeds.clear();
+            for (size_t f = 0; f < nFilters; f++)
+            {
+                if (vDone[f])
+                    continue;
+                vActive.push_back(f);
+                vLaneBegin.push_back(vSeeds.size());
+                for (unsigned int i = 0; i < vFilters[f]->nHashFuncs; i++)
+                    vSeeds.push_back(vFilters[f]->Seed(i));
+            }
+            vLaneBegin.push_back(vSeeds.size());
+            vHashes.resize(vSeeds.size());
+            fRebuild = false;
+        }
+        if (vActive.empty())
+            break;
+
+        MurmurHash3Multi(vSeeds.data(), vSeeds.size(), elements.vData.data() + element.nBegin, element.nSize, vHashes.data());
 
-    return false;
+        for (size_t j = 0; j < vActive.size(); j++)
+        {
+            const size_t f = vActive[j];
+            CBloomFilter& filter = *vFilters[f];
+            if (vDone[f] || (fOutput && vMatchedOutput[f] == element.nIndex))
+                continue;
+            if (!filter.ContainsHashes(&vHashes[vLaneBegin[j]]))
+                continue;
+            vMatch[f] = true;
+            const unsigned char nUpdate = filter.nFlags & BLOOM_UPDATE_MASK;
+            if (fOutput)
+            {
+                // Add the matched output, so the filter also matches the
+                // transaction spending it
+                vMatchedOutput[f] = element.nIndex;
+                if (nUpdate == BLOOM_UPDATE_ALL ||
+                        (nUpdate == BLOOM_UPDATE_P2PUBKEY_ONLY && elements.vPubKeyOutput[element.nIndex]))
+                    filter.insert(COutPoint(elements.hash, element.nIndex));
+            }
+            // A filter that is not updated needs no more than one match
+            if (fInput || nUpdate == BLOOM_UPDATE_NONE)
+            {
+                vDone[f] = true;
+                fRebuild = true;
+            }
+        }
+    }
 }
 
 void CBloomFilter::UpdateEmptyFull()
@@ -6,12 +6,13 @@
 #define BITCOIN_BLOOM_H
 
 #include "serialize.h"
+#include "uint256.h"
 
+#include <stdint.h>
 #include <vector>
 
 class COutPoint;
 class CTransaction;
-class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -30,6 +31,38 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The data elements of a transaction that bloom filters are matched against:
+ * its txid, the data pushes of its outputs, and the outpoints and data pushes
+ * of its inputs. Extracted once, so a transaction can be matched against the
+ * filters of many peers without parsing its scripts again for each of them.
+ */
+class CBloomTxElements
+{
+public:
+    explicit CBloomTxElements(const CTransaction& tx);
+
+private:
+    friend class CBloomFilter;
+
+    struct Element
+    {
+        uint32_t nBegin; //!< Offset of the element in vData
+        uint32_t nSize;
+        uint32_t nIndex; //!< Output or input the element is from
+    };
+
+    uint256 hash;
+    std::vector<unsigned char> vData;
+    //! The txid, the outputs' data pushes, then each input's outpoint and data pushes
+    std::vector<Element> vElements;
+    size_t nInputsBegin;
+    //! Whether each output pays to a pubkey or multisig, for BLOOM_UPDATE_P2PUBKEY_ONLY
+    std::vector<bool> vPubKeyOutput;
+
+    void Add(const unsigned char* pBegin, const unsigned char* pEnd, uint32_t nIndex);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -52,6 +85,10 @@ private:
     unsigned char nFlags;
 
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    //! Seed of hash function nHashNum
+    uint32_t Seed(unsigned int nHashNum) const { return nHashNum * 0xFBA4C795 + nTweak; }
+    //! Whether the bits of all the MurmurHash3 values of an element, one per hash function, are set
+    bool ContainsHashes(const uint32_t* pHashes) const;
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweak);
@@ -97,9 +134,21 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    bool IsRelevantAndUpdate(const CBloomTxElements& elements);
+
+    /**
+     * Match a transaction against many filters at once, with the same result
+     * and updates as calling IsRelevantAndUpdate on each: vMatch[i] is set to
+     * whether vFilters[i] matched. Each element is hashed for all the filters
+     * in one pass.
+     */
+    static void MatchBatch(const CBloomTxElements& elements, const std::vector<CBloomFilter*>& vFilters, std::vector<bool>& vMatch);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
+
+    //! True if the filter matches all or no transactions, regardless of their contents
+    bool IsFullOrEmpty() const { return isFull || isEmpty; }
 };
 
 /**
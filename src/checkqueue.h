@@ -52,6 +52,10 @@ private:
     //! The temporary evaluation result.
     bool fAllOk;
 
+    //! A verification that failed since the last Wait, if fHaveFailed.
+    T failed;
+    bool fHaveFailed;
+
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
@@ -66,19 +70,26 @@ private:
     unsigned int nBatchSize;
 
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(bool fMaster = false, T* pfailed = NULL)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
         unsigned int nNow = 0;
         bool fOk = true;
+        T checkFailed;
+        bool fCheckFailed = false;
         do {
             {
                 boost::unique_lock<boost::mutex> lock(mutex);
                 // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
                 if (nNow) {
                     fAllOk &= fOk;
+                    if (fCheckFailed && !fHaveFailed) {
+                        failed.swap(checkFailed);
+                        fHaveFailed = true;
+                    }
+                    fCheckFailed = false;
                     nTodo -= nNow;
                     if (nTodo == 0 && !fMaster)
                         // We processed the last element; inform the master it can exit and return the result
@@ -93,8 +104,13 @@ private:
                         nTotal--;
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
+                        if (fMaster) {
+                            if (fHaveFailed && pfailed)
+                                pfailed->swap(failed);
+                            T().swap(failed);
+                            fHaveFailed = false;
                             fAllOk = true;
+                        }
                         // return the current status
                         return fRet;
                     }
@@ -119,16 +135,22 @@ private:
                 fOk = fAllOk;
             }
             // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
+            BOOST_FOREACH (T& check, vChecks) {
+                if (fOk) {
                     fOk = check();
+                    if (!fOk) {
+                        checkFailed.swap(check);
+                        fCheckFailed = true;
+                    }
+                }
+            }
             vChecks.clear();
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), fHaveFailed(false), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -137,9 +159,10 @@ public:
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
-    bool Wait()
+    //! If not and pfailed is given, one of the verifications that failed is stored in it.
+    bool Wait(T* pfailed = NULL)
     {
-        return Loop(true);
+        return Loop(true, pfailed);
     }
 
     //! Add a batch of checks to the queue
@@ -190,11 +213,11 @@ public:
         }
     }
 
-    bool Wait()
+    bool Wait(T* pfailed = NULL)
     {
         if (pqueue == NULL)
             return true;
-        bool fRet = pqueue->Wait();
+        bool fRet = pqueue->Wait(pfailed);
         fDone = true;
         return fRet;
     }
@@ -44,9 +44,20 @@
 #include <ifaddrs.h>
 #include <limits.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #endif
 
+// Wait for sockets with poll() rather than select(), which cannot handle
+// descriptors numbered FD_SETSIZE or higher. On Linux the socket handler
+// thread uses epoll, whose cost grows with the number of ready sockets only.
+#ifndef WIN32
+#define USE_POLL
+#endif
+#ifdef __linux__
+#define USE_EPOLL
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT        0
 #else
@@ -84,7 +95,7 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -56,6 +56,11 @@ public:
      */
     CDBBatch(const CDBWrapper &parent) : parent(parent) { };
 
+    void Clear()
+    {
+        batch.Clear();
+    }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -190,6 +190,12 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/**
+ * MurmurHash3 of the same data under nSeeds seeds at once: pHashes[j] is
+ * MurmurHash3(pSeeds[j], data). Much cheaper than hashing for each seed.
+ */
+void MurmurHash3Multi(const uint32_t* pSeeds, size_t nSeeds, const unsigned char* pData, size_t nSize, uint32_t* pHashes);
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
 /** SipHash-2-4 */
@@ -66,6 +66,35 @@ static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
 
+bool HTTPJSONWriter::WriteOut(const std::string& str, bool fLast)
+{
+    if (!fStarted && fLast) {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, str);
+        return true;
+    }
+    if (!fStarted) {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReplyStart(HTTP_OK);
+        fStarted = true;
+    }
+    if (!req->WriteReplyChunk(str.data(), str.size()))
+        return false;
+    if (fLast) {
+        req->WriteReplyEnd();
+        fEnded = true;
+    }
+    return true;
+}
+
+void HTTPJSONWriter::Abort()
+{
+    if (fStarted && !fEnded) {
+        req->WriteReplyAbort();
+        fEnded = true;
+    }
+}
+
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
     // Send error reply from json-rpc error object
@@ -184,6 +213,22 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // Commands with large results are written into the reply as they are produced
+            HTTPJSONWriter writer(req);
+            try {
+                if (tableRPC.executeStream(jreq.strMethod, jreq.params, jreq.id, writer)) {
+                    writer.Finish();
+                    return true;
+                }
+            } catch (...) {
+                if (!writer.IsStarted())
+                    throw;
+                // The status line is out; all we can do is break the reply off
+                LogPrintf("%s: error while streaming reply to %s, reply aborted\n", __func__, jreq.strMethod);
+                writer.Abort();
+                return false;
+            }
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -5,11 +5,43 @@
 #ifndef BITCOIN_HTTPRPC_H
 #define BITCOIN_HTTPRPC_H
 
+#include "rpc/jsonwriter.h"
+
 #include <string>
 #include <map>
 
 class HTTPRequest;
 
+/**
+ * JSON writer that sends the document as the reply to an HTTP request.
+ * A document that fits in one flush goes out as a normal reply; a larger
+ * one is streamed into the connection's output buffer as a chunked reply,
+ * which starts with the first flush.
+ */
+class HTTPJSONWriter : public CJSONWriter
+{
+private:
+    HTTPRequest* req;
+    bool fStarted;
+    bool fEnded;
+
+protected:
+    bool WriteOut(const std::string& str, bool fLast);
+
+public:
+    HTTPJSONWriter(HTTPRequest* reqIn) : req(reqIn), fStarted(false), fEnded(false) {}
+
+    /** Whether part of the reply was sent, so that an error can no longer be reported as a reply */
+    bool IsStarted() const { return fStarted; }
+
+    /**
+     * Give up on a started reply whose document cannot be completed. The
+     * connection is closed without ending the reply, so the client sees a
+     * broken transfer instead of a short document.
+     */
+    void Abort();
+};
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -24,6 +24,7 @@
 #include <event2/http.h>
 #include <event2/thread.h>
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
 
@@ -37,8 +38,16 @@
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/foreach.hpp>
 
+#include <atomic>
+#include <deque>
+
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
+/** Maximum number of bytes of a chunked reply waiting to be written to the client */
+static const size_t MAX_REPLY_STREAM_BUFFER = 4 * 1024 * 1024;
+
+/** Set when the server is shutting down, to stop workers streaming replies */
+static std::atomic<bool> fReplyStreamsInterrupted(false);
 
 /** HTTP request work item */
 class HTTPWorkItem : public HTTPClosure
@@ -464,6 +473,7 @@ void InterruptHTTPServer()
     }
     if (workQueue)
         workQueue->Interrupt();
+    fReplyStreamsInterrupted = true;
 }
 
 void StopHTTPServer()
@@ -534,12 +544,170 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/**
+ * Reply sent with chunked transfer encoding. Chunks are produced by a worker
+ * thread and handed to libevent by the http thread, which also owns this
+ * object: it is deleted there after the worker finished the reply, or once
+ * both the worker is done and the connection was closed.
+ *
+ * The worker is throttled on the number of bytes queued here or still in
+ * the connection's output buffer, so a slow client does not make us
+ * buffer the whole reply. libevent before 2.1.1 does not expose that
+ * buffer, and only the bytes queued here are counted.
+ */
+class HTTPReplyStream
+{
+public:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+
+    struct evhttp_request* req;
+    int nStatus;
+    std::deque<struct evbuffer*> queue;
+    size_t nQueued;         //!< Bytes in queue
+    size_t nOutput;         //!< Bytes in the connection's output buffer
+    int nPendingFlushes;    //!< Flush events triggered but not run yet
+    bool fStarted;          //!< Reply start sent
+    bool fEndSent;          //!< Reply end sent
+    bool fWorkerDone;       //!< No more chunks will be queued
+    bool fAbort;            //!< Close the connection instead of ending the reply
+    bool fClosed;           //!< Connection closed, remaining chunks are dropped
+
+    struct evhttp_connection* conn;
+    struct evbuffer* output;
+    struct evbuffer_cb_entry* outputCb;
+
+    HTTPReplyStream(struct evhttp_request* reqIn, int nStatusIn) :
+        req(reqIn), nStatus(nStatusIn), nQueued(0), nOutput(0), nPendingFlushes(0), fStarted(false),
+        fEndSent(false), fWorkerDone(false), fAbort(false), fClosed(false), conn(NULL), output(NULL), outputCb(NULL)
+    {
+    }
+
+    ~HTTPReplyStream()
+    {
+        BOOST_FOREACH(struct evbuffer* buf, queue)
+            evbuffer_free(buf);
+    }
+
+    /** Whether nothing refers to this object any more */
+    bool IsFinished() const { return fWorkerDone && nPendingFlushes == 0 && (fEndSent || fClosed); }
+
+    /** Have the http thread send what has been queued */
+    void TriggerFlush();
+
+    /** Send the queued chunks, and the end of the reply once the worker is done (http thread) */
+    void Flush();
+};
+
+static void http_reply_stream_closed(struct evhttp_connection* conn, void* arg)
+{
+    HTTPReplyStream* stream = (HTTPReplyStream*)arg;
+    bool fDelete;
+    {
+        boost::unique_lock<boost::mutex> lock(stream->cs);
+        // The request and the output buffer are gone with the connection
+        stream->fClosed = true;
+        stream->req = NULL;
+        stream->output = NULL;
+        fDelete = stream->IsFinished();
+    }
+    stream->cond.notify_all();
+    if (fDelete)
+        delete stream;
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+static void http_reply_stream_output(struct evbuffer* buf, const struct evbuffer_cb_info* info, void* arg)
+{
+    HTTPReplyStream* stream = (HTTPReplyStream*)arg;
+    if (info->n_deleted == 0)
+        return;
+    {
+        boost::unique_lock<boost::mutex> lock(stream->cs);
+        stream->nOutput = evbuffer_get_length(buf);
+    }
+    stream->cond.notify_all();
+}
+#endif
+
+void HTTPReplyStream::TriggerFlush()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nPendingFlushes++;
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(&HTTPReplyStream::Flush, this));
+    ev->trigger(0);
+}
+
+void HTTPReplyStream::Flush()
+{
+    std::deque<struct evbuffer*> chunks;
+    bool fEnd = false;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fClosed && !fEndSent) {
+            chunks.swap(queue);
+            nQueued = 0;
+            fEnd = fWorkerDone;
+        }
+    }
+
+    // libevent may call back into this object, so cs is not held below. The
+    // state used here is only modified by the http thread.
+    if (!fClosed && !fEndSent && !fStarted) {
+        evhttp_send_reply_start(req, nStatus, NULL);
+        conn = evhttp_request_get_connection(req);
+        evhttp_connection_set_closecb(conn, http_reply_stream_closed, this);
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        output = bufferevent_get_output(evhttp_connection_get_bufferevent(conn));
+        outputCb = evbuffer_add_cb(output, http_reply_stream_output, this);
+#endif
+        fStarted = true;
+    }
+    BOOST_FOREACH(struct evbuffer* buf, chunks) {
+        if (!fClosed)
+            evhttp_send_reply_chunk(req, buf);
+        evbuffer_free(buf);
+    }
+    if (fEnd && !fClosed) {
+        // Detach before ending the reply, which may close the connection right away
+        if (outputCb)
+            evbuffer_remove_cb_entry(output, outputCb);
+        evhttp_connection_set_closecb(conn, NULL, NULL);
+        if (fAbort) {
+            // Without the final empty chunk the client sees the reply as truncated
+            evhttp_connection_free(conn);
+        } else {
+            evhttp_send_reply_end(req);
+        }
+        req = NULL;
+        output = NULL;
+        fEndSent = true;
+    }
+
+    bool fDelete;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (output && !fClosed)
+            nOutput = evbuffer_get_length(output);
+        nPendingFlushes--;
+        fDelete = IsFinished();
+    }
+    cond.notify_all();
+    if (fDelete)
+        delete this;
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       stream(NULL)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
+    if (stream)
+        WriteReplyEnd();
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
@@ -605,6 +773,61 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req);
+    stream = new HTTPReplyStream(req, nStatus);
+    stream->TriggerFlush();
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+bool HTTPRequest::WriteReplyChunk(const char* data, size_t size)
+{
+    assert(stream);
+    {
+        boost::unique_lock<boost::mutex> lock(stream->cs);
+        while (!stream->fClosed && !fReplyStreamsInterrupted && stream->nQueued + stream->nOutput > MAX_REPLY_STREAM_BUFFER)
+            stream->cond.timed_wait(lock, boost::posix_time::milliseconds(100));
+        if (stream->fClosed || fReplyStreamsInterrupted)
+            return false;
+        struct evbuffer* buf = evbuffer_new();
+        evbuffer_add(buf, data, size);
+        stream->queue.push_back(buf);
+        stream->nQueued += size;
+    }
+    stream->TriggerFlush();
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    FinishReplyStream(false);
+}
+
+void HTTPRequest::WriteReplyAbort()
+{
+    FinishReplyStream(true);
+}
+
+void HTTPRequest::FinishReplyStream(bool fAbort)
+{
+    assert(stream);
+    // Count the last flush as pending before marking the worker done, so the
+    // stream cannot be deleted before it ran. It belongs to the http thread
+    // from here on.
+    HTTPReplyStream* streamDone = stream;
+    stream = NULL;
+    {
+        boost::unique_lock<boost::mutex> lock(streamDone->cs);
+        streamDone->fWorkerDone = true;
+        streamDone->fAbort = fAbort;
+        streamDone->nPendingFlushes++;
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(&HTTPReplyStream::Flush, streamDone));
+    ev->trigger(0);
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -19,6 +19,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+class HTTPReplyStream;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -57,6 +58,9 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    HTTPReplyStream* stream;
+
+    void FinishReplyStream(bool fAbort);
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -112,6 +116,34 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply whose body is sent in pieces with chunked transfer
+     * encoding, for bodies that are too large to build in memory.
+     * Follow with any number of WriteReplyChunk calls and one WriteReplyEnd.
+     *
+     * @note Call WriteHeader before this. Like WriteReply, it can be called
+     * only once and instead of WriteReply.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Queue a piece of the body started by WriteReplyStart. Blocks while too
+     * much of the reply is still waiting to be written to the client.
+     * Returns false if the client went away; the caller should stop producing
+     * the body and call WriteReplyEnd.
+     */
+    bool WriteReplyChunk(const char* data, size_t size);
+
+    /** Finish a reply started by WriteReplyStart */
+    void WriteReplyEnd();
+
+    /**
+     * Give up on a reply started by WriteReplyStart when the rest of the body
+     * cannot be produced. The connection is closed without ending the chunked
+     * body, so the client can tell that the reply is incomplete.
+     */
+    void WriteReplyAbort();
 };
 
 /** Event handler closure.
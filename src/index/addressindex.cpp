@@ -0,0 +1,121 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindex.h"
+
+#include "chain.h"
+#include "crypto/sha256.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "undo.h"
+
+#include <boost/scoped_ptr.hpp>
+
+static const char DB_ADDRESSINDEX = 'a';
+
+CAddressIndex *paddressindex = NULL;
+
+uint256 GetScriptHash(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(begin_ptr(script), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+CAddressIndex::CAddressIndex(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CBaseIndex("addressindex"), db("address", nCacheSize, fMemory, fWipe), batch(db)
+{
+}
+
+bool CAddressIndex::ReadBestBlock(CBlockLocator& locator)
+{
+    return db.ReadBestBlock(locator);
+}
+
+bool CAddressIndex::AppendBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (!ReadBlockUndo(blockundo, pindex))
+        return false;
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxOut& prevout = txundo.vprevout[j].txout;
+                if (prevout.scriptPubKey.IsUnspendable())
+                    continue;
+                CAddressIndexKey key(GetScriptHash(prevout.scriptPubKey), pindex->nHeight, txid, j, true);
+                batch.Write(std::make_pair(DB_ADDRESSINDEX, key), -prevout.nValue);
+            }
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            CAddressIndexKey key(GetScriptHash(out.scriptPubKey), pindex->nHeight, txid, j, false);
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, key), out.nValue);
+        }
+    }
+    return true;
+}
+
+bool CAddressIndex::RewindBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (!ReadBlockUndo(blockundo, pindex))
+        return false;
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxOut& prevout = txundo.vprevout[j].txout;
+                batch.Erase(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(GetScriptHash(prevout.scriptPubKey), pindex->nHeight, txid, j, true)));
+            }
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(GetScriptHash(out.scriptPubKey), pindex->nHeight, txid, j, false)));
+        }
+    }
+    return true;
+}
+
+bool CAddressIndex::Commit(const CBlockLocator& locator)
+{
+    if (!db.WriteBatchWithBestBlock(batch, locator))
+        return false;
+    batch.Clear();
+    return true;
+}
+
+bool CAddressIndex::FindEntries(const CAddressIndexKey& keyStart, unsigned int nLimit,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> >& vEntries,
+                                bool& fMore, CAddressIndexKey& keyNext)
+{
+    fMore = false;
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, keyStart));
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.hashScript != keyStart.hashScript)
+            break;
+        if (vEntries.size() >= nLimit) {
+            fMore = true;
+            keyNext = key.second;
+            break;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read entry", __func__);
+        vEntries.push_back(std::make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
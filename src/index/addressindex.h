@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "index/base.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CScript;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Maximum number of entries returned by one address index lookup */
+static const unsigned int MAX_ADDRESSINDEX_RESULTS = 10000;
+
+/** Hash identifying a scriptPubKey in the address index (single SHA256 of the script) */
+uint256 GetScriptHash(const CScript& script);
+
+/**
+ * Key of an address index entry. Height and position are serialized
+ * big-endian so that the entries of a script sort by height, then txid
+ * (not by position within the block).
+ */
+struct CAddressIndexKey
+{
+    uint256 hashScript;
+    unsigned int nHeight;
+    uint256 txid;
+    //! Output index for funding entries, input index for spending entries
+    unsigned int n;
+    bool fSpending;
+
+    CAddressIndexKey() : nHeight(0), n(0), fSpending(false) {}
+    CAddressIndexKey(const uint256& hashScriptIn, unsigned int nHeightIn, const uint256& txidIn, unsigned int nIn, bool fSpendingIn) :
+        hashScript(hashScriptIn), nHeight(nHeightIn), txid(txidIn), n(nIn), fSpending(fSpendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 32 + 4 + 32 + 4 + 1;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        hashScript.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, nHeight);
+        txid.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, n);
+        ser_writedata8(s, fSpending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        hashScript.Unserialize(s, nType, nVersion);
+        nHeight = ser_readdata32be(s);
+        txid.Unserialize(s, nType, nVersion);
+        n = ser_readdata32be(s);
+        fSpending = ser_readdata8(s);
+    }
+};
+
+/**
+ * Address index (-addressindex): every output created and spent in the
+ * active chain, keyed by the script it pays to. The value is the amount,
+ * negative for spends.
+ */
+class CAddressIndex : public CBaseIndex
+{
+private:
+    CIndexDB db;
+    CDBBatch batch;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator);
+    bool AppendBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool RewindBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool Commit(const CBlockLocator& locator);
+
+public:
+    CAddressIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /**
+     * Look up the entries of a script by height, then txid, starting at keyStart
+     * (whose hashScript selects the script). At most nLimit entries are
+     * returned; if more exist, fMore is set and keyNext is where the next
+     * page starts.
+     */
+    bool FindEntries(const CAddressIndexKey& keyStart, unsigned int nLimit,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> >& vEntries,
+                     bool& fMore, CAddressIndexKey& keyNext);
+};
+
+/** The global address index, NULL unless -addressindex is set */
+extern CAddressIndex *paddressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
@@ -0,0 +1,190 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/base.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+/** Maximum number of blocks queued before their entries are committed */
+static const int INDEX_COMMIT_BLOCKS = 2000;
+/** Maximum time between commits while catching up (milliseconds) */
+static const int64_t INDEX_COMMIT_INTERVAL = 10 * 1000;
+
+static const char DB_BEST_BLOCK = 'B';
+
+static boost::filesystem::path GetIndexDir(const std::string& strName)
+{
+    boost::filesystem::path path = GetDataDir() / "indexes";
+    TryCreateDirectory(path);
+    return path / strName;
+}
+
+CIndexDB::CIndexDB(const std::string& strName, size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(GetIndexDir(strName), nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CIndexDB::ReadBestBlock(CBlockLocator& locator)
+{
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+bool CIndexDB::WriteBatchWithBestBlock(CDBBatch& batch, const CBlockLocator& locator)
+{
+    batch.Write(DB_BEST_BLOCK, locator);
+    return WriteBatch(batch);
+}
+
+CBaseIndex::CBaseIndex(const std::string& strNameIn) :
+    strName(strNameIn), pindexBest(NULL), fSynced(false), fTipChanged(false), nQueued(0), nLastCommit(0)
+{
+}
+
+CBaseIndex::~CBaseIndex()
+{
+}
+
+bool CBaseIndex::Start()
+{
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        if (!ReadBestBlock(locator))
+            locator.SetNull();
+
+        // Resume from the most recent committed block we still know about. If it
+        // is no longer in the active chain, the sync thread rewinds from there.
+        pindexBest = NULL;
+        BOOST_FOREACH(const uint256& hash, locator.vHave) {
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end()) {
+                pindexBest = mi->second;
+                break;
+            }
+        }
+        LogPrintf("%s: %s starting at height %d (chain height %d)\n", __func__, strName,
+            pindexBest ? pindexBest->nHeight : -1, chainActive.Height());
+    }
+
+    nLastCommit = GetTimeMillis();
+    RegisterValidationInterface(this);
+    threadSync = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, strName.c_str(),
+        boost::function<void()>(boost::bind(&CBaseIndex::ThreadSync, this))));
+    return true;
+}
+
+void CBaseIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+    threadSync.interrupt();
+    if (threadSync.joinable())
+        threadSync.join();
+}
+
+void CBaseIndex::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csTip);
+        fTipChanged = true;
+    }
+    condTip.notify_one();
+}
+
+bool CBaseIndex::ReadBlockUndo(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("%s: no undo data available for block %s", __func__, pindex->GetBlockHash().ToString());
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
+bool CBaseIndex::CommitBest()
+{
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindexBest);
+    }
+    if (!Commit(locator))
+        return error("%s: failed to commit %s at height %d", __func__, strName, pindexBest->nHeight);
+    LogPrint("index", "%s: committed %d blocks, best height %d\n", strName, nQueued, pindexBest->nHeight);
+    nQueued = 0;
+    nLastCommit = GetTimeMillis();
+    return true;
+}
+
+void CBaseIndex::ThreadSync()
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            const CBlockIndex* pindex = NULL;
+            bool fRewind = false;
+            {
+                LOCK(cs_main);
+                // ConnectBlock never processes the genesis block, so no index does either.
+                if (pindexBest == NULL)
+                    pindexBest = chainActive.Genesis();
+                if (pindexBest != NULL) {
+                    fRewind = !chainActive.Contains(pindexBest);
+                    pindex = fRewind ? pindexBest : chainActive.Next(pindexBest);
+                }
+            }
+
+            if (pindex == NULL) {
+                // Caught up with the tip: flush and wait until it moves again
+                if (nQueued > 0 && !CommitBest())
+                    return;
+                if (!fSynced && pindexBest != NULL) {
+                    LogPrintf("%s is enabled at height %d\n", strName, pindexBest->nHeight);
+                    fSynced = true;
+                }
+                boost::unique_lock<boost::mutex> lock(csTip);
+                while (!fTipChanged)
+                    condTip.wait(lock);
+                fTipChanged = false;
+                continue;
+            }
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, consensusParams)) {
+                error("%s: failed to read block %s from disk, %s stopped", __func__, pindex->GetBlockHash().ToString(), strName);
+                return;
+            }
+            if (fRewind) {
+                if (!RewindBlock(block, pindex)) {
+                    error("%s: failed to rewind block %s, %s stopped", __func__, pindex->GetBlockHash().ToString(), strName);
+                    return;
+                }
+                pindexBest = pindex->pprev;
+            } else {
+                if (!AppendBlock(block, pindex)) {
+                    error("%s: failed to index block %s, %s stopped", __func__, pindex->GetBlockHash().ToString(), strName);
+                    return;
+                }
+                pindexBest = pindex;
+            }
+
+            if (++nQueued >= INDEX_COMMIT_BLOCKS || GetTimeMillis() - nLastCommit > INDEX_COMMIT_INTERVAL) {
+                if (!CommitBest())
+                    return;
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Keep the work done so far
+        if (nQueued > 0)
+            CommitBest();
+        throw;
+    }
+}
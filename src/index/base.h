@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BASE_H
+#define BITCOIN_INDEX_BASE_H
+
+#include "dbwrapper.h"
+#include "sync.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <string>
+
+#include <boost/thread.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+struct CBlockLocator;
+
+//! Max memory allocated to the database of each optional index (MiB)
+static const int64_t nMaxIndexDBCache = 64;
+
+/** Database of an index that is kept in its own directory under indexes/ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(const std::string& strName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool ReadBestBlock(CBlockLocator& locator);
+    /** Write a batch of entries together with the locator of the block they were indexed up to */
+    bool WriteBatchWithBestBlock(CDBBatch& batch, const CBlockLocator& locator);
+};
+
+/**
+ * Base class for optional indexes that are built from the block files by a
+ * background thread, independent of block validation.
+ *
+ * On start the thread catches up from the last block recorded by the index
+ * to the current chain tip, queueing entries per block and committing them
+ * in batches. Once synced it follows the tip: UpdatedBlockTip notifications
+ * wake the thread, which rewinds blocks that left the active chain and
+ * appends the new ones.
+ */
+class CBaseIndex : public CValidationInterface
+{
+private:
+    const std::string strName;
+
+    /** Last block whose entries have been queued (or committed) */
+    const CBlockIndex* pindexBest;
+    std::atomic<bool> fSynced;
+
+    CWaitableCriticalSection csTip;
+    CConditionVariable condTip;
+    bool fTipChanged;
+
+    boost::thread threadSync;
+
+    /** Number of blocks queued since the last commit */
+    int nQueued;
+    int64_t nLastCommit;
+
+    void ThreadSync();
+    bool CommitBest();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+
+    /** Read the undo data of a block, for indexes that need the outputs its inputs spent */
+    static bool ReadBlockUndo(CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+    /** Read the locator of the last block committed to the index. Returns false if there is none. */
+    virtual bool ReadBestBlock(CBlockLocator& locator) = 0;
+
+    /** Queue the entries for a block that was connected to the active chain */
+    virtual bool AppendBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+
+    /** Queue the removal of entries for a block that left the active chain.
+     *  Indexes that tolerate stale entries need not override this. */
+    virtual bool RewindBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
+
+    /** Write all queued entries together with the new best block locator in one batch */
+    virtual bool Commit(const CBlockLocator& locator) = 0;
+
+public:
+    CBaseIndex(const std::string& strNameIn);
+    virtual ~CBaseIndex();
+
+    /** Locate the starting point, register for notifications and start the sync thread */
+    bool Start();
+    /** Stop the sync thread (committing any queued entries) and unregister. Must be called before destruction. */
+    void Stop();
+
+    /** Whether the index has caught up with the active chain at least once */
+    bool IsSynced() const { return fSynced; }
+};
+
+#endif // BITCOIN_INDEX_BASE_H
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockfilterindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util.h"
+
+static const char DB_BLOCKFILTER = 'f';
+
+CBlockFilterIndex *pblockfilterindex = NULL;
+
+CBlockFilterIndex::CBlockFilterIndex(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CBaseIndex("blockfilterindex"), db("blockfilter", nCacheSize, fMemory, fWipe), batch(db)
+{
+}
+
+bool CBlockFilterIndex::ReadBestBlock(CBlockLocator& locator)
+{
+    return db.ReadBestBlock(locator);
+}
+
+bool CBlockFilterIndex::ReadFilterHeader(const uint256& hashBlock, uint256& hashHeader)
+{
+    std::map<uint256, uint256>::const_iterator it = mapPendingHeaders.find(hashBlock);
+    if (it != mapPendingHeaders.end()) {
+        hashHeader = it->second;
+        return true;
+    }
+    CBlockFilterEntry entry;
+    if (!db.Read(std::make_pair(DB_BLOCKFILTER, hashBlock), entry))
+        return false;
+    hashHeader = entry.hashHeader;
+    return true;
+}
+
+void CBlockFilterIndex::WriteFilter(const CBlockFilter& filter, const uint256& hashPrevHeader)
+{
+    CBlockFilterEntry entry;
+    entry.vchFilter = filter.GetEncodedFilter();
+    entry.hashFilter = filter.GetHash();
+    entry.hashHeader = filter.ComputeHeader(hashPrevHeader);
+    batch.Write(std::make_pair(DB_BLOCKFILTER, filter.GetBlockHash()), entry);
+    mapPendingHeaders[filter.GetBlockHash()] = entry.hashHeader;
+}
+
+bool CBlockFilterIndex::AppendBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    uint256 hashPrevHeader;
+    if (!ReadFilterHeader(pindex->pprev->GetBlockHash(), hashPrevHeader)) {
+        if (pindex->pprev->pprev != NULL)
+            return error("%s: missing filter header of block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+        // Blocks are only indexed from height 1, so add the genesis filter along with the first one
+        WriteFilter(CBlockFilter(Params().GenesisBlock(), CBlockUndo()), uint256());
+        hashPrevHeader = mapPendingHeaders[pindex->pprev->GetBlockHash()];
+    }
+
+    CBlockUndo blockundo;
+    if (!ReadBlockUndo(blockundo, pindex))
+        return false;
+    WriteFilter(CBlockFilter(block, blockundo), hashPrevHeader);
+    return true;
+}
+
+bool CBlockFilterIndex::Commit(const CBlockLocator& locator)
+{
+    if (!db.WriteBatchWithBestBlock(batch, locator))
+        return false;
+    batch.Clear();
+    mapPendingHeaders.clear();
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter)
+{
+    CBlockFilterEntry entry;
+    if (!db.Read(std::make_pair(DB_BLOCKFILTER, pindex->GetBlockHash()), entry))
+        return false;
+    try {
+        filter = CBlockFilter(BLOCK_FILTER_BASIC, pindex->GetBlockHash(), entry.vchFilter);
+    } catch (const std::exception& e) {
+        return error("%s: corrupt filter of block %s: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& hashHeader)
+{
+    CBlockFilterEntry entry;
+    if (!db.Read(std::make_pair(DB_BLOCKFILTER, pindex->GetBlockHash()), entry))
+        return false;
+    hashHeader = entry.hashHeader;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<CBlockFilter>& vFilters)
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+    vFilters.resize(pindexStop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex* pindex = pindexStop; pindex && pindex->nHeight >= nStartHeight; pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, vFilters[pindex->nHeight - nStartHeight]))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes)
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+    vHashes.resize(pindexStop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex* pindex = pindexStop; pindex && pindex->nHeight >= nStartHeight; pindex = pindex->pprev) {
+        CBlockFilterEntry entry;
+        if (!db.Read(std::make_pair(DB_BLOCKFILTER, pindex->GetBlockHash()), entry))
+            return false;
+        vHashes[pindex->nHeight - nStartHeight] = entry.hashFilter;
+    }
+    return true;
+}
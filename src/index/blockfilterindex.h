@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "index/base.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+
+/** Stored filter of a block, along with its hash and filter header */
+struct CBlockFilterEntry
+{
+    std::vector<unsigned char> vchFilter;
+    uint256 hashFilter;
+    uint256 hashHeader;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vchFilter);
+        READWRITE(hashFilter);
+        READWRITE(hashHeader);
+    }
+};
+
+/**
+ * Block filter index (-blockfilterindex): the basic compact filter and
+ * filter header of every block in the active chain, so they can be served
+ * to light clients with a single read.
+ *
+ * Entries are keyed by block hash; entries of blocks that left the active
+ * chain stay valid for those blocks and are not removed.
+ */
+class CBlockFilterIndex : public CBaseIndex
+{
+private:
+    CIndexDB db;
+    CDBBatch batch;
+
+    /** Filter headers of the blocks queued since the last commit */
+    std::map<uint256, uint256> mapPendingHeaders;
+
+    bool ReadFilterHeader(const uint256& hashBlock, uint256& hashHeader);
+    void WriteFilter(const CBlockFilter& filter, const uint256& hashPrevHeader);
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator);
+    bool AppendBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool Commit(const CBlockLocator& locator);
+
+public:
+    CBlockFilterIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Get the filter of a block. Returns false if it has not been indexed (yet). */
+    bool LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter);
+
+    /** Get the filter header of a block */
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& hashHeader);
+
+    /** Get the filters of the blocks from nStartHeight up to and including pindexStop */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<CBlockFilter>& vFilters);
+
+    /** Get the filter hashes of the blocks from nStartHeight up to and including pindexStop */
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes);
+};
+
+/** The global block filter index, NULL unless -blockfilterindex is set */
+extern CBlockFilterIndex *pblockfilterindex;
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
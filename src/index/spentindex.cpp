@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/spentindex.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+
+static const char DB_SPENTINDEX = 's';
+
+CSpentIndex *pspentindex = NULL;
+
+CSpentIndex::CSpentIndex(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CBaseIndex("spentindex"), db("spent", nCacheSize, fMemory, fWipe), batch(db)
+{
+}
+
+bool CSpentIndex::ReadBestBlock(CBlockLocator& locator)
+{
+    return db.ReadBestBlock(locator);
+}
+
+bool CSpentIndex::AppendBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        for (unsigned int j = 0; j < tx.vin.size(); j++)
+            batch.Write(std::make_pair(DB_SPENTINDEX, tx.vin[j].prevout), CSpentIndexValue(tx.GetHash(), j, pindex->nHeight));
+    }
+    return true;
+}
+
+bool CSpentIndex::RewindBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        for (unsigned int j = 0; j < tx.vin.size(); j++)
+            batch.Erase(std::make_pair(DB_SPENTINDEX, tx.vin[j].prevout));
+    }
+    return true;
+}
+
+bool CSpentIndex::Commit(const CBlockLocator& locator)
+{
+    if (!db.WriteBatchWithBestBlock(batch, locator))
+        return false;
+    batch.Clear();
+    return true;
+}
+
+bool CSpentIndex::FindSpender(const COutPoint& outpoint, CSpentIndexValue& value)
+{
+    return db.Read(std::make_pair(DB_SPENTINDEX, outpoint), value);
+}
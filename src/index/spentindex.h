@@ -0,0 +1,62 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEX_H
+#define BITCOIN_INDEX_SPENTINDEX_H
+
+#include "index/base.h"
+#include "serialize.h"
+#include "uint256.h"
+
+class COutPoint;
+
+static const bool DEFAULT_SPENTINDEX = false;
+
+/** The input that spends an outpoint in the active chain */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    unsigned int nIn;
+    int nHeight;
+
+    CSpentIndexValue() : nIn(0), nHeight(0) {}
+    CSpentIndexValue(const uint256& txidIn, unsigned int nInIn, int nHeightIn) :
+        txid(txidIn), nIn(nInIn), nHeight(nHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(VARINT(nIn));
+        READWRITE(VARINT(nHeight));
+    }
+};
+
+/**
+ * Spent index (-spentindex): maps every outpoint spent in the active chain
+ * to the transaction input spending it.
+ */
+class CSpentIndex : public CBaseIndex
+{
+private:
+    CIndexDB db;
+    CDBBatch batch;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator);
+    bool AppendBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool RewindBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool Commit(const CBlockLocator& locator);
+
+public:
+    CSpentIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool FindSpender(const COutPoint& outpoint, CSpentIndexValue& value);
+};
+
+/** The global spent index, NULL unless -spentindex is set */
+extern CSpentIndex *pspentindex;
+
+#endif // BITCOIN_INDEX_SPENTINDEX_H
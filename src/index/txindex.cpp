@@ -0,0 +1,40 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txindex.h"
+
+#include "chain.h"
+#include "main.h"
+#include "primitives/block.h"
+
+CTxIndex *ptxindex = NULL;
+
+CTxIndex::CTxIndex() : CBaseIndex("txindex")
+{
+}
+
+bool CTxIndex::ReadBestBlock(CBlockLocator& locator)
+{
+    return pblocktree->ReadTxIndexBestBlock(locator);
+}
+
+bool CTxIndex::AppendBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    vPos.reserve(vPos.size() + block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        vPos.push_back(std::make_pair(tx.GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+    return true;
+}
+
+bool CTxIndex::Commit(const CBlockLocator& locator)
+{
+    if (!pblocktree->WriteTxIndex(vPos, locator))
+        return false;
+    vPos.clear();
+    return true;
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TXINDEX_H
+#define BITCOIN_INDEX_TXINDEX_H
+
+#include "index/base.h"
+#include "txdb.h"
+
+#include <utility>
+#include <vector>
+
+/**
+ * Transaction index (-txindex): maps txids to their position in the block
+ * files. Entries live in the block tree database, next to the block index.
+ *
+ * Entries of blocks that leave the active chain are not erased; they are
+ * overwritten if the transaction is confirmed again, just like the index
+ * ConnectBlock used to maintain.
+ */
+class CTxIndex : public CBaseIndex
+{
+private:
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator);
+    bool AppendBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool Commit(const CBlockLocator& locator);
+
+public:
+    CTxIndex();
+};
+
+/** The global transaction index, NULL unless -txindex is set */
+extern CTxIndex *ptxindex;
+
+#endif // BITCOIN_INDEX_TXINDEX_H
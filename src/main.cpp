@@ -15,6 +15,7 @@
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "index/blockfilterindex.h"
 #include "init.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -30,6 +31,9 @@
 #include "tinyformat.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txmempooltrace.h"
+#include "txorphanage.h"
+#include "txrequest.h"
 #include "ui_interface.h"
 #include "undo.h"
 #include "util.h"
@@ -43,6 +47,7 @@
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/math/distributions/poisson.hpp>
@@ -80,6 +85,7 @@ size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
+bool fFastBlockRelay = DEFAULT_FAST_BLOCK_RELAY;
 
 
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
@@ -88,22 +94,7 @@ CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 CTxMemPool mempool(::minRelayTxFee);
 FeeFilterRounder filterRounder(::minRelayTxFee);
 
-struct IteratorComparator
-{
-    template<typename I>
-    bool operator()(const I& a, const I& b)
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct COrphanTx {
-    CTransaction tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-map<COutPoint, set<map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
+CTxOrphanage orphanage GUARDED_BY(cs_main);
 void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
@@ -213,6 +204,7 @@ namespace {
         uint256 hash;
         CBlockIndex* pindex;                                     //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
@@ -237,8 +229,56 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /**
+     * Bloom filter elements of announced transactions, by position in
+     * txAnnounceQueue. Built when the first peer with a filter reaches the
+     * announcement, for the other filtering peers to reuse, and dropped once
+     * no filtering peer's cursor is behind it. Protected by cs_main.
+     */
+    std::map<uint64_t, std::shared_ptr<const CBloomTxElements> > mapBloomElements;
+
+    /**
+     * Serialized block and cmpctblock messages of the blocks most recently
+     * requested or announced. A fresh block is sent to many peers at once;
+     * they all share one buffer instead of each reading and serializing the
+     * block again.
+     */
+    struct CachedBlockMessage {
+        uint256 hash;
+        std::string strCommand;
+        bool fWitness;
+        CSerializeDataRef msg;
+    };
+    CCriticalSection cs_vBlockMessageCache;
+    std::deque<CachedBlockMessage> vBlockMessageCache;
+    static const size_t BLOCK_MESSAGE_CACHE_SIZE = 8;
+
+    /** Which peers to request announced transactions from, and when. Protected by cs_main. */
+    CTxRequestTracker txRequestTracker;
+
+    /**
+     * Transactions we saw but do not have in the mempool (evicted, replaced,
+     * orphaned or rejected), in <witness hash, transaction> form, so that
+     * compact blocks including them can still be reconstructed. A ring
+     * buffer of -blockreconstructionextratxn entries, protected by cs_main.
+     */
+    std::vector<std::pair<uint256, std::shared_ptr<const CTransaction> > > vExtraTxnForCompact;
+    size_t vExtraTxnForCompactIt = 0;
 } // anon namespace
 
+// Requires cs_main.
+static void AddToCompactExtraTransactions(const std::shared_ptr<const CTransaction>& tx)
+{
+    size_t nMaxExtraTxn = GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
+    if (nMaxExtraTxn == 0)
+        return;
+    if (vExtraTxnForCompact.empty())
+        vExtraTxnForCompact.resize(nMaxExtraTxn);
+    vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
+    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % vExtraTxnForCompact.size();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Registration of network node signals.
@@ -288,6 +328,12 @@ struct CNodeState {
     list<QueuedBlock> vBlocksInFlight;
     //! When the first entry in vBlocksInFlight started downloading. Don't care when vBlocksInFlight is empty.
     int64_t nDownloadingSince;
+    //! When we last received a block we requested from this peer (in microseconds), or 0.
+    int64_t nLastBlockReceived;
+    //! Moving average of the time this peer takes to send one requested block (in microseconds), or 0 if not measured yet.
+    int64_t nAvgBlockInterval;
+    //! Moving average of the time between requesting a block from this peer and receiving it (in microseconds), or 0.
+    int64_t nAvgBlockResponse;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
@@ -324,6 +370,9 @@ struct CNodeState {
         fSyncStarted = false;
         nStallingSince = 0;
         nDownloadingSince = 0;
+        nLastBlockReceived = 0;
+        nAvgBlockInterval = 0;
+        nAvgBlockResponse = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
@@ -385,6 +434,7 @@ void FinalizeNode(NodeId nodeid) {
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    txRequestTracker.DisconnectedPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -396,16 +446,29 @@ void FinalizeNode(NodeId nodeid) {
         assert(mapBlocksInFlight.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
+        assert(txRequestTracker.Size() == 0);
     }
 }
 
 // Requires cs_main.
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-bool MarkBlockAsReceived(const uint256& hash) {
+// If it was received from the peer it was requested from (nodeFrom), that peer's download speed is measured.
+bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
+        if (itInFlight->second.first == nodeFrom) {
+            // The time the block took once the peer was done with the previous
+            // one tells its throughput; the time since the request its latency.
+            int64_t nNow = GetTimeMicros();
+            int64_t nTimeRequested = itInFlight->second.second->nTimeRequested;
+            int64_t nInterval = std::max<int64_t>(nNow - std::max(nTimeRequested, state->nLastBlockReceived), 1);
+            int64_t nResponse = std::max<int64_t>(nNow - nTimeRequested, 1);
+            state->nAvgBlockInterval = state->nAvgBlockInterval ? (state->nAvgBlockInterval * 7 + nInterval) / 8 : nInterval;
+            state->nAvgBlockResponse = state->nAvgBlockResponse ? (state->nAvgBlockResponse * 7 + nResponse) / 8 : nResponse;
+            state->nLastBlockReceived = nNow;
+        }
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         if (state->nBlocksInFlightValidHeaders == 0 && itInFlight->second.second->fValidatedHeaders) {
             // Last validated block on the queue was received.
@@ -442,7 +505,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     MarkBlockAsReceived(hash);
 
     list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)});
+            {hash, pindex, pindex != NULL, GetTimeMicros(), std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -556,8 +619,24 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
     return pa;
 }
 
+/**
+ * Whether a block in flight from another peer, which holds back the download
+ * window, should be requested from nodeid instead: it has been in flight for
+ * well over the time its peer usually takes, and nodeid is faster.
+ */
+bool IsStragglingBlock(NodeId nodeid, const uint256& hash) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::const_iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first == nodeid)
+        return false;
+    const CNodeState* state = State(nodeid);
+    const CNodeState* stateHolder = State(itInFlight->second.first);
+    int64_t nInFlight = GetTimeMicros() - itInFlight->second.second->nTimeRequested;
+    return ::IsStragglingBlock(nInFlight, stateHolder->nAvgBlockResponse, stateHolder->nAvgBlockInterval, state->nAvgBlockInterval);
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
+ *  at most count entries. If nothing else can be fetched because a block in flight from a slower
+ *  peer holds back the download window, that block is added to be requested again. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
@@ -594,6 +673,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -629,6 +709,11 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        if (pindexWaitingFor && IsStragglingBlock(nodeid, pindexWaitingFor->GetBlockHash())) {
+                            LogPrint("net", "Requesting straggling block %s (%d) from peer=%d instead of peer=%d\n",
+                                pindexWaitingFor->GetBlockHash().ToString(), pindexWaitingFor->nHeight, nodeid, waitingfor);
+                            vBlocks.push_back(pindexWaitingFor);
+                        }
                     }
                     return;
                 }
@@ -639,6 +724,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -646,6 +732,21 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
 
 } // anon namespace
 
+int GetBlocksInTransitPerPeer(int64_t nAvgBlockInterval) {
+    if (nAvgBlockInterval == 0)
+        return DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nBlocks = BLOCK_DOWNLOAD_TARGET_TIME * 1000000 / nAvgBlockInterval;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, nBlocks));
+}
+
+bool IsStragglingBlock(int64_t nInFlight, int64_t nHolderAvgBlockResponse, int64_t nHolderAvgBlockInterval, int64_t nAvgBlockInterval) {
+    if (nAvgBlockInterval == 0)
+        return false;
+    if (nInFlight < std::max(BLOCK_STRAGGLER_MIN_TIME, 2 * nHolderAvgBlockResponse))
+        return false;
+    return nHolderAvgBlockInterval == 0 || nAvgBlockInterval < nHolderAvgBlockInterval;
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
@@ -702,13 +803,13 @@ CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// orphanage
 //
 
 bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     uint256 hash = tx.GetHash();
-    if (mapOrphanTransactions.count(hash))
+    if (orphanage.HaveTx(hash))
         return false;
 
     // Ignore big transactions, to avoid a
@@ -725,85 +826,25 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
-    assert(ret.second);
-    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
+    orphanage.AddTx(tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME);
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u, peer=%d holds %u)\n", hash.ToString(),
+             orphanage.Size(), peer, orphanage.Count(peer));
     return true;
 }
 
-int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return 0;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
-    {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(it);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-    return 1;
-}
-
 void EraseOrphansFor(NodeId peer)
 {
-    int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseOrphanTx(maybeErase->second.tx.GetHash());
-        }
-    }
+    int nErased = orphanage.EraseForPeer(peer);
     if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
 }
 
 
 unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end())
-        {
-            map<uint256, COrphanTx>::iterator maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx.GetHash());
-            } else {
-                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx due to expiration\n", nErased);
-    }
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
+    int nErased = orphanage.EraseExpired(GetTime());
+    if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx due to expiration\n", nErased);
+    return orphanage.LimitOrphans(nMaxOrphans);
 }
 
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
@@ -1129,9 +1170,12 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
     std::vector<uint256> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    std::vector<std::shared_ptr<const CTransaction> > vEvicted;
+    pool.TrimToSize(limit, &vNoSpendsRemaining, &vEvicted);
     BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
+    BOOST_FOREACH(const std::shared_ptr<const CTransaction>& tx, vEvicted)
+        AddToCompactExtraTransactions(tx);
 }
 
 /** Convert CValidationState to a human-readable message for logging */
@@ -1143,8 +1187,61 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+/** Fill in state for the failed script check of input nIn of tx, and return false */
+static bool ScriptCheckFailed(const CScriptCheck& check, const CCoins& coins, const CTransaction& tx, unsigned int nIn, CValidationState& state, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata)
+{
+    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+        // Check whether the failure was caused by a
+        // non-mandatory script verification check, such as
+        // non-standard DER encodings or non-null dummy
+        // arguments; if so, don't trigger DoS protection to
+        // avoid splitting the network between upgraded and
+        // non-upgraded nodes.
+        CScriptCheck check2(coins, tx, nIn,
+                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
+        if (check2())
+            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+    }
+    // Failures of other flags indicate a transaction that is
+    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+    // such nodes as they are not following the protocol. That
+    // said during an upgrade careful thought should be taken
+    // as to the correct behavior - we may want to continue
+    // peering with non-upgraded nodes even after soft-fork
+    // super-majority signaling has occurred.
+    return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+}
+
+/**
+ * CheckInputs for mempool acceptance. The scripts of transactions with many
+ * inputs are checked on the script-checking threads, which are idle between
+ * blocks; both users of the queue hold cs_main. If checks fail, state reports
+ * one of the failing inputs, not necessarily the first one.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads && tx.vin.size() >= MIN_PARALLEL_SCRIPT_CHECK_INPUTS) {
+        std::vector<CScriptCheck> vChecks;
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        if (!CheckInputs(tx, state, view, true, flags, true, txdata, &vChecks))
+            return false;
+        control.Add(vChecks);
+        CScriptCheck checkFailed;
+        if (control.Wait(&checkFailed))
+            return true;
+        unsigned int nIn = checkFailed.GetInputIndex();
+        const CCoins* coins = view.AccessCoins(tx.vin[nIn].prevout.hash);
+        assert(coins);
+        return ScriptCheckFailed(checkFailed, *coins, tx, nIn, state, flags, true, txdata);
+    }
+    return CheckInputs(tx, state, view, true, flags, true, txdata);
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
                               std::vector<uint256>& vHashTxnToUncache)
 {
     const uint256 hash = tx.GetHash();
@@ -1317,7 +1414,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1372,8 +1469,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
         size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
         std::string errString;
-        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
-            return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+        {
+            LOCK(pool.cs);
+            if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+                return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+            }
         }
 
         // A transaction that spends outputs that would be replaced by it is invalid. Now
@@ -1527,7 +1627,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -1548,7 +1648,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        if (!CheckInputsForMempool(tx, state, view, MANDATORY_SCRIPT_VERIFY_FLAGS, txdata))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
@@ -1562,11 +1662,14 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
                     hash.ToString(),
                     FormatMoney(nModifiedFees - nConflictingFees),
                     (int)nSize - (int)nConflictingSize);
+            AddToCompactExtraTransactions(it->GetSharedTx());
         }
         pool.RemoveStaged(allConflicting, false);
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
+        if (pmempoolRecorder && &pool == &mempool)
+            pmempoolRecorder->RecordTransaction(entry);
 
         // trim mempool and check if tx was trimmed
         if (!fOverrideMempoolLimit) {
@@ -1581,11 +1684,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
     std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
     if (!res) {
         BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
             pcoinsTip->Uncache(hashTx);
@@ -1593,6 +1696,155 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, nAbsurdFee);
+}
+
+/** Decode a serialized transaction, accepting both the witness and the non-witness serialization */
+static bool DecodeRawTransaction(const std::vector<unsigned char>& vRawTx, CTransaction& tx)
+{
+    try {
+        CDataStream ssData(vRawTx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        ssData >> tx;
+        if (ssData.eof())
+            return true;
+    } catch (const std::exception&) {
+        // Fall through.
+    }
+    try {
+        CDataStream ssData(vRawTx, SER_NETWORK, PROTOCOL_VERSION);
+        ssData >> tx;
+        return ssData.empty();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+/** Decode and run the context-free checks on the submitted transactions nBegin to nEnd */
+static void CheckSubmittedTransactions(const std::vector<std::vector<unsigned char> >& vRawTx, std::vector<CTransaction>& vtx,
+                                       std::vector<CTxSubmitResult>& vResults, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CTxSubmitResult& result = vResults[i];
+        if (!DecodeRawTransaction(vRawTx[i], vtx[i])) {
+            result.status = CTxSubmitResult::DECODE_FAILED;
+            continue;
+        }
+        result.hash = vtx[i].GetHash();
+        CValidationState state;
+        if (!CheckTransaction(vtx[i], state)) {
+            result.status = CTxSubmitResult::REJECTED;
+            result.nRejectCode = state.GetRejectCode();
+            result.strRejectReason = state.GetRejectReason();
+            continue;
+        }
+        result.status = CTxSubmitResult::ACCEPTED;
+    }
+}
+
+/**
+ * Call fn on contiguous ranges covering [0, nCount), on as many threads as are
+ * worth it for SUBMIT_TRANSACTIONS_PER_THREAD transactions each
+ */
+static void ForTransactionRanges(size_t nCount, const boost::function<void(size_t, size_t)>& fn)
+{
+    size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), (nCount + SUBMIT_TRANSACTIONS_PER_THREAD - 1) / SUBMIT_TRANSACTIONS_PER_THREAD);
+    if (nThreads > 1) {
+        boost::thread_group threads;
+        for (size_t t = 1; t < nThreads; t++)
+            threads.create_thread(boost::bind(fn, nCount * t / nThreads, nCount * (t + 1) / nThreads));
+        fn(0, nCount / nThreads);
+        threads.join_all();
+    } else {
+        fn(0, nCount);
+    }
+}
+
+/**
+ * Verify the signatures of the transactions whose inputs are already known
+ * on the script-checking threads. This only fills the signature cache: the
+ * transactions are then accepted exactly as they would be alone, and find
+ * their valid signatures cached.
+ */
+static void WarmSignatureCache(const CTxMemPool& pool, const std::vector<const CTransaction*>& vtx)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads)
+        return;
+
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(vtx.size());
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        BOOST_FOREACH(const CTransaction* ptx, vtx) {
+            const CTransaction& tx = *ptx;
+            if (pool.exists(tx.GetHash()) || !view.HaveInputs(tx))
+                continue;
+            vTxData.push_back(PrecomputedTransactionData(tx));
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                vChecks.push_back(CScriptCheck());
+                CScriptCheck(*view.AccessCoins(tx.vin[j].prevout.hash), tx, j, STANDARD_SCRIPT_VERIFY_FLAGS, true, &vTxData.back()).swap(vChecks.back());
+            }
+        }
+    }
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+void SubmitTransactions(const std::vector<std::vector<unsigned char> >& vRawTx, CAmount nAbsurdFee, std::vector<CTxSubmitResult>& vResults)
+{
+    const size_t nTx = vRawTx.size();
+    std::vector<CTransaction> vtx(nTx);
+    vResults.assign(nTx, CTxSubmitResult());
+
+    // Decode and check the transactions before taking any lock
+    ForTransactionRanges(nTx, boost::bind(&CheckSubmittedTransactions, boost::cref(vRawTx), boost::ref(vtx), boost::ref(vResults), _1, _2));
+
+    LOCK(cs_main);
+
+    std::vector<const CTransaction*> vtxChecked;
+    vtxChecked.reserve(nTx);
+    for (size_t i = 0; i < nTx; i++) {
+        if (vResults[i].status == CTxSubmitResult::ACCEPTED)
+            vtxChecked.push_back(&vtx[i]);
+    }
+    WarmSignatureCache(mempool, vtxChecked);
+
+    for (size_t i = 0; i < nTx; i++) {
+        CTxSubmitResult& result = vResults[i];
+        if (result.status != CTxSubmitResult::ACCEPTED)
+            continue;
+        const CTransaction& tx = vtx[i];
+        const CCoins* existingCoins = pcoinsTip->AccessCoins(result.hash);
+        if (existingCoins && existingCoins->nHeight < 1000000000) {
+            result.status = CTxSubmitResult::ALREADY_IN_CHAIN;
+            continue;
+        }
+        if (!mempool.exists(result.hash)) {
+            CValidationState state;
+            bool fMissingInputs = false;
+            if (!AcceptToMemoryPool(mempool, state, tx, false, &fMissingInputs, false, nAbsurdFee)) {
+                if (state.IsInvalid())
+                    result.status = CTxSubmitResult::REJECTED;
+                else if (fMissingInputs)
+                    result.status = CTxSubmitResult::MISSING_INPUTS;
+                else
+                    result.status = CTxSubmitResult::FAILED;
+                result.nRejectCode = state.GetRejectCode();
+                result.strRejectReason = state.GetRejectReason();
+                continue;
+            }
+        }
+        RelayTransaction(tx);
+    }
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1721,6 +1973,35 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // The block is preceded by the message start and its size
+    CDiskBlockPos hpos = pos;
+    if (hpos.nPos < 8)
+        return error("%s: invalid block position %s", __func__, pos.ToString());
+    hpos.nPos -= 8;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blockStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blockStart) >> nSize;
+        if (memcmp(blockStart, messageStart, MESSAGE_START_SIZE))
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+            return error("%s: block size %u too large at %s", __func__, nSize, pos.ToString());
+        size_t nOffset = vchBlock.size();
+        vchBlock.resize(nOffset + nSize);
+        filein.read((char*)&vchBlock[nOffset], nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 static const int64_t nReleaseBlocks = 100;
 static const int64_t nStartSubsidy = 32 * COIN;
 static const int64_t nMinSubsidy = COIN / 2;
@@ -2075,26 +2356,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
                 } else if (!check()) {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
-                        if (check2())
-                            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after soft-fork
-                    // super-majority signaling has occurred.
-                    return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+                    return ScriptCheckFailed(check, *coins, tx, i, state, flags, cacheStore, txdata);
                 }
             }
         }
@@ -2103,6 +2365,33 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     return true;
 }
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
+{
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    // Read block
+    uint256 hashChecksum;
+    try {
+        filein >> blockundo;
+        filein >> hashChecksum;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    // Verify checksum
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher << blockundo;
+    if (hashChecksum != hasher.GetHash())
+        return error("%s: Checksum mismatch", __func__);
+
+    return true;
+}
+
 namespace {
 
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
@@ -2132,32 +2421,6 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
-{
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
-    uint256 hashChecksum;
-    try {
-        filein >> blockundo;
-        filein >> hashChecksum;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-    }
-
-    // Verify checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
-    hasher << hashBlock;
-    hasher << blockundo;
-    if (hashChecksum != hasher.GetHash())
-        return error("%s: Checksum mismatch", __func__);
-
-    return true;
-}
 
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
@@ -2305,8 +2568,6 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("skeincoin-scriptch");
     scriptcheckqueue.Thread();
@@ -2473,14 +2734,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
-    std::vector<uint256> vOrphanErase;
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -2504,17 +2761,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
             }
 
-            // Which orphan pool entries must we evict?
-            for (size_t j = 0; j < tx.vin.size(); j++) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(tx.vin[j].prevout);
-                if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
-                for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                    const CTransaction& orphanTx = (*mi)->second.tx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    vOrphanErase.push_back(orphanHash);
-                }
-            }
-
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
                 return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
                                  REJECT_INVALID, "bad-txns-nonfinal");
@@ -2548,9 +2794,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
-
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
@@ -2589,10 +2832,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2605,13 +2844,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
     // Erase orphan transactions include or precluded by this block
-    if (vOrphanErase.size()) {
-        int nErased = 0;
-        BOOST_FOREACH(uint256 &orphanHash, vOrphanErase) {
-            nErased += EraseOrphanTx(orphanHash);
-        }
-        LogPrint("mempool", "Erased %d orphan tx included or conflicted by block\n", nErased);
-    }
+    int nOrphansErased = orphanage.EraseForBlock(block);
+    if (nOrphansErased > 0)
+        LogPrint("mempool", "Erased %d orphan tx included or conflicted by block\n", nOrphansErased);
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
@@ -2843,6 +3078,8 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         // UpdateTransactionsFromBlock finds descendants of any transactions in this
         // block that were added back and cleans up the mempool state.
         mempool.UpdateTransactionsFromBlock(vHashUpdate);
+        if (pmempoolRecorder)
+            pmempoolRecorder->RecordDisconnect(pindexDelete->pprev->nHeight, vHashUpdate);
     }
 
     // Update chainActive and related variables.
@@ -2904,6 +3141,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
+    if (pmempoolRecorder && !IsInitialBlockDownload())
+        pmempoolRecorder->RecordBlock(*pblock, pindexNew->nHeight);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
     // Tell wallet about transactions that went from mempool
@@ -3133,9 +3372,10 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
 
         // Notifications/callbacks that can run without cs_main
-        // Always notify the UI if a new block tip was connected
+        // Always notify the UI and listeners if a new block tip was connected
         if (pindexFork != pindexNewTip) {
             uiInterface.NotifyBlockTip(fInitialDownload, pindexNewTip);
+            GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
             if (!fInitialDownload) {
                 // Find the hashes of all blocks that weren't previously in the best chain.
@@ -3161,10 +3401,6 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
                         }
                     }
                 }
-                // Notify external listeners about the new tip.
-                if (!vHashes.empty()) {
-                    GetMainSignals().UpdatedBlockTip(pindexNewTip);
-                }
             }
         }
     } while (pindexNewTip != pindexMostWork);
@@ -3719,6 +3955,56 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+/** Serialize a block or cmpctblock message for block, and keep it in the cache */
+static CSerializeDataRef BuildBlockMessage(const CBlock& block, const char* pszCommand, bool fWitness)
+{
+    CNetMessageBuilder builder(pszCommand, PROTOCOL_VERSION | (fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS));
+    if (strcmp(pszCommand, NetMsgType::CMPCTBLOCK) == 0)
+        builder << CBlockHeaderAndShortTxIDs(block, fWitness);
+    else
+        builder << block;
+
+    CachedBlockMessage entry;
+    entry.hash = block.GetHash();
+    entry.strCommand = pszCommand;
+    entry.fWitness = fWitness;
+    entry.msg = builder.Finish();
+    LOCK(cs_vBlockMessageCache);
+    if (vBlockMessageCache.size() >= BLOCK_MESSAGE_CACHE_SIZE)
+        vBlockMessageCache.pop_front();
+    vBlockMessageCache.push_back(entry);
+    return entry.msg;
+}
+
+/**
+ * Send a block extending our tip as a cmpctblock to the peers that asked for
+ * high-bandwidth relay as soon as its proof of work and CheckBlock pass,
+ * without waiting for it to be connected. Peers do not punish us for such
+ * blocks turning out invalid (BIP 152). Requires cs_main.
+ */
+static void RelayCompactBlockEarly(const CBlock& block, CBlockIndex* pindex)
+{
+    if (pindex->pprev != chainActive.Tip() || IsInitialBlockDownload())
+        return;
+
+    CSerializeDataRef msgs[2]; // without and with witnesses, built on first use
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes) {
+        CNodeState* state = State(pnode->GetId());
+        if (pnode->fDisconnect || !state || !state->fPreferHeaderAndIDs)
+            continue;
+        ProcessBlockAvailability(pnode->GetId());
+        if (PeerHasHeader(state, pindex) || !PeerHasHeader(state, pindex->pprev))
+            continue;
+        CSerializeDataRef& msg = msgs[state->fWantsCmpctWitness ? 1 : 0];
+        if (!msg)
+            msg = BuildBlockMessage(block, NetMsgType::CMPCTBLOCK, state->fWantsCmpctWitness);
+        LogPrint("net", "%s sending header-and-ids %s to peer %d\n", __func__, pindex->GetBlockHash().ToString(), pnode->id);
+        pnode->PushSerializedMessage(NetMsgType::CMPCTBLOCK, msg);
+        state->pindexBestHeaderSent = pindex;
+    }
+}
+
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
 static bool AcceptBlock(const CBlock& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
 {
@@ -3761,6 +4047,9 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    if (dbp == NULL && fFastBlockRelay)
+        RelayCompactBlockEarly(block, pindex);
+
     int nHeight = pindex->nHeight;
 
     // Write block to history file
@@ -3803,7 +4092,7 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, C
 {
     {
         LOCK(cs_main);
-        bool fRequested = MarkBlockAsReceived(pblock->GetHash());
+        bool fRequested = MarkBlockAsReceived(pblock->GetHash(), pfrom ? pfrom->GetId() : -1);
         fRequested |= fForceProcessing;
 
         // Store to disk
@@ -4115,16 +4404,22 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
 
+    // A transaction index written inline by ConnectBlock (older versions) is
+    // in sync with the chain tip; hand it over to the background indexer there.
+    bool fLegacyTxIndex = false;
+    if (pblocktree->ReadFlag("txindex", fLegacyTxIndex) && fLegacyTxIndex) {
+        LogPrintf("%s: upgrading transaction index at height %d\n", __func__, chainActive.Height());
+        if (!pblocktree->WriteTxIndex(std::vector<std::pair<uint256, CDiskTxPos> >(), chainActive.GetLocator()) ||
+            !pblocktree->WriteFlag("txindex", false))
+            return error("%s: failed to upgrade transaction index", __func__);
+    }
+
     PruneBlockIndexCandidates();
 
     LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
@@ -4330,8 +4625,7 @@ void UnloadBlockIndex()
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
-    mapOrphanTransactions.clear();
-    mapOrphanTransactionsByPrev.clear();
+    orphanage.Clear();
     nSyncStarted = 0;
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -4375,9 +4669,6 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (chainActive.Genesis() != NULL)
         return true;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4781,7 +5072,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
             // requesting or processing some txs which have already been included in a block
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
-                   mapOrphanTransactions.count(inv.hash) ||
+                   orphanage.HaveTx(inv.hash) ||
                    pcoinsTip->HaveCoinsInCache(inv.hash);
         }
     case MSG_BLOCK:
@@ -4792,148 +5083,200 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Get the serialized BLOCK or CMPCTBLOCK message for the block stored at pos,
+ * reading and serializing it on a cache miss. Does not need cs_main. Returns
+ * an empty reference if the block cannot be read.
+ */
+static CSerializeDataRef GetBlockMessage(const uint256& hash, const CDiskBlockPos& pos, const char* pszCommand, bool fWitness, const Consensus::Params& consensusParams)
+{
+    {
+        LOCK(cs_vBlockMessageCache);
+        BOOST_FOREACH(const CachedBlockMessage& entry, vBlockMessageCache) {
+            if (entry.hash == hash && entry.fWitness == fWitness && entry.strCommand == pszCommand)
+                return entry.msg;
+        }
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != hash) {
+        LogPrintf("%s: cannot load block %s from disk\n", __func__, hash.ToString());
+        return CSerializeDataRef();
+    }
+    return BuildBlockMessage(block, pszCommand, fWitness);
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
+    // A full or compact block to send once cs_main is released, as reading
+    // and serializing it does not need consensus state
+    const char* pszBlockCommand = NULL;
+    bool fBlockWitness = false;
+    uint256 hashBlockToSend;
+    CDiskBlockPos posBlockToSend;
+    uint256 hashContinueTip;
 
-    while (it != pfrom->vRecvGetData.end()) {
-        // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
-            break;
+    {
+        LOCK(cs_main);
 
-        const CInv &inv = *it;
-        {
-            boost::this_thread::interruption_point();
-            it++;
+        while (it != pfrom->vRecvGetData.end()) {
+            // Don't bother if send buffer is too full to respond anyway
+            if (pfrom->nSendSize >= SendBufferSize())
+                break;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+            const CInv &inv = *it;
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                boost::this_thread::interruption_point();
+                it++;
+
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                    bool send = false;
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end())
+                    {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            static const int nOneMonth = 30 * 24 * 60 * 60;
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a month older (both in time, and in
+                            // best equivalent proof of work) than the best header chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                                (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                                (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
+                            if (!send) {
+                                LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                            }
                         }
                     }
-                }
-                // disconnect node in case we have reached the outbound limit for serving historical blocks
-                // never disconnect whitelisted nodes
-                static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-                if (send && CNode::OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
-                {
-                    LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+                    // disconnect node in case we have reached the outbound limit for serving historical blocks
+                    // never disconnect whitelisted nodes
+                    static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
+                    if (send && CNode::OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
+                    {
+                        LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-                    //disconnect node
-                    pfrom->fDisconnect = true;
-                    send = false;
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
-                {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_FILTERED_BLOCK)
+                        //disconnect node
+                        pfrom->fDisconnect = true;
+                        send = false;
+                    }
+                    // Pruned nodes may have deleted the block, so check whether
+                    // it's available before trying to send.
+                    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                     {
-                        bool send = false;
-                        CMerkleBlock merkleBlock;
+                        if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+                            pszBlockCommand = NetMsgType::BLOCK;
+                            fBlockWitness = inv.type == MSG_WITNESS_BLOCK;
+                        }
+                        else if (inv.type == MSG_FILTERED_BLOCK)
                         {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                send = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                            // Send block from disk
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                                assert(!"cannot load block from disk");
+                            bool send = false;
+                            CMerkleBlock merkleBlock;
+                            {
+                                LOCK(pfrom->cs_filter);
+                                if (pfrom->pfilter) {
+                                    send = true;
+                                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                                }
+                            }
+                            if (send) {
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
                             }
+                            // else
+                                // no response
                         }
-                        if (send) {
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they wont have a useful mempool to match against a compact block,
+                            // and we don't feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+                            if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+                                pszBlockCommand = NetMsgType::CMPCTBLOCK;
+                            else
+                                pszBlockCommand = NetMsgType::BLOCK;
+                            fBlockWitness = fPeerWantsWitness;
+                        }
+                        if (pszBlockCommand) {
+                            hashBlockToSend = inv.hash;
+                            posBlockToSend = mi->second->GetBlockPos();
                         }
-                        // else
-                            // no response
-                    }
-                    else if (inv.type == MSG_CMPCT_BLOCK)
-                    {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they wont have a useful mempool to match against a compact block,
-                        // and we don't feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
-                        } else
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
-                    }
 
-                    // Trigger the peer node to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
-                    {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        pfrom->PushMessage(NetMsgType::INV, vInv);
-                        pfrom->hashContinue.SetNull();
+                        // Trigger the peer node to send a getblocks request for the next batch of inventory
+                        if (inv.hash == pfrom->hashContinue)
+                        {
+                            // Bypass PushInventory, this must send even if redundant,
+                            // and we want it right after the last block so they don't
+                            // wait for other stuff first.
+                            if (pszBlockCommand) {
+                                hashContinueTip = chainActive.Tip()->GetBlockHash();
+                            } else {
+                                vector<CInv> vInv;
+                                vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                                pfrom->PushMessage(NetMsgType::INV, vInv);
+                            }
+                            pfrom->hashContinue.SetNull();
+                        }
                     }
                 }
-            }
-            else if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX)
-            {
-                // Send stream from relay memory
-                bool push = false;
-                auto mi = mapRelay.find(inv.hash);
-                if (mi != mapRelay.end()) {
-                    pfrom->PushMessageWithFlag(inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0, NetMsgType::TX, *mi->second);
-                    push = true;
-                } else if (pfrom->timeLastMempoolReq) {
-                    auto txinfo = mempool.info(inv.hash);
-                    // To protect privacy, do not answer getdata using the mempool when
-                    // that TX couldn't have been INVed in reply to a MEMPOOL request.
-                    if (txinfo.tx && txinfo.nTime <= pfrom->timeLastMempoolReq) {
-                        pfrom->PushMessageWithFlag(inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0, NetMsgType::TX, *txinfo.tx);
+                else if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX)
+                {
+                    // Send stream from relay memory
+                    bool push = false;
+                    auto mi = mapRelay.find(inv.hash);
+                    if (mi != mapRelay.end()) {
+                        pfrom->PushMessageWithFlag(inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0, NetMsgType::TX, *mi->second);
                         push = true;
+                    } else if (pfrom->timeLastMempoolReq) {
+                        auto txinfo = mempool.info(inv.hash);
+                        // To protect privacy, do not answer getdata using the mempool when
+                        // that TX couldn't have been INVed in reply to a MEMPOOL request.
+                        if (txinfo.tx && txinfo.nTime <= pfrom->timeLastMempoolReq) {
+                            pfrom->PushMessageWithFlag(inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0, NetMsgType::TX, *txinfo.tx);
+                            push = true;
+                        }
+                    }
+                    if (!push) {
+                        vNotFound.push_back(inv);
                     }
                 }
-                if (!push) {
-                    vNotFound.push_back(inv);
-                }
-            }
 
-            // Track requests for our stuff.
-            GetMainSignals().Inventory(inv.hash);
+                // Track requests for our stuff.
+                GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
-                break;
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+                    break;
+            }
+        }
+    }
+
+    if (pszBlockCommand) {
+        CSerializeDataRef msg = GetBlockMessage(hashBlockToSend, posBlockToSend, pszBlockCommand, fBlockWitness, consensusParams);
+        if (msg)
+            pfrom->PushSerializedMessage(pszBlockCommand, msg);
+        if (!hashContinueTip.IsNull()) {
+            vector<CInv> vInv;
+            vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
+            pfrom->PushMessage(NetMsgType::INV, vInv);
         }
     }
 
@@ -4959,6 +5302,52 @@ uint32_t GetFetchFlags(CNode* pfrom, CBlockIndex* pprev, const Consensus::Params
     return nFetchFlags;
 }
 
+/**
+ * Track a peer's announcement of a transaction we do not have. Outbound and
+ * whitelisted peers are asked first; inbound ones only after a delay.
+ * Requires cs_main.
+ */
+static void AddTxAnnouncement(CNode* pfrom, const uint256& txid, int64_t nNow)
+{
+    if (txRequestTracker.Count(pfrom->GetId()) >= MAX_PEER_TX_ANNOUNCEMENTS)
+        return;
+    bool fPreferred = !pfrom->fInbound || pfrom->fWhitelisted;
+    txRequestTracker.ReceivedInv(pfrom->GetId(), txid, fPreferred, fPreferred ? nNow : nNow + NONPREF_PEER_TX_DELAY);
+}
+
+/**
+ * Validate a compact filter request from a peer and look up its stop block.
+ * Peers making requests we do not serve or that are malformed are disconnected.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256& hashStop,
+                                      uint32_t nMaxCount, const CBlockIndex*& pindexStop)
+{
+    if (!(nLocalServices & NODE_COMPACT_FILTERS) || pblockfilterindex == NULL || nFilterType != BLOCK_FILTER_BASIC) {
+        LogPrint("net", "peer %d requested unsupported block filter type %d, disconnect\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+            LogPrint("net", "peer %d requested block filters up to unknown block %s, disconnect\n", pfrom->id, hashStop.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        pindexStop = mi->second;
+    }
+
+    uint32_t nStopHeight = pindexStop->nHeight;
+    if (nStartHeight > nStopHeight || nStopHeight - nStartHeight >= nMaxCount) {
+        LogPrint("net", "peer %d requested invalid block filter range %d-%d, disconnect\n", pfrom->id, nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams)
 {
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -5337,7 +5726,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 if (fBlocksOnly)
                     LogPrint("net", "transaction (%s) inv sent in violation of protocol peer=%d\n", inv.hash.ToString(), pfrom->id);
                 else if (!fAlreadyHave && !fImporting && !fReindex && !IsInitialBlockDownload())
-                    pfrom->AskFor(inv);
+                    AddTxAnnouncement(pfrom, inv.hash, GetTimeMicros());
             }
 
             // Track requests for our stuff
@@ -5525,8 +5914,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return true;
         }
 
-        deque<COutPoint> vWorkQueue;
-        vector<uint256> vEraseQueue;
+        deque<uint256> vWorkQueue;
         CTransaction tx;
         vRecv >> tx;
 
@@ -5538,15 +5926,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         bool fMissingInputs = false;
         CValidationState state;
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
+        txRequestTracker.ReceivedResponse(pfrom->GetId(), inv.hash);
 
         if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs)) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
+            vWorkQueue.push_back(inv.hash);
 
             pfrom->nLastTXTime = GetTime();
 
@@ -5555,20 +5940,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 tx.GetHash().ToString(),
                 mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this one
+            // Recursively process any orphan transactions that depended on this one:
+            // one pass per accepted parent, trying each of its orphans once, in the
+            // order they arrived
             set<NodeId> setMisbehaving;
             while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+                const uint256 hashParent = vWorkQueue.front();
                 vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
+                BOOST_FOREACH(const COrphanTx* orphan, orphanage.GetChildren(hashParent))
                 {
-                    const CTransaction& orphanTx = (*mi)->second.tx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
+                    const CTransaction& orphanTx = orphan->tx;
+                    const uint256 orphanHash = orphan->hash;
+                    NodeId fromPeer = orphan->fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
                     // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
@@ -5581,10 +5964,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
                         RelayTransaction(orphanTx);
-                        for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
-                        vEraseQueue.push_back(orphanHash);
+                        vWorkQueue.push_back(orphanHash);
+                        orphanage.EraseTx(orphanHash);
                     }
                     else if (!fMissingInputs2)
                     {
@@ -5599,7 +5980,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                         // Has inputs but not accepted to mempool
                         // Probably non-standard or insufficient fee/priority
                         LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
                         if (orphanTx.wit.IsNull() && !stateDummy.CorruptionPossible()) {
                             // Do not use rejection cache for witness transactions or
                             // witness-stripped transactions, as they can have been malleated.
@@ -5607,13 +5987,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                             assert(recentRejects);
                             recentRejects->insert(orphanHash);
                         }
+                        orphanage.EraseTx(orphanHash);
                     }
                     mempool.check(pcoinsTip);
                 }
             }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
         }
         else if (fMissingInputs)
         {
@@ -5625,15 +6003,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 }
             }
             if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom, chainActive.Tip(), chainparams.GetConsensus());
+                int64_t nNow = GetTimeMicros();
                 BOOST_FOREACH(const CTxIn& txin, tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                    CInv _inv(MSG_TX, txin.prevout.hash);
                     pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+                    if (!AlreadyHave(_inv)) AddTxAnnouncement(pfrom, _inv.hash, nNow);
                 }
-                AddOrphanTx(tx, pfrom->GetId());
+                if (AddOrphanTx(tx, pfrom->GetId()))
+                    AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+                // DoS prevention: do not allow the orphanage to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
                 unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
                 if (nEvicted > 0)
@@ -5649,6 +6028,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 assert(recentRejects);
                 recentRejects->insert(tx.GetHash());
             }
+            // It may still show up in a block; keep it unless it is big or
+            // already in the mempool, where blocks are reconstructed from anyway
+            if (GetTransactionWeight(tx) < MAX_STANDARD_TX_WEIGHT && !mempool.exists(tx.GetHash()))
+                AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
 
             if (pfrom->fWhitelisted && GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
                 // Always relay transactions received from whitelisted peers, even
@@ -5681,6 +6064,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 Misbehaving(pfrom->GetId(), nDoS);
             }
         }
+        // Accepted, kept as an orphan or rejected for good: no need to fetch it again
+        if (AlreadyHave(inv))
+            txRequestTracker.ForgetTxHash(inv.hash);
         FlushStateToDisk(state, FLUSH_STATE_PERIODIC);
     }
 
@@ -5767,7 +6153,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 }
 
                 PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
-                ReadStatus status = partialBlock.InitData(cmpctblock);
+                ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status == READ_STATUS_INVALID) {
                     MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
                     Misbehaving(pfrom->GetId(), 100);
@@ -5810,7 +6196,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 // Optimistically try to reconstruct anyway since we might be
                 // able to without any round trips.
                 PartiallyDownloadedBlock tempBlock(&mempool);
-                ReadStatus status = tempBlock.InitData(cmpctblock);
+                ReadStatus status = tempBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status != READ_STATUS_OK) {
                     // TODO: don't ignore failures
                     return true;
@@ -6126,7 +6512,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr);
@@ -6289,6 +6678,70 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        std::vector<CBlockFilter> vFilters;
+        if (!pblockfilterindex->LookupFilterRange(nStartHeight, pindexStop, vFilters)) {
+            LogPrint("net", "block filters up to %s not indexed yet, ignoring getcfilters from peer=%d\n", hashStop.ToString(), pfrom->id);
+            return true;
+        }
+        BOOST_FOREACH(const CBlockFilter& filter, vFilters)
+            pfrom->PushMessage(NetMsgType::CFILTER, filter);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        uint256 hashPrevHeader;
+        std::vector<uint256> vFilterHashes;
+        if ((nStartHeight > 0 && !pblockfilterindex->LookupFilterHeader(pindexStop->GetAncestor(nStartHeight - 1), hashPrevHeader)) ||
+            !pblockfilterindex->LookupFilterHashRange(nStartHeight, pindexStop, vFilterHashes)) {
+            LogPrint("net", "block filters up to %s not indexed yet, ignoring getcfheaders from peer=%d\n", hashStop.ToString(), pfrom->id);
+            return true;
+        }
+        pfrom->PushMessage(NetMsgType::CFHEADERS, nFilterType, hashStop, hashPrevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(), pindexStop))
+            return true;
+
+        std::vector<uint256> vHeaders(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        for (unsigned int i = 0; i < vHeaders.size(); i++) {
+            if (!pblockfilterindex->LookupFilterHeader(pindexStop->GetAncestor((i + 1) * CFCHECKPT_INTERVAL), vHeaders[i])) {
+                LogPrint("net", "block filters up to %s not indexed yet, ignoring getcfcheckpt from peer=%d\n", hashStop.ToString(), pfrom->id);
+                return true;
+            }
+        }
+        pfrom->PushMessage(NetMsgType::CFCHECKPT, nFilterType, hashStop, vHeaders);
+    }
+
+
     else if (strCommand == NetMsgType::REJECT)
     {
         if (fDebug) {
@@ -6326,8 +6779,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
     else if (strCommand == NetMsgType::NOTFOUND) {
-        // We do not care about the NOTFOUND message, but logging an Unknown Command
-        // message would be undesirable as we transmit it ourselves.
+        // Transactions the peer does not have are requested from another peer
+        vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() > MAX_INV_SZ) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("message notfound size() = %u", vInv.size());
+        }
+
+        LOCK(cs_main);
+        BOOST_FOREACH(const CInv& inv, vInv) {
+            if ((inv.type & MSG_TYPE_MASK) == MSG_TX)
+                txRequestTracker.ReceivedResponse(pfrom->GetId(), inv.hash);
+        }
     }
 
     else {
@@ -6403,10 +6868,10 @@ bool ProcessMessages(CNode* pfrom)
         // Message size
         unsigned int nMessageSize = hdr.nMessageSize;
 
-        // Checksum
+        // Checksum, computed as the message was received
         CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = ReadLE32((unsigned char*)&hash);
+        const uint256& hash = msg.GetMessageHash();
+        unsigned int nChecksum = ReadLE32(hash.begin());
         if (nChecksum != hdr.nChecksum)
         {
             LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n", __func__,
@@ -6466,6 +6931,34 @@ bool ProcessMessages(CNode* pfrom)
     return fOk;
 }
 
+/**
+ * The bloom filter elements of the transaction announced at position nPos of
+ * txAnnounceQueue, extracted from the relayed transaction the first time a
+ * filtering peer asks for them.
+ */
+static std::shared_ptr<const CBloomTxElements> GetBloomElements(uint64_t nPos, const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+    auto it = mapBloomElements.find(nPos);
+    if (it != mapBloomElements.end())
+        return it->second;
+
+    std::shared_ptr<const CTransaction> tx;
+    auto mi = mapRelay.find(hash);
+    if (mi != mapRelay.end())
+        tx = mi->second;
+    else
+        tx = mempool.get(hash);
+    if (!tx)
+        return nullptr;
+    std::shared_ptr<const CBloomTxElements> elements = std::make_shared<const CBloomTxElements>(*tx);
+    // A filtering peer that stopped reading keeps everything after its
+    // cursor; past the limit, the elements are extracted again for each peer
+    if (mapBloomElements.size() < MAX_BLOOM_ELEMENTS_CACHE)
+        mapBloomElements.insert(std::make_pair(nPos, elements));
+    return elements;
+}
+
 class CompareInvMempoolOrder
 {
     CTxMemPool *mp;
@@ -6475,14 +6968,75 @@ public:
         mp = mempool;
     }
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(const CTxAnnounceQueue::Entry& a, const CTxAnnounceQueue::Entry& b)
     {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+        /* The entries with the fewest ancestors/highest fee sort first. */
+        return mp->CompareDepthAndScore(a.hash, b.hash);
     }
 };
 
+/**
+ * Queue the transactions relayed since the last trickle for announcement to
+ * all peers. They are sorted once here rather than by every peer.
+ */
+static void QueueTxAnnouncements(int64_t nNow)
+{
+    AssertLockHeld(cs_main);
+    if (!mapBloomElements.empty()) {
+        // Drop the bloom filter elements every filtering peer has walked past
+        uint64_t nMinCursor = std::numeric_limits<uint64_t>::max();
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                LOCK(pnode->cs_filter);
+                if (pnode->pfilter && !pnode->pfilter->IsFullOrEmpty())
+                    nMinCursor = std::min(nMinCursor, pnode->nTxAnnounceCursor);
+            }
+        }
+        mapBloomElements.erase(mapBloomElements.begin(), mapBloomElements.lower_bound(nMinCursor));
+    }
+
+    std::vector<uint256> vHashes;
+    txAnnounceQueue.TakePending(vHashes);
+    if (vHashes.empty())
+        return;
+    std::sort(vHashes.begin(), vHashes.end());
+    vHashes.erase(std::unique(vHashes.begin(), vHashes.end()), vHashes.end());
+
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
+    {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    std::vector<CTxAnnounceQueue::Entry> vEntries;
+    vEntries.reserve(vHashes.size());
+    BOOST_FOREACH(const uint256& hash, vHashes) {
+        // Not in the mempool anymore? don't bother sending it.
+        auto txinfo = mempool.info(hash);
+        if (!txinfo.tx)
+            continue;
+        CTxAnnounceQueue::Entry entry;
+        entry.hash = hash;
+        entry.nFeePerK = txinfo.feeRate.GetFeePerK();
+        entry.nTime = nNow / 1000000;
+        vEntries.push_back(entry);
+
+        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+        if (ret.second) {
+            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+        }
+    }
+
+    // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
+    {
+        LOCK(mempool.cs);
+        std::sort(vEntries.begin(), vEntries.end(), CompareInvMempoolOrder(&mempool));
+    }
+    txAnnounceQueue.Append(vEntries, nNow / 1000000);
+}
+
 bool SendMessages(CNode* pto)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -6536,6 +7090,7 @@ bool SendMessages(CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -6685,11 +7240,10 @@ bool SendMessages(CNode* pto)
                     // probably means we're doing an initial-ish-sync or they're slow
                     LogPrint("net", "%s sending header-and-ids %s to peer %d\n", __func__,
                             vHeaders.front().GetHash().ToString(), pto->id);
-                    //TODO: Shouldn't need to reload block from disk, but requires refactor
-                    CBlock block;
-                    assert(ReadBlockFromDisk(block, pBestIndex, consensusParams));
-                    CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                    pto->PushMessageWithFlag(state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
+                    CSerializeDataRef msg = GetBlockMessage(pBestIndex->GetBlockHash(), pBestIndex->GetBlockPos(), NetMsgType::CMPCTBLOCK, state.fWantsCmpctWitness, consensusParams);
+                    if (!msg)
+                        assert(!"cannot load block from disk");
+                    pto->PushSerializedMessage(NetMsgType::CMPCTBLOCK, msg);
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
                     if (vHeaders.size() > 1) {
@@ -6739,6 +7293,20 @@ bool SendMessages(CNode* pto)
         // Message: inventory
         //
         vector<CInv> vInv;
+
+        // Check whether periodic sends should happen
+        bool fSendTrickle = pto->fWhitelisted;
+        if (pto->nNextInvSend < nNow) {
+            fSendTrickle = true;
+            // Use half the delay for outbound peers, as there is less privacy concern for them.
+            pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
+        }
+
+        // Fill the shared announcement queue before taking cs_inventory, as
+        // it takes cs_vNodes, which is taken before cs_inventory elsewhere
+        if (fSendTrickle)
+            QueueTxAnnouncements(nNow);
+
         {
             LOCK(pto->cs_inventory);
             vInv.reserve(std::max<size_t>(pto->vInventoryBlockToSend.size(), INVENTORY_BROADCAST_MAX));
@@ -6753,18 +7321,10 @@ bool SendMessages(CNode* pto)
             }
             pto->vInventoryBlockToSend.clear();
 
-            // Check whether periodic sends should happen
-            bool fSendTrickle = pto->fWhitelisted;
-            if (pto->nNextInvSend < nNow) {
-                fSendTrickle = true;
-                // Use half the delay for outbound peers, as there is less privacy concern for them.
-                pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
-            }
-
             // Time to send but the peer has requested we not relay transactions.
             if (fSendTrickle) {
                 LOCK(pto->cs_filter);
-                if (!pto->fRelayTxes) pto->setInventoryTxToSend.clear();
+                if (!pto->fRelayTxes) pto->nTxAnnounceCursor = txAnnounceQueue.End();
             }
 
             // Respond to BIP35 mempool requests
@@ -6782,7 +7342,6 @@ bool SendMessages(CNode* pto)
                 for (const auto& txinfo : vtxinfo) {
                     const uint256& hash = txinfo.tx->GetHash();
                     CInv inv(MSG_TX, hash);
-                    pto->setInventoryTxToSend.erase(hash);
                     if (filterrate) {
                         if (txinfo.feeRate.GetFeePerK() < filterrate)
                             continue;
@@ -6802,67 +7361,53 @@ bool SendMessages(CNode* pto)
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
-                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
-                LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
-                    // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
-                    // Check if not in the filter already
-                    if (pto->filterInventoryKnown.contains(hash)) {
-                        continue;
-                    }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
-                    }
-                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
-                        continue;
-                    }
-                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                    // Send
-                    vInv.push_back(CInv(MSG_TX, hash));
-                    nRelayedTransactions++;
-                    {
-                        // Expire old relay messages
-                        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
-                        {
-                            mapRelay.erase(vRelayExpiration.front().second);
-                            vRelayExpiration.pop_front();
+                std::vector<CTxAnnounceQueue::Entry> vEntries;
+                LOCK2(pto->cs_filter, mempool.cs);
+                while (nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
+                    // Walk the shared queue from where this peer left off, reading
+                    // no more entries than may still be sent
+                    vEntries.clear();
+                    txAnnounceQueue.Read(pto->nTxAnnounceCursor, INVENTORY_BROADCAST_MAX - nRelayedTransactions, vEntries);
+                    if (vEntries.empty())
+                        break;
+                    uint64_t nPos = pto->nTxAnnounceCursor - vEntries.size();
+                    for (size_t i = 0; i < vEntries.size(); i++, nPos++) {
+                        const CTxAnnounceQueue::Entry& entry = vEntries[i];
+                        // Check if not in the filter already
+                        if (pto->filterInventoryKnown.contains(entry.hash)) {
+                            continue;
                         }
-
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
-                        if (ret.second) {
-                            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+                        if (filterrate && entry.nFeePerK < filterrate) {
+                            continue;
                         }
+                        // Not in the mempool anymore? don't bother sending it.
+                        if (pto->pfilter && !pto->pfilter->IsFullOrEmpty()) {
+                            if (!mempool.exists(entry.hash)) continue;
+                            std::shared_ptr<const CBloomTxElements> elements = GetBloomElements(nPos, entry.hash);
+                            if (!elements || !pto->pfilter->IsRelevantAndUpdate(*elements)) continue;
+                        } else if (pto->pfilter) {
+                            auto txinfo = mempool.info(entry.hash);
+                            if (!txinfo.tx || !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                        } else if (!mempool.exists(entry.hash)) {
+                            continue;
+                        }
+                        // Send
+                        vInv.push_back(CInv(MSG_TX, entry.hash));
+                        nRelayedTransactions++;
+                        if (vInv.size() == MAX_INV_SZ) {
+                            pto->PushMessage(NetMsgType::INV, vInv);
+                            vInv.clear();
+                        }
+                        pto->filterInventoryKnown.insert(entry.hash);
                     }
-                    if (vInv.size() == MAX_INV_SZ) {
-                        pto->PushMessage(NetMsgType::INV, vInv);
-                        vInv.clear();
-                    }
-                    pto->filterInventoryKnown.insert(hash);
                 }
             }
         }
@@ -6896,10 +7441,11 @@ bool SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nMaxBlocksInFlight = GetBlocksInTransitPerPeer(state.nAvgBlockInterval);
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nMaxBlocksInFlight) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nMaxBlocksInFlight - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -6918,24 +7464,27 @@ bool SendMessages(CNode* pto)
         //
         // Message: getdata (non-blocks)
         //
-        while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
-        {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv))
-            {
-                if (fDebug)
-                    LogPrint("net", "Requesting %s peer=%d\n", inv.ToString(), pto->id);
-                vGetData.push_back(inv);
-                if (vGetData.size() >= 1000)
-                {
-                    pto->PushMessage(NetMsgType::GETDATA, vGetData);
-                    vGetData.clear();
+        if (!pto->fDisconnect) {
+            uint32_t nFetchFlags = GetFetchFlags(pto, chainActive.Tip(), consensusParams);
+            BOOST_FOREACH(const uint256& txid, txRequestTracker.GetRequestable(pto->GetId(), nNow)) {
+                if (txRequestTracker.CountInFlight(pto->GetId()) >= MAX_PEER_TX_IN_FLIGHT)
+                    break;
+                CInv inv(MSG_TX | nFetchFlags, txid);
+                if (!AlreadyHave(inv)) {
+                    if (fDebug)
+                        LogPrint("net", "Requesting %s peer=%d\n", inv.ToString(), pto->id);
+                    vGetData.push_back(inv);
+                    if (vGetData.size() >= 1000)
+                    {
+                        pto->PushMessage(NetMsgType::GETDATA, vGetData);
+                        vGetData.clear();
+                    }
+                    txRequestTracker.RequestedTx(pto->GetId(), txid, nNow + TX_REQUEST_TIMEOUT);
+                } else {
+                    // If we're not going to ask, no one needs to be asked
+                    txRequestTracker.ForgetTxHash(txid);
                 }
-            } else {
-                //If we're not going to ask, don't expect a response.
-                pto->setAskFor.erase(inv.hash);
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
         if (!vGetData.empty())
             pto->PushMessage(NetMsgType::GETDATA, vGetData);
@@ -6977,6 +7526,158 @@ ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::D
     return VersionBitsState(chainActive.Tip(), params, pos, versionbitscache);
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of transactions reloaded into the mempool per lock of cs_main */
+static const unsigned int MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+/** Run the context-free checks on the reloaded transactions nBegin to nEnd */
+static void CheckBatchTransactions(const std::vector<std::pair<CTransaction, int64_t> >& vBatch, std::vector<char>& vValid, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CValidationState state;
+        vValid[i] = CheckTransaction(vBatch[i].first, state);
+    }
+}
+
+/**
+ * Accept a batch of transactions with their original entry times under one
+ * lock of cs_main. The mempool is trimmed to its limits once for the whole
+ * batch rather than after every transaction. Returns the number accepted.
+ *
+ * Like SubmitTransactions, the context-free checks run on several threads
+ * before the lock is taken, and the signatures of the transactions whose
+ * inputs are known are verified on the script-checking threads first. Each
+ * transaction is then accepted on its own, finding its signatures cached.
+ */
+static unsigned int AcceptBatchToMemoryPool(CTxMemPool& pool, const std::vector<std::pair<CTransaction, int64_t> >& vBatch)
+{
+    std::vector<char> vValid(vBatch.size());
+    ForTransactionRanges(vBatch.size(), boost::bind(&CheckBatchTransactions, boost::cref(vBatch), boost::ref(vValid), _1, _2));
+
+    LOCK(cs_main);
+    std::vector<const CTransaction*> vtxChecked;
+    vtxChecked.reserve(vBatch.size());
+    for (size_t i = 0; i < vBatch.size(); i++) {
+        if (vValid[i])
+            vtxChecked.push_back(&vBatch[i].first);
+    }
+    WarmSignatureCache(pool, vtxChecked);
+
+    std::vector<uint256> vAccepted;
+    for (size_t i = 0; i < vBatch.size(); i++) {
+        if (!vValid[i])
+            continue;
+        CValidationState state;
+        if (AcceptToMemoryPoolWithTime(pool, state, vBatch[i].first, true, NULL, vBatch[i].second, true))
+            vAccepted.push_back(vBatch[i].first.GetHash());
+    }
+    LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+
+    unsigned int nAccepted = 0;
+    BOOST_FOREACH(const uint256& hash, vAccepted)
+        nAccepted += pool.exists(hash);
+    return nAccepted;
+}
+
+bool LoadMempool()
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nStart = GetTimeMicros();
+    uint64_t nAccepted = 0, nFailed = 0, nExpired = 0;
+    int64_t nNow = GetTime();
+    try {
+        uint64_t nVersion;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return false;
+
+        // Restore the fee and priority deltas first, so the transactions are
+        // accepted with them
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); ++it)
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+
+        // Parents were dumped before their children, so batches can be
+        // accepted in order
+        uint64_t nCount;
+        file >> nCount;
+        std::vector<std::pair<CTransaction, int64_t> > vBatch;
+        vBatch.reserve(MEMPOOL_LOAD_BATCH_SIZE);
+        while (nCount--) {
+            CTransaction tx;
+            int64_t nTime;
+            file >> tx;
+            file >> nTime;
+            if (nTime + nExpiryTimeout > nNow)
+                vBatch.push_back(std::make_pair(tx, nTime));
+            else
+                nExpired++;
+
+            if (vBatch.size() == MEMPOOL_LOAD_BATCH_SIZE || (nCount == 0 && !vBatch.empty())) {
+                unsigned int nBatchAccepted = AcceptBatchToMemoryPool(mempool, vBatch);
+                nAccepted += nBatchAccepted;
+                nFailed += vBatch.size() - nBatchAccepted;
+                vBatch.clear();
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %u successes, %u failed, %u expired (%.2fms)\n",
+        nAccepted, nFailed, nExpired, 0.001 * (GetTimeMicros() - nStart));
+    return true;
+}
+
+void DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<TxMempoolInfo> vInfo;
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        vInfo = mempool.infoAll();
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr)
+            return;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        uint64_t nVersion = MEMPOOL_DUMP_VERSION;
+        file << nVersion;
+        file << mapDeltas;
+        file << (uint64_t)vInfo.size();
+        BOOST_FOREACH(const TxMempoolInfo& info, vInfo) {
+            file << *info.tx;
+            file << info.nTime;
+        }
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        int64_t nLast = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (nMid - nStart) * 0.000001, (nLast - nMid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+    }
+}
+
 class CMainCleanup
 {
 public:
@@ -6989,7 +7690,6 @@ public:
         mapBlockIndex.clear();
 
         // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
+        orphanage.Clear();
     }
 } instance_of_cmaincleanup;
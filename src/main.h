@@ -31,6 +31,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -57,10 +58,10 @@ static const CAmount HIGH_TX_FEE_PER_KB = 0.01 * COIN;
 static const CAmount HIGH_MAX_TX_FEE = 100 * HIGH_TX_FEE_PER_KB;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default number of recently evicted, replaced, orphaned and rejected transactions kept for compact block reconstruction */
+static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Expiration time for orphan transactions in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default for -limitancestorcount, max number of in-mempool ancestors */
 static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
 /** Default for -limitancestorsize, maximum kilobytes of tx + all in-mempool ancestors */
@@ -71,6 +72,10 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempoolsnapshotinterval, milliseconds between mempool snapshots served to RPC readers */
+static const int64_t DEFAULT_MEMPOOL_SNAPSHOT_INTERVAL = 500;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -82,8 +87,22 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Transactions with at least this many inputs have their scripts checked in parallel when entering the mempool */
+static const unsigned int MIN_PARALLEL_SCRIPT_CHECK_INPUTS = 16;
+/** Number of transactions submitted together that are worth another thread to decode and check */
+static const unsigned int SUBMIT_TRANSACTIONS_PER_THREAD = 32;
+/** Maximum number of transactions submitted together by one sendrawtransactions or /rest/sendtxs request */
+static const size_t MAX_SUBMIT_TRANSACTIONS = 10000;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 128;
+/** Number of blocks requested at once from a peer whose download speed we have not measured yet. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Minimum number of blocks requested at once from a peer, however slow. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** How many seconds of its measured download speed worth of blocks to request from a peer at once. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_TIME = 5;
+/** Time in microseconds a block must have been in flight before it may be requested from a faster peer instead. */
+static const int64_t BLOCK_STRAGGLER_MIN_TIME = 2 * 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 60;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -115,6 +134,16 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Maximum number of queued announcements whose bloom filter elements are kept for filtering peers */
+static const size_t MAX_BLOOM_ELEMENTS_CACHE = 5000;
+/** Maximum number of transaction announcements of a peer being tracked. */
+static const size_t MAX_PEER_TX_ANNOUNCEMENTS = 5000;
+/** Maximum number of transactions requested from a peer at once. */
+static const size_t MAX_PEER_TX_IN_FLIGHT = 100;
+/** Delay before requesting a transaction from an inbound peer, in microseconds. Outbound peers are asked first. */
+static const int64_t NONPREF_PEER_TX_DELAY = 2 * 1000000;
+/** Time to wait for a requested transaction before asking another peer, in microseconds. */
+static const int64_t TX_REQUEST_TIMEOUT = 60 * 1000000;
 /** Average delay between feefilter broadcasts in seconds. */
 static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -137,6 +166,8 @@ static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 static const bool DEFAULT_TESTSAFEMODE = false;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
+/** Default for -fastblockrelay */
+static const bool DEFAULT_FAST_BLOCK_RELAY = true;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 
@@ -147,6 +178,13 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+/** Maximum number of compact filters served for one getcfilters request */
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of filter hashes served for one getcfheaders request */
+static const unsigned int MAX_GETCFHEADERS_SIZE = 2000;
+/** Interval between the filter headers of a cfcheckpt message */
+static const int CFCHECKPT_INTERVAL = 1000;
 
 struct BlockHasher
 {
@@ -180,6 +218,7 @@ extern CAmount maxTxFee;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 extern int64_t nMaxTipAge;
 extern bool fEnableReplacement;
+extern bool fFastBlockRelay;
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
@@ -298,6 +337,19 @@ CBlockIndex * InsertBlockIndex(uint256 hash);
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
+/**
+ * The number of blocks to keep in flight from a peer that takes nAvgBlockInterval
+ * microseconds to send each one: enough for BLOCK_DOWNLOAD_TARGET_TIME, or
+ * DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER if it was not measured yet (0).
+ */
+int GetBlocksInTransitPerPeer(int64_t nAvgBlockInterval);
+/**
+ * Whether a block that has been in flight for nInFlight microseconds from a peer
+ * with the given average response time and block interval should be requested
+ * instead from a peer taking nAvgBlockInterval per block: it has been in flight
+ * well over the time its peer usually takes, and the other peer is faster.
+ */
+bool IsStragglingBlock(int64_t nInFlight, int64_t nHolderAvgBlockResponse, int64_t nHolderAvgBlockInterval, int64_t nAvgBlockInterval);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
@@ -307,6 +359,40 @@ void PruneAndFlush();
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+
+/** What became of one transaction submitted with SubmitTransactions */
+struct CTxSubmitResult
+{
+    enum Status {
+        DECODE_FAILED,    //!< Not a valid serialized transaction
+        REJECTED,         //!< Invalid, see nRejectCode and strRejectReason
+        MISSING_INPUTS,   //!< Spends outputs that are neither in the chain nor in the mempool
+        FAILED,           //!< Not accepted for another reason, see strRejectReason
+        ALREADY_IN_CHAIN, //!< Already confirmed
+        ACCEPTED,         //!< In the mempool, now or already before, and relayed
+    };
+
+    uint256 hash;
+    Status status;
+    int nRejectCode;
+    std::string strRejectReason;
+
+    CTxSubmitResult() : status(DECODE_FAILED), nRejectCode(0) {}
+};
+
+/**
+ * Submit a batch of serialized transactions to the memory pool and relay the
+ * accepted ones, as sendrawtransaction does for one. Decoding and the
+ * context-free checks run in parallel, then the signatures of the
+ * transactions whose inputs are known are verified in parallel, and then the
+ * transactions are accepted in order, all under a single lock of cs_main. A
+ * transaction may spend the outputs of an earlier one of the batch.
+ */
+void SubmitTransactions(const std::vector<std::vector<unsigned char> >& vRawTx, CAmount nAbsurdFee, std::vector<CTxSubmitResult>& vResults);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -435,6 +521,7 @@ public:
     }
 
     ScriptError GetScriptError() const { return error; }
+    unsigned int GetInputIndex() const { return nIn; }
 };
 
 
@@ -442,6 +529,9 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Append the serialized block stored at pos to vchBlock, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -534,4 +624,10 @@ static const unsigned int REJECT_ALREADY_KNOWN = 0x101;
 /** Transaction conflicts with a transaction already known */
 static const unsigned int REJECT_CONFLICT = 0x102;
 
+/** Dump the mempool to disk, with the entry times and fee deltas */
+void DumpMempool();
+
+/** Load the mempool from disk, accepting the transactions in batches */
+bool LoadMempool();
+
 #endif // BITCOIN_MAIN_H
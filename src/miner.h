@@ -156,6 +156,7 @@ private:
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
+    CTxMemPool& pool;
 
     // Variables used for addPriorityTxs
     int lastFewTxs;
@@ -163,8 +164,13 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams);
+    BlockAssembler(const CChainParams& chainparams, CTxMemPool& pool);
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
+    /** Select the transactions of a block at nHeight from the mempool alone,
+     *  without a chain tip: the coinbase, header and validity check are left
+     *  out. Used to measure transaction selection on its own. */
+    CBlockTemplate* SelectTransactions(int nHeight, int64_t nLockTimeCutoff, bool fIncludeWitness);
 
 private:
     // utility functions
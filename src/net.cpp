@@ -21,10 +21,15 @@
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -98,7 +103,7 @@ std::string strSubVersion;
 
 std::vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
+CTxAnnounceQueue txAnnounceQueue;
 
 static std::deque<std::string> vOneShots;
 CCriticalSection cs_vOneShots;
@@ -769,6 +774,66 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
     return true;
 }
 
+/**
+ * Message data buffers kept for reuse. Buffers are sized for the whole
+ * message before its data is received; recycling the large ones saves
+ * mapping and faulting in fresh memory (and wiping it on free) for every
+ * block.
+ */
+static CCriticalSection cs_vRecvBufferPool;
+static std::vector<CSerializeData> vRecvBufferPool;
+//! Maximum number of buffers in the pool
+static const size_t RECV_BUFFER_POOL_SIZE = 8;
+//! Buffers below this capacity are cheap to allocate and not worth pooling
+static const size_t RECV_BUFFER_POOL_MIN = 64 * 1024;
+
+//! How far ahead of the data received a message buffer is allocated
+static const size_t RECV_BUFFER_AHEAD = 256 * 1024;
+
+/** Give vRecv a pooled buffer that can hold nSize bytes, if there is one */
+static void GetRecvBuffer(CDataStream& vRecv, size_t nSize)
+{
+    if (nSize < RECV_BUFFER_POOL_MIN)
+        return;
+    LOCK(cs_vRecvBufferPool);
+    for (size_t i = 0; i < vRecvBufferPool.size(); i++) {
+        if (vRecvBufferPool[i].capacity() >= nSize) {
+            vRecv.swap(vRecvBufferPool[i]);
+            vRecvBufferPool.erase(vRecvBufferPool.begin() + i);
+            return;
+        }
+    }
+}
+
+/** Return the buffer of a message that is done with to the pool */
+static void ReleaseRecvBuffer(CDataStream& vRecv)
+{
+    CSerializeData vch;
+    vRecv.swap(vch);
+    if (vch.capacity() < RECV_BUFFER_POOL_MIN)
+        return;
+    vch.clear();
+
+    LOCK(cs_vRecvBufferPool);
+    if (vRecvBufferPool.size() < RECV_BUFFER_POOL_SIZE) {
+        vRecvBufferPool.push_back(CSerializeData());
+        vRecvBufferPool.back().swap(vch);
+        return;
+    }
+    // Keep the largest buffers, which are the most expensive to allocate
+    for (size_t i = 0; i < vRecvBufferPool.size(); i++) {
+        if (vRecvBufferPool[i].capacity() < vch.capacity()) {
+            vRecvBufferPool[i].swap(vch);
+            return;
+        }
+    }
+}
+
+CNetMessage::~CNetMessage()
+{
+    ReleaseRecvBuffer(vRecv);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -797,6 +862,9 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    if (hdr.nMessageSize == 0)
+        hasher.Finalize(hashData.begin());
+
     return nCopy;
 }
 
@@ -805,14 +873,23 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
+    // A pooled buffer costs nothing to take, but fresh memory is allocated
+    // only up to RECV_BUFFER_AHEAD ahead of the data actually received, so
+    // that a header alone cannot make us allocate the whole message
+    if (nDataPos == 0)
+        GetRecvBuffer(vRecv, hdr.nMessageSize);
+    if (vRecv.size() < nDataPos + nCopy)
+        vRecv.resize(std::min((size_t)hdr.nMessageSize, nDataPos + nCopy + RECV_BUFFER_AHEAD));
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
+    // Checksum the data while it is still hot in the cache, on the socket
+    // handler thread rather than the message handler thread
+    hasher.Write((const unsigned char*)pch, nCopy);
+    if (nDataPos == hdr.nMessageSize)
+        hasher.Finalize(hashData.begin());
+
     return nCopy;
 }
 
@@ -824,25 +901,57 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
 
 
+#ifndef WIN32
+/** Maximum number of queued messages handed to a single sendmsg call */
+static const int SEND_IOV_MAX = 64;
+#endif
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializeDataRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
+#ifdef WIN32
+        const CSerializeData &data = **it;
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Gather the queued messages into one call, so that a queue of many
+        // small messages does not cost a system call each
+        struct iovec iov[SEND_IOV_MAX];
+        int nIov = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (std::deque<CSerializeDataRef>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < SEND_IOV_MAX; ++itIov) {
+            iov[nIov].iov_base = (void*)(&(**itIov)[nOffset]);
+            iov[nIov].iov_len = (*itIov)->size() - nOffset;
+            nOffset = 0;
+            nIov++;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the messages that were sent completely
+            size_t nSent = nBytes;
+            while (nSent > 0) {
+                const size_t nLeft = (*it)->size() - pnode->nSendOffset;
+                if (nSent < nLeft) {
+                    pnode->nSendOffset += nSent;
+                    break;
+                }
+                nSent -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
+            }
+            if (pnode->nSendOffset > 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1088,9 +1197,253 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+static const int SOCKET_EVENT_RECV = 1;
+static const int SOCKET_EVENT_SEND = 2;
+static const int SOCKET_EVENT_ERROR = 4;
+
+/**
+ * Waits for the sockets of the socket handler thread to become ready.
+ *
+ * Sockets are watched for one pass of the thread at a time: Watch every
+ * socket of interest, then Wait. Sockets that were not watched again since
+ * the previous Wait are forgotten. Errors are always reported.
+ *
+ * With epoll, sockets stay registered with the kernel between passes and
+ * are only updated when the events of interest change, so a pass costs a
+ * system call per change and per ready socket rather than per socket.
+ * Otherwise poll() (or select() on Windows) is handed the full set on
+ * every pass.
+ */
+class CSocketEvents
+{
+private:
+    struct CWatch
+    {
+        int64_t nOwner; //!< Tells apart sockets that reuse a descriptor number
+        int nEvents;
+        bool fRegistered; //!< Registered with the kernel (epoll only)
+        bool fWatched; //!< Watched since the last Wait
+    };
+    std::map<SOCKET, CWatch> mapWatch;
+#ifdef USE_EPOLL
+    int epollfd;
+    std::vector<struct epoll_event> vEvents;
+
+    void Register(SOCKET hSocket, CWatch& watch)
+    {
+        struct epoll_event event;
+        event.events = 0;
+        if (watch.nEvents & SOCKET_EVENT_RECV)
+            event.events |= EPOLLIN;
+        if (watch.nEvents & SOCKET_EVENT_SEND)
+            event.events |= EPOLLOUT;
+        event.data.u64 = hSocket;
+        if (watch.fRegistered && epoll_ctl(epollfd, EPOLL_CTL_MOD, hSocket, &event) == 0)
+            return;
+        // Not registered yet, or a closed socket whose descriptor was reused
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hSocket, &event) == 0 ||
+            (errno == EEXIST && epoll_ctl(epollfd, EPOLL_CTL_MOD, hSocket, &event) == 0)) {
+            watch.fRegistered = true;
+        } else {
+            LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+            watch.fRegistered = false;
+        }
+    }
+#endif
+
+public:
+    CSocketEvents()
+    {
+#ifdef USE_EPOLL
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd < 0)
+            LogPrintf("socket epoll_create1 error %s\n", NetworkErrorString(WSAGetLastError()));
+#endif
+    }
+
+    ~CSocketEvents()
+    {
+#ifdef USE_EPOLL
+        if (epollfd >= 0)
+            close(epollfd);
+#endif
+    }
+
+    /** Wait for nEvents (SOCKET_EVENT_*) on hSocket in the next Wait */
+    void Watch(SOCKET hSocket, int64_t nOwner, int nEvents)
+    {
+        std::map<SOCKET, CWatch>::iterator it = mapWatch.find(hSocket);
+        if (it == mapWatch.end()) {
+            CWatch watch = {nOwner, -1, false, false};
+            it = mapWatch.insert(std::make_pair(hSocket, watch)).first;
+        } else if (it->second.nOwner != nOwner) {
+            // The previous owner's socket was closed, taking its registration along
+            it->second.nOwner = nOwner;
+            it->second.nEvents = -1;
+        }
+        it->second.fWatched = true;
+#ifdef USE_EPOLL
+        if (it->second.nEvents != nEvents) {
+            it->second.nEvents = nEvents;
+            Register(hSocket, it->second);
+        }
+#else
+        it->second.nEvents = nEvents;
+#endif
+    }
+
+    /**
+     * Wait up to nTimeout milliseconds for watched sockets to become ready.
+     * Returns false on error, after which every socket should be tried.
+     */
+    bool Wait(int nTimeout, std::vector<std::pair<SOCKET, int> >& vReady)
+    {
+        vReady.clear();
+
+        // Forget sockets that are gone
+        for (std::map<SOCKET, CWatch>::iterator it = mapWatch.begin(); it != mapWatch.end(); ) {
+            if (it->second.fWatched) {
+                it->second.fWatched = false;
+                ++it;
+                continue;
+            }
+#ifdef USE_EPOLL
+            // Usually closed already, which unregisters it
+            if (it->second.fRegistered)
+                epoll_ctl(epollfd, EPOLL_CTL_DEL, it->first, NULL);
+#endif
+            mapWatch.erase(it++);
+        }
+
+#if defined(USE_EPOLL)
+        if (epollfd < 0) {
+            MilliSleep(nTimeout);
+            return false;
+        }
+        vEvents.resize(std::max<size_t>(mapWatch.size(), 1));
+        int nReady = epoll_wait(epollfd, &vEvents[0], vEvents.size(), nTimeout);
+        if (nReady < 0)
+            return WSAGetLastError() == WSAEINTR;
+        for (int i = 0; i < nReady; i++) {
+            int nEvents = 0;
+            if (vEvents[i].events & EPOLLIN)
+                nEvents |= SOCKET_EVENT_RECV;
+            if (vEvents[i].events & EPOLLOUT)
+                nEvents |= SOCKET_EVENT_SEND;
+            if (vEvents[i].events & (EPOLLERR | EPOLLHUP))
+                nEvents |= SOCKET_EVENT_ERROR;
+            vReady.push_back(std::make_pair((SOCKET)vEvents[i].data.u64, nEvents));
+        }
+        return true;
+#elif defined(USE_POLL)
+        std::vector<struct pollfd> vPollFds;
+        vPollFds.reserve(mapWatch.size());
+        for (std::map<SOCKET, CWatch>::const_iterator it = mapWatch.begin(); it != mapWatch.end(); ++it) {
+            struct pollfd pollfd;
+            pollfd.fd = it->first;
+            pollfd.events = ((it->second.nEvents & SOCKET_EVENT_RECV) ? POLLIN : 0) |
+                            ((it->second.nEvents & SOCKET_EVENT_SEND) ? POLLOUT : 0);
+            pollfd.revents = 0;
+            vPollFds.push_back(pollfd);
+        }
+        if (poll(vPollFds.empty() ? NULL : &vPollFds[0], vPollFds.size(), nTimeout) < 0)
+            return WSAGetLastError() == WSAEINTR;
+        for (size_t i = 0; i < vPollFds.size(); i++) {
+            int nEvents = 0;
+            if (vPollFds[i].revents & POLLIN)
+                nEvents |= SOCKET_EVENT_RECV;
+            if (vPollFds[i].revents & POLLOUT)
+                nEvents |= SOCKET_EVENT_SEND;
+            if (vPollFds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+                nEvents |= SOCKET_EVENT_ERROR;
+            if (nEvents)
+                vReady.push_back(std::make_pair((SOCKET)vPollFds[i].fd, nEvents));
+        }
+        return true;
+#else
+        struct timeval timeout;
+        timeout.tv_sec  = nTimeout / 1000;
+        timeout.tv_usec = (nTimeout % 1000) * 1000;
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        for (std::map<SOCKET, CWatch>::const_iterator it = mapWatch.begin(); it != mapWatch.end(); ++it) {
+            if (it->second.nEvents & SOCKET_EVENT_RECV)
+                FD_SET(it->first, &fdsetRecv);
+            if (it->second.nEvents & SOCKET_EVENT_SEND)
+                FD_SET(it->first, &fdsetSend);
+            FD_SET(it->first, &fdsetError);
+            hSocketMax = std::max(hSocketMax, it->first);
+        }
+
+        int nSelect = select(mapWatch.empty() ? 0 : hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR) {
+            if (mapWatch.empty())
+                MilliSleep(nTimeout);
+            return mapWatch.empty();
+        }
+        for (std::map<SOCKET, CWatch>::const_iterator it = mapWatch.begin(); it != mapWatch.end(); ++it) {
+            int nEvents = 0;
+            if (FD_ISSET(it->first, &fdsetRecv))
+                nEvents |= SOCKET_EVENT_RECV;
+            if (FD_ISSET(it->first, &fdsetSend))
+                nEvents |= SOCKET_EVENT_SEND;
+            if (FD_ISSET(it->first, &fdsetError))
+                nEvents |= SOCKET_EVENT_ERROR;
+            if (nEvents)
+                vReady.push_back(std::make_pair(it->first, nEvents));
+        }
+        return true;
+#endif
+    }
+
+    /** All watched sockets, marked as ready to receive. For use after Wait failed. */
+    void GetAll(std::vector<std::pair<SOCKET, int> >& vReady) const
+    {
+        vReady.clear();
+        for (std::map<SOCKET, CWatch>::const_iterator it = mapWatch.begin(); it != mapWatch.end(); ++it)
+            vReady.push_back(std::make_pair(it->first, (int)SOCKET_EVENT_RECV));
+    }
+};
+
+static void InactivityCheck(CNode* pnode, int64_t nTime)
+{
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    CSocketEvents socketEvents;
+    std::vector<std::pair<SOCKET, int> > vReady;
+    int64_t nLastInactivityCheck = 0;
     while (true)
     {
         //
@@ -1157,45 +1510,27 @@ void ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Find which sockets to wait for
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            socketEvents.Watch(hListenSocket.socket, -1, SOCKET_EVENT_RECV);
 
+        std::map<SOCKET, CNode*> mapSocketNode;
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodes)
             {
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
 
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
                 // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
+                //   or there is space left in the buffer, wait for receiving data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
                 // Together, that means that at least one of the following is always possible,
@@ -1203,72 +1538,71 @@ void ThreadSocketHandler()
                 // * We send some data.
                 // * We wait for data to be received (and disconnect after timeout).
                 // * We process a message in the buffer (message handler thread).
+                int nEvents = 0;
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        nEvents = SOCKET_EVENT_SEND;
                 }
-                {
+                if (!nEvents) {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                     if (lockRecv && (
                         pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
                         pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                        nEvents = SOCKET_EVENT_RECV;
                 }
+                socketEvents.Watch(pnode->hSocket, pnode->id, nEvents);
+                mapSocketNode[pnode->hSocket] = pnode;
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR)
+        // The timeout is the frequency to poll pnode->vSend
+        if (!socketEvents.Wait(50, vReady))
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
+            LogPrintf("socket wait error %s\n", NetworkErrorString(WSAGetLastError()));
+            socketEvents.GetAll(vReady);
+            MilliSleep(50);
         }
+        boost::this_thread::interruption_point();
 
         //
         // Accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        std::vector<std::pair<CNode*, int> > vNodesReady;
+        for (size_t i = 0; i < vReady.size(); i++)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            std::map<SOCKET, CNode*>::const_iterator it = mapSocketNode.find(vReady[i].first);
+            if (it != mapSocketNode.end()) {
+                vNodesReady.push_back(std::make_pair(it->second, vReady[i].second));
+                continue;
+            }
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
             {
-                AcceptConnection(hListenSocket);
+                if (hListenSocket.socket != INVALID_SOCKET && hListenSocket.socket == vReady[i].first)
+                    AcceptConnection(hListenSocket);
             }
         }
 
         //
-        // Service each socket
+        // Service each ready socket
         //
-        std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->AddRef();
+            for (size_t i = 0; i < vNodesReady.size(); i++)
+                vNodesReady[i].first->AddRef();
         }
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        for (size_t i = 0; i < vNodesReady.size(); i++)
         {
             boost::this_thread::interruption_point();
+            CNode* pnode = vNodesReady[i].first;
+            int nEvents = vNodesReady[i].second;
 
             //
             // Receive
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (nEvents & (SOCKET_EVENT_RECV | SOCKET_EVENT_ERROR))
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1312,45 +1646,32 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (nEvents & SOCKET_EVENT_SEND)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     SocketSendData(pnode);
             }
-
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
         }
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->Release();
+            for (size_t i = 0; i < vNodesReady.size(); i++)
+                vNodesReady[i].first->Release();
+        }
+
+        //
+        // Inactivity checking, which has a resolution of seconds
+        //
+        int64_t nTime = GetTime();
+        if (nTime != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = nTime;
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
+            {
+                if (pnode->hSocket != INVALID_SOCKET)
+                    InactivityCheck(pnode, nTime);
+            }
         }
     }
 }
@@ -1849,6 +2170,17 @@ bool OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSem
 }
 
 
+/** Number of passes over the nodes started by all message handler threads */
+static std::atomic<unsigned int> nMessageHandlerPasses(0);
+
+/**
+ * Message handler pool thread. Each pass walks all nodes and handles the
+ * ones no other handler thread is busy with, so that a peer whose messages
+ * are slow to process (a large getdata, or a block waiting for cs_main)
+ * holds up one thread rather than every other peer. Work that needs
+ * consensus state is serialized by cs_main inside ProcessMessages and
+ * SendMessages.
+ */
 void ThreadMessageHandler()
 {
     boost::mutex condition_mutex;
@@ -1867,11 +2199,19 @@ void ThreadMessageHandler()
 
         bool fSleep = true;
 
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        // Start each pass at a different node, so that the threads spread out
+        size_t nStart = vNodesCopy.empty() ? 0 : nMessageHandlerPasses++ % vNodesCopy.size();
+        for (size_t i = 0; i < vNodesCopy.size(); i++)
         {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            // Skip nodes another thread is working on
+            bool fExpected = false;
+            if (!pnode->fProcessing.compare_exchange_strong(fExpected, true))
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1889,7 +2229,6 @@ void ThreadMessageHandler()
                     }
                 }
             }
-            boost::this_thread::interruption_point();
 
             // Send messages
             {
@@ -1897,6 +2236,8 @@ void ThreadMessageHandler()
                 if (lockSend)
                     GetNodeSignals().SendMessages(pnode);
             }
+
+            pnode->fProcessing = false;
             boost::this_thread::interruption_point();
         }
 
@@ -2136,7 +2477,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlers", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    LogPrintf("Using %d message handler threads\n", nMessageHandlerThreads);
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -2199,14 +2543,50 @@ instance_of_cnetcleanup;
 
 void RelayTransaction(const CTransaction& tx)
 {
-    CInv inv(MSG_TX, tx.GetHash());
-    LOCK(cs_vNodes);
-    BOOST_FOREACH(CNode* pnode, vNodes)
-    {
-        pnode->PushInventory(inv);
+    txAnnounceQueue.Push(tx.GetHash());
+}
+
+void CTxAnnounceQueue::Push(const uint256& hash)
+{
+    LOCK(cs);
+    vPending.push_back(hash);
+}
+
+void CTxAnnounceQueue::TakePending(std::vector<uint256>& vHashes)
+{
+    LOCK(cs);
+    vHashes.swap(vPending);
+    vPending.clear();
+}
+
+void CTxAnnounceQueue::Append(const std::vector<Entry>& vEntries, int64_t nNow)
+{
+    LOCK(cs);
+    vQueue.insert(vQueue.end(), vEntries.begin(), vEntries.end());
+    while (!vQueue.empty() && (vQueue.size() > MAX_TX_ANNOUNCE_QUEUE || vQueue.front().nTime < nNow - TX_ANNOUNCE_EXPIRY)) {
+        vQueue.pop_front();
+        nQueueStart++;
     }
 }
 
+uint64_t CTxAnnounceQueue::End() const
+{
+    LOCK(cs);
+    return nQueueStart + vQueue.size();
+}
+
+void CTxAnnounceQueue::Read(uint64_t& nCursor, size_t nMax, std::vector<Entry>& vEntries) const
+{
+    LOCK(cs);
+    if (nCursor < nQueueStart)
+        nCursor = nQueueStart;
+    size_t nPos = nCursor - nQueueStart;
+    assert(nPos <= vQueue.size());
+    size_t nCount = std::min(nMax, vQueue.size() - nPos);
+    vEntries.insert(vEntries.end(), vQueue.begin() + nPos, vQueue.begin() + nPos + nCount);
+    nCursor += nCount;
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -2489,6 +2869,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fProcessing = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -2500,6 +2881,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
     nNextInvSend = 0;
+    nTxAnnounceCursor = txAnnounceQueue.End();
     fRelayTxes = false;
     fSentAddr = false;
     pfilter = new CBloomFilter();
@@ -2546,38 +2928,20 @@ CNode::~CNode()
     GetNodeSignals().FinalizeNode(GetId());
 }
 
-void CNode::AskFor(const CInv& inv)
+/** Set the size and checksum in the header of a serialized message. Returns the payload size. */
+static unsigned int FinishMessageHeader(CDataStream& ss)
 {
-    if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
-        return;
-    // a peer may not have multiple non-responded queue positions for a single inv item
-    if (!setAskFor.insert(inv.hash).second)
-        return;
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
 
-    // We're using mapAskFor as a priority queue,
-    // the key is the earliest time the request can be sent
-    int64_t nRequestTime;
-    limitedmap<uint256, int64_t>::const_iterator it = mapAlreadyAskedFor.find(inv.hash);
-    if (it != mapAlreadyAskedFor.end())
-        nRequestTime = it->second;
-    else
-        nRequestTime = 0;
-    LogPrint("net", "askfor %s  %d (%s) peer=%d\n", inv.ToString(), nRequestTime, DateTimeStrFormat("%H:%M:%S", nRequestTime/1000000), id);
-
-    // Make sure not to reuse time indexes to keep things in the same order
-    int64_t nNow = GetTimeMicros() - 1000000;
-    static int64_t nLastTime;
-    ++nLastTime;
-    nNow = std::max(nNow, nLastTime);
-    nLastTime = nNow;
-
-    // Each retry is 2 minutes after the last
-    nRequestTime = std::max(nRequestTime + 2 * 60 * 1000000, nNow);
-    if (it != mapAlreadyAskedFor.end())
-        mapAlreadyAskedFor.update(it, nRequestTime);
-    else
-        mapAlreadyAskedFor.insert(std::make_pair(inv.hash, nRequestTime));
-    mapAskFor.insert(std::make_pair(nRequestTime, inv));
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    return nSize;
 }
 
 void CNode::BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend)
@@ -2616,33 +2980,59 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+    unsigned int nSize = FinishMessageHeader(ssSend);
 
     //log total amount of bytes per command
     mapSendBytesPerMsgCmd[std::string(pszCommand)] += nSize + CMessageHeader::HEADER_SIZE;
 
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
-
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    // Move the buffer out of ssSend rather than copying it
+    std::shared_ptr<CSerializeData> pmsg = std::make_shared<CSerializeData>();
+    ssSend.swap(*pmsg);
+    nSendSize += pmsg->size();
+    vSendMsg.push_back(pmsg);
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSerializedMessage(const char* pszCommand, const CSerializeDataRef& msg)
+{
+    LOCK(cs_vSend);
+    if (mapArgs.count("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 2)) == 0)
+    {
+        LogPrint("net", "dropmessages DROPPING SEND MESSAGE\n");
+        return;
+    }
+
+    mapSendBytesPerMsgCmd[std::string(pszCommand)] += msg->size();
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", SanitizeString(pszCommand), msg->size() - CMessageHeader::HEADER_SIZE, id);
+
+    nSendSize += msg->size();
+    vSendMsg.push_back(msg);
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
+CNetMessageBuilder::CNetMessageBuilder(const char* pszCommand, int nVersion) : ss(SER_NETWORK, nVersion)
+{
+    ss << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+}
+
+CSerializeDataRef CNetMessageBuilder::Finish()
+{
+    FinishMessageHeader(ss);
+    std::shared_ptr<CSerializeData> pmsg = std::make_shared<CSerializeData>();
+    ss.swap(*pmsg);
+    return pmsg;
+}
+
 //
 // CBanDB
 //
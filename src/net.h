@@ -9,7 +9,7 @@
 #include "amount.h"
 #include "bloom.h"
 #include "compat.h"
-#include "limitedmap.h"
+#include "hash.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -19,6 +19,7 @@
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -59,10 +60,6 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
-/** The maximum number of entries in mapAskFor */
-static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
-/** The maximum number of entries in setAskFor (larger due to getdata latency)*/
-static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 /** The default for -maxuploadtarget. 0 = Unlimited */
@@ -73,6 +70,14 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of message handler threads (-msghandlers) */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** How long (in seconds) transaction announcements stay queued for peers that have not trickled yet */
+static const int64_t TX_ANNOUNCE_EXPIRY = 10 * 60;
+/** Maximum number of transaction announcements queued */
+static const size_t MAX_TX_ANNOUNCE_QUEUE = 100000;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -154,6 +159,52 @@ bool IsReachable(enum Network net);
 bool IsReachable(const CNetAddr &addr);
 CAddress GetLocalAddress(const CNetAddr *paddrPeer = NULL);
 
+/**
+ * Transaction announcements, shared by all peers. Relayed transactions are
+ * collected as pending; at the next trickle they are put in mempool order
+ * once and appended to the queue. Every peer keeps a cursor into the queue,
+ * so a trickle costs a peer only the announcements it has not walked past
+ * yet, rather than a sort of everything it has to announce.
+ */
+class CTxAnnounceQueue
+{
+public:
+    struct Entry
+    {
+        uint256 hash;
+        CAmount nFeePerK; //!< Fee rate when queued, for peers' fee filters
+        int64_t nTime;    //!< Time when queued
+    };
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<uint256> vPending;
+    std::deque<Entry> vQueue;
+    uint64_t nQueueStart; //!< Position of the front of vQueue
+
+public:
+    CTxAnnounceQueue() : nQueueStart(0) {}
+
+    /** Add a relayed transaction, to be ordered and appended by the next trickle */
+    void Push(const uint256& hash);
+
+    /** Take the transactions pushed since the last call */
+    void TakePending(std::vector<uint256>& vHashes);
+
+    /** Append ordered entries, dropping expired ones from the front */
+    void Append(const std::vector<Entry>& vEntries, int64_t nNow);
+
+    /** Position just past the last queued entry */
+    uint64_t End() const;
+
+    /**
+     * Read up to nMax entries at nCursor and move the cursor past them. A
+     * cursor that has fallen behind the expired entries continues at the
+     * front of the queue.
+     */
+    void Read(uint64_t& nCursor, size_t nMax, std::vector<Entry>& vEntries) const;
+};
+
 
 extern bool fDiscover;
 extern bool fListen;
@@ -168,7 +219,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
+extern CTxAnnounceQueue txAnnounceQueue;
 
 extern std::vector<std::string> vAddedNodes;
 extern CCriticalSection cs_vAddedNodes;
@@ -218,6 +269,10 @@ public:
 
 
 class CNetMessage {
+private:
+    CHash256 hasher;                // hash of the data received so far
+    uint256 hashData;               // hash of the complete message data
+
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
@@ -238,6 +293,8 @@ public:
         nTime = 0;
     }
 
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -245,6 +302,13 @@ public:
         return (hdr.nMessageSize == nDataPos);
     }
 
+    /** Double-SHA256 of the message data, hashed as it arrived. Only valid once complete. */
+    const uint256& GetMessageHash() const
+    {
+        assert(complete());
+        return hashData;
+    }
+
     void SetVersion(int nVersionIn)
     {
         hdrbuf.SetVersion(nVersionIn);
@@ -255,6 +319,33 @@ public:
     int readData(const char *pch, unsigned int nBytes);
 };
 
+/** A complete serialized message, shared by every send queue it is pushed to */
+typedef std::shared_ptr<const CSerializeData> CSerializeDataRef;
+
+/**
+ * Serializes a message once so that the same buffer can be queued to any
+ * number of peers with CNode::PushSerializedMessage, instead of being
+ * serialized into each peer's ssSend.
+ */
+class CNetMessageBuilder
+{
+private:
+    CDataStream ss;
+
+public:
+    CNetMessageBuilder(const char* pszCommand, int nVersion);
+
+    template<typename T>
+    CNetMessageBuilder& operator<<(const T& obj)
+    {
+        ss << obj;
+        return *this;
+    }
+
+    /** Set the size and checksum in the header and hand out the message */
+    CSerializeDataRef Finish();
+};
+
 
 typedef enum BanReason
 {
@@ -329,7 +420,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializeDataRef> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -359,6 +450,9 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    // Set while a message handler thread works on this node, so that its
+    // messages are processed and sent by one thread at a time
+    std::atomic<bool> fProcessing;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in its version message that we should not relay tx invs
@@ -396,6 +490,7 @@ public:
     int nStartingHeight;
 
     // flood relay
+    CCriticalSection cs_vAddrToSend; // protects vAddrToSend and addrKnown
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -405,16 +500,13 @@ public:
 
     // inventory based relay
     CRollingBloomFilter filterInventoryKnown;
-    // Set of transaction ids we still have to announce.
-    // They are sorted by the mempool before relay, so the order is not important.
-    std::set<uint256> setInventoryTxToSend;
+    // Position in txAnnounceQueue of the next transaction to consider announcing
+    uint64_t nTxAnnounceCursor;
     // List of block ids we still have announce.
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
     std::vector<uint256> vInventoryBlockToSend;
     CCriticalSection cs_inventory;
-    std::set<uint256> setAskFor;
-    std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
     // Used for headers announcements - unfiltered blocks to relay
     // Also protected by cs_inventory
@@ -514,6 +606,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(addr.GetKey());
     }
 
@@ -522,6 +615,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_vAddrToSend);
         if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
@@ -542,12 +636,9 @@ public:
 
     void PushInventory(const CInv& inv)
     {
+        // Transactions are announced to all peers through txAnnounceQueue
         LOCK(cs_inventory);
-        if (inv.type == MSG_TX) {
-            if (!filterInventoryKnown.contains(inv.hash)) {
-                setInventoryTxToSend.insert(inv.hash);
-            }
-        } else if (inv.type == MSG_BLOCK) {
+        if (inv.type == MSG_BLOCK) {
             vInventoryBlockToSend.push_back(inv.hash);
         }
     }
@@ -558,8 +649,6 @@ public:
         vBlockHashesToAnnounce.push_back(hash);
     }
 
-    void AskFor(const CInv& inv);
-
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
     void BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend);
 
@@ -569,6 +658,9 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend);
 
+    /** Queue a message serialized with CNetMessageBuilder, without copying it */
+    void PushSerializedMessage(const char* pszCommand, const CSerializeDataRef& msg);
+
     void PushVersion();
 
 
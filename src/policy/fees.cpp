@@ -36,6 +36,13 @@ void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
     txCtAvg.resize(buckets.size());
     curBlockVal.resize(buckets.size());
     avg.resize(buckets.size());
+
+    unconfAtLeast.resize(maxConfirms);
+    for (unsigned int i = 0; i < maxConfirms; i++)
+        unconfAtLeast[i].resize(buckets.size());
+    fUnconfSumsValid = false;
+    medianCache.resize(maxConfirms);
+    ClearMedianCache();
 }
 
 // Zero out the data for the current block
@@ -49,6 +56,45 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
         curBlockTxCt[j] = 0;
         curBlockVal[j] = 0;
     }
+    fUnconfSumsValid = false;
+    ClearMedianCache();
+}
+
+void TxConfirmStats::UpdateUnconfSums(unsigned int nBlockHeight)
+{
+    nUnconfSumsHeight = nBlockHeight;
+    fUnconfSumsValid = true;
+    for (unsigned int j = 0; j < buckets.size(); j++)
+        UpdateUnconfSumsForBucket(j);
+    ClearMedianCache();
+}
+
+bool TxConfirmStats::UpdateUnconfSumsForBucket(unsigned int bucketindex)
+{
+    bool fChanged = false;
+    int nSum = oldUnconfTxs[bucketindex];
+    for (int confct = GetMaxConfirms(); confct >= 1; confct--) {
+        if (confct < (int)GetMaxConfirms())
+            nSum += unconfTxs[UnconfSlot(nUnconfSumsHeight, confct)][bucketindex];
+        if (unconfAtLeast[confct - 1][bucketindex] != nSum) {
+            unconfAtLeast[confct - 1][bucketindex] = nSum;
+            fChanged = true;
+        }
+    }
+    return fChanged;
+}
+
+void TxConfirmStats::UnconfTxsChanged(unsigned int bucketindex)
+{
+    // A transaction that entered the mempool at the height of the sums counts
+    // against no target, so new transactions usually leave the results valid
+    if (fUnconfSumsValid && UpdateUnconfSumsForBucket(bucketindex))
+        ClearMedianCache();
+}
+
+void TxConfirmStats::ClearMedianCache()
+{
+    medianCached.assign(medianCache.size(), false);
 }
 
 
@@ -58,9 +104,8 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
-    }
+    if ((size_t)blocksToConfirm <= curBlockConf.size())
+        curBlockConf[blocksToConfirm - 1][bucketindex]++;
     curBlockTxCt[bucketindex]++;
     curBlockVal[bucketindex] += val;
 }
@@ -68,11 +113,16 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 void TxConfirmStats::UpdateMovingAverages()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
+        // A tx confirmed in Y blocks counts as confirmed within Y or more
+        int nConfirmedWithin = 0;
+        for (unsigned int i = 0; i < confAvg.size(); i++) {
+            nConfirmedWithin += curBlockConf[i][j];
+            confAvg[i][j] = confAvg[i][j] * decay + nConfirmedWithin;
+        }
         avg[j] = avg[j] * decay + curBlockVal[j];
         txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
     }
+    ClearMedianCache();
 }
 
 // returns -1 on error conditions
@@ -80,6 +130,17 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
                                          unsigned int nBlockHeight)
 {
+    if (!fUnconfSumsValid || nUnconfSumsHeight != nBlockHeight)
+        UpdateUnconfSums(nBlockHeight);
+    if (sufficientTxVal != cacheSufficientTxVal || successBreakPoint != cacheSuccessBreakPoint || requireGreater != cacheRequireGreater) {
+        ClearMedianCache();
+        cacheSufficientTxVal = sufficientTxVal;
+        cacheSuccessBreakPoint = successBreakPoint;
+        cacheRequireGreater = requireGreater;
+    }
+    if (medianCached[confTarget - 1])
+        return medianCache[confTarget - 1];
+
     // Counters for a bucket (or range of buckets)
     double nConf = 0; // Number of tx's confirmed within the confTarget
     double totalNum = 0; // Total number of tx's that were ever confirmed
@@ -105,16 +166,13 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
 
     // Start counting from highest(default) or lowest fee/pri transactions
     for (int bucket = startbucket; bucket >= 0 && bucket <= maxbucketindex; bucket += step) {
         curFarBucket = bucket;
         nConf += confAvg[confTarget - 1][bucket];
         totalNum += txCtAvg[bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
-        extraNum += oldUnconfTxs[bucket];
+        extraNum += unconfAtLeast[confTarget - 1][bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
         // (Only count the confirmed data points, so that each confirmation count
@@ -171,6 +229,8 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
              requireGreater ? ">" : "<", median, buckets[minBucket], buckets[maxBucket],
              100 * nConf / (totalNum + extraNum), nConf, totalNum, extraNum);
 
+    medianCache[confTarget - 1] = median;
+    medianCached[confTarget - 1] = true;
     return median;
 }
 
@@ -239,6 +299,13 @@ void TxConfirmStats::Read(CAutoFile& filein)
     }
     oldUnconfTxs.resize(buckets.size());
 
+    unconfAtLeast.resize(maxConfirms);
+    for (unsigned int i = 0; i < maxConfirms; i++)
+        unconfAtLeast[i].resize(buckets.size());
+    fUnconfSumsValid = false;
+    medianCache.resize(maxConfirms);
+    ClearMedianCache();
+
     for (unsigned int i = 0; i < buckets.size(); i++)
         bucketMap[buckets[i]] = i;
 
@@ -251,6 +318,7 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
+    UnconfTxsChanged(bucketindex);
     LogPrint("estimatefee", "adding to %s", dataTypeString);
     return bucketindex;
 }
@@ -267,19 +335,23 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     }
 
     if (blocksAgo >= (int)unconfTxs.size()) {
-        if (oldUnconfTxs[bucketindex] > 0)
+        if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
-        else
+            UnconfTxsChanged(bucketindex);
+        } else {
             LogPrint("estimatefee", "Blockpolicy error, mempool tx removed from >25 blocks,bucketIndex=%u already\n",
                      bucketindex);
+        }
     }
     else {
         unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0)
+        if (unconfTxs[blockIndex][bucketindex] > 0) {
             unconfTxs[blockIndex][bucketindex]--;
-        else
+            UnconfTxsChanged(bucketindex);
+        } else {
             LogPrint("estimatefee", "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
+        }
     }
 }
 
@@ -347,7 +419,8 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
 {
     unsigned int txHeight = entry.GetHeight();
     uint256 hash = entry.GetTx().GetHash();
-    if (mapMemPoolTxs[hash].stats != NULL) {
+    TxStatsInfo& statsInfo = mapMemPoolTxs[hash];
+    if (statsInfo.stats != NULL) {
         LogPrint("estimatefee", "Blockpolicy error mempool tx %s already being tracked\n",
                  hash.ToString().c_str());
 	return;
@@ -378,18 +451,18 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     // what that will be and its too hard to continue updating it
     // so use starting priority as a proxy
     double curPri = entry.GetPriority(txHeight);
-    mapMemPoolTxs[hash].blockHeight = txHeight;
+    statsInfo.blockHeight = txHeight;
 
     LogPrint("estimatefee", "Blockpolicy mempool tx %s ", hash.ToString().substr(0,10));
     // Record this as a priority estimate
     if (entry.GetFee() == 0 || isPriDataPoint(feeRate, curPri)) {
-        mapMemPoolTxs[hash].stats = &priStats;
-        mapMemPoolTxs[hash].bucketIndex =  priStats.NewTx(txHeight, curPri);
+        statsInfo.stats = &priStats;
+        statsInfo.bucketIndex = priStats.NewTx(txHeight, curPri);
     }
     // Record this as a fee estimate
     else if (isFeeDataPoint(feeRate, curPri)) {
-        mapMemPoolTxs[hash].stats = &feeStats;
-        mapMemPoolTxs[hash].bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
+        statsInfo.stats = &feeStats;
+        statsInfo.bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
     }
     else {
         LogPrint("estimatefee", "not adding");
@@ -93,7 +93,8 @@ private:
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calculate the totals for the current block to update the moving averages
+    // and count the txs confirmed in exactly Y blocks in the current block, which
+    // are summed up into the totals when the moving averages are updated
     std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total priority/fee of all tx's in each bucket
@@ -115,7 +116,36 @@ private:
     // transactions still unconfirmed after MAX_CONFIRMS for each bucket
     std::vector<int> oldUnconfTxs;
 
+    // For each target Y and bucket X, the number of mempool transactions that
+    // count against confirming within Y blocks at height nUnconfSumsHeight:
+    // those unconfirmed for Y blocks or more, including oldUnconfTxs. Kept up
+    // to date as transactions come and go, and rebuilt when the height changes.
+    std::vector<std::vector<int> > unconfAtLeast; // unconfAtLeast[Y-1][X], Y from 1 to MAX_CONFIRMS
+    unsigned int nUnconfSumsHeight;
+    bool fUnconfSumsValid;
+
+    // Results of EstimateMedianVal for each target, for the last arguments it
+    // was called with, until the data they were calculated from changes
+    std::vector<double> medianCache;
+    std::vector<bool> medianCached;
+    double cacheSufficientTxVal;
+    double cacheSuccessBreakPoint;
+    bool cacheRequireGreater;
+
+    /** The unconfTxs slot counted against confirming within confct blocks at nBlockHeight */
+    unsigned int UnconfSlot(unsigned int nBlockHeight, unsigned int confct) const { return (nBlockHeight - confct) % unconfTxs.size(); }
+    /** Make unconfAtLeast match the mempool counts at nBlockHeight */
+    void UpdateUnconfSums(unsigned int nBlockHeight);
+    /** Recompute the sums of one bucket after its mempool counts changed. Returns whether any sum changed. */
+    bool UpdateUnconfSumsForBucket(unsigned int bucketIndex);
+    /** Keep the sums current after the mempool counts of bucketIndex changed */
+    void UnconfTxsChanged(unsigned int bucketIndex);
+    /** Forget all results of EstimateMedianVal */
+    void ClearMedianCache();
+
 public:
+    TxConfirmStats() : nUnconfSumsHeight(0), fUnconfSumsValid(false), cacheSufficientTxVal(0), cacheSuccessBreakPoint(0), cacheRequireGreater(false) {}
+
     /**
      * Initialize the data structures.  This is called by BlockPolicyEstimator's
      * constructor with default values.
@@ -158,10 +188,15 @@ public:
      * @param requireGreater return the lowest fee/pri such that all higher values pass minSuccess OR
      *        return the highest fee/pri such that all lower values fail minSuccess
      * @param nBlockHeight the current block height
+     * Results are cached until the data they depend on changes, so asking
+     * for every target between two blocks costs one scan of the buckets each.
      */
     double EstimateMedianVal(int confTarget, double sufficientTxVal,
                              double minSuccess, bool requireGreater, unsigned int nBlockHeight);
 
+    /** Whether the result of EstimateMedianVal for confTarget is cached */
+    bool IsEstimateCached(int confTarget) const { return medianCached[confTarget - 1]; }
+
     /** Return the max number of confirms we're tracking */
     unsigned int GetMaxConfirms() { return confAvg.size(); }
 
@@ -243,6 +278,9 @@ public:
     /** Return a fee estimate */
     CFeeRate estimateFee(int confTarget);
 
+    /** Whether the fee estimate for confTarget is cached (for testing) */
+    bool IsFeeEstimateCached(int confTarget) const { return feeStats.IsEstimateCached(confTarget); }
+
     /** Estimate fee rate needed to get be included in a block within
      *  confTarget blocks. If no answer can be given at confTarget, return an
      *  estimate at the lowest target where one can be given.
@@ -246,6 +246,38 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * getcfilters requests the compact filters of a range of blocks, given by
+ * a filter type, start height and stop hash.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by BIP 157.
+ */
+extern const char *GETCFILTERS;
+/**
+ * cfilter is a response to a getcfilters request containing a single
+ * compact filter.
+ */
+extern const char *CFILTER;
+/**
+ * getcfheaders requests the compact filter headers of a range of blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by BIP 157.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * cfheaders is a response to a getcfheaders request containing the filter
+ * header of the block before the range and the filter hashes of the range.
+ */
+extern const char *CFHEADERS;
+/**
+ * getcfcheckpt requests the filter headers at evenly spaced intervals up
+ * to a stop hash.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by BIP 157.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * cfcheckpt is a response to a getcfcheckpt request containing the filter
+ * headers of every CFCHECKPT_INTERVAL-th block.
+ */
+extern const char *CFCHECKPT;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -270,6 +302,9 @@ enum ServiceFlags : uint64_t {
     // Indicates that a node can be asked for blocks and transactions including
     // witness data.
     NODE_WITNESS = (1 << 3),
+    // NODE_COMPACT_FILTERS means the node will serve basic compact block filters
+    // and their headers (BIP 157 and 158).
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
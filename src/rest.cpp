@@ -7,7 +7,11 @@
 #include "chainparams.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "index/addressindex.h"
+#include "index/blockfilterindex.h"
+#include "index/spentindex.h"
 #include "main.h"
+#include "httprpc.h"
 #include "httpserver.h"
 #include "rpc/server.h"
 #include "streams.h"
@@ -16,6 +20,8 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/dynamic_bitset.hpp>
 
@@ -24,6 +30,10 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_BLOCKS_RANGE = 10000; //max number of blocks streamed by one /rest/blocks request
+static const long MAX_REST_HEADERS_RANGE = 200000; //max number of headers streamed by one /rest/headersbyheight request
+static const size_t REST_STREAM_CHUNK_SIZE = 256 * 1024; //size of the chunks streamed replies are sent in
+static const int REST_STREAM_BATCH = 1000; //number of blocks or headers looked up at a time while streaming
 
 enum RetFormat {
     RF_UNDEF,
@@ -58,12 +68,36 @@ struct CCoin {
     }
 };
 
+struct CTxSubmitResultEntry {
+    uint256 hash;
+    uint8_t nStatus; // CTxSubmitResult::Status
+    int32_t nRejectCode;
+    std::string strRejectReason;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hash);
+        READWRITE(nStatus);
+        READWRITE(nRejectCode);
+        READWRITE(LIMITED_STRING(strRejectReason, MAX_REJECT_MESSAGE_LENGTH));
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void blockToJSONStream(CJSONWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void mempoolToJSONStream(CJSONWriter& writer, bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern bool DecodeIndexedScript(const std::string& str, CScript& script);
+extern bool DecodeAddressIndexCursor(const std::string& str, CAddressIndexKey& key);
+extern UniValue addressDeltasToJSON(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vEntries, bool fMore, const CAddressIndexKey& keyNext);
+extern UniValue spentInfoToJSON(const CSpentIndexValue& value);
+extern UniValue blockFilterToJSON(const CBlockFilter& filter, const uint256& hashHeader);
+extern UniValue txSubmitResultsToJSON(const std::vector<CTxSubmitResult>& vResults);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, string message)
 {
@@ -200,6 +234,212 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/** Parse "<start height>/<count>" and find the last block of the range in the active chain */
+static bool ParseHeightRange(HTTPRequest* req, const std::string& param, const std::string& strUsage, long nMaxCount,
+                             int& nStartHeight, const CBlockIndex*& pindexStop)
+{
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use " + strUsage + ".");
+
+    int32_t nCount;
+    if (!ParseInt32(path[0], &nStartHeight) || nStartHeight < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[0]);
+    if (!ParseInt32(path[1], &nCount) || nCount < 1 || nCount > nMaxCount)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + path[1]);
+
+    LOCK(cs_main);
+    if (nStartHeight > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+    // Walking back from a fixed stop block keeps the range consistent if the chain reorganizes meanwhile
+    pindexStop = chainActive[(int)std::min((int64_t)nStartHeight + nCount - 1, (int64_t)chainActive.Height())];
+    return true;
+}
+
+/** Send the buffered bytes of a streamed reply as one chunk. Returns false if the client went away. */
+static bool WriteStreamChunk(HTTPRequest* req, RetFormat rf, std::vector<unsigned char>& vchBuffer)
+{
+    bool ret;
+    if (rf == RF_HEX) {
+        string strHex = HexStr(vchBuffer.begin(), vchBuffer.end());
+        ret = req->WriteReplyChunk(strHex.data(), strHex.size());
+    } else {
+        ret = req->WriteReplyChunk((const char*)vchBuffer.data(), vchBuffer.size());
+    }
+    vchBuffer.clear();
+    return ret;
+}
+
+static bool rest_blockhash_by_height(HTTPRequest* req,
+                                     const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string heightStr;
+    const RetFormat rf = ParseDataFormat(heightStr, strURIPart);
+
+    int32_t nHeight;
+    if (!ParseInt32(heightStr, &nHeight) || nHeight < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + heightStr);
+
+    uint256 hash;
+    {
+        LOCK(cs_main);
+        if (nHeight > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+        hash = chainActive[nHeight]->GetBlockHash();
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssHash(SER_NETWORK, PROTOCOL_VERSION);
+        ssHash << hash;
+        string binaryHash = ssHash.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHash);
+        return true;
+    }
+
+    case RF_HEX: {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, hash.GetHex() + "\n");
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue objHash(UniValue::VOBJ);
+        objHash.push_back(Pair("blockhash", hash.GetHex()));
+        string strJSON = objHash.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blocks(HTTPRequest* req,
+                        const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    int nStartHeight;
+    const CBlockIndex* pindexStop;
+    if (!ParseHeightRange(req, param, "/rest/blocks/<start height>/<count>.<ext>", MAX_REST_BLOCKS_RANGE, nStartHeight, pindexStop))
+        return false;
+
+    {
+        LOCK(cs_main);
+        if (fHavePruned && !(pindexStop->GetAncestor(nStartHeight)->nStatus & BLOCK_HAVE_DATA))
+            return RESTERR(req, HTTP_NOT_FOUND, "Blocks not available (pruned data)");
+    }
+
+    // Stream the blocks as stored in the block files, without deserializing them
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+
+    std::vector<unsigned char> vchBuffer;
+    std::vector<CDiskBlockPos> vPos;
+    bool fOk = true;       //!< The client is still there
+    bool fComplete = true; //!< All blocks of the range could be read
+    for (int nHeight = nStartHeight; fOk && fComplete && nHeight <= pindexStop->nHeight; nHeight += vPos.size()) {
+        vPos.clear();
+        {
+            LOCK(cs_main);
+            int nBatchEnd = std::min(nHeight + REST_STREAM_BATCH - 1, pindexStop->nHeight);
+            for (const CBlockIndex* pindex = pindexStop->GetAncestor(nBatchEnd); pindex && pindex->nHeight >= nHeight; pindex = pindex->pprev) {
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                    // Pruned since the request started
+                    vPos.clear();
+                    break;
+                }
+                vPos.push_back(pindex->GetBlockPos());
+            }
+            std::reverse(vPos.begin(), vPos.end());
+        }
+        if (vPos.empty()) {
+            fComplete = false;
+            break;
+        }
+
+        BOOST_FOREACH(const CDiskBlockPos& pos, vPos) {
+            if (!ReadRawBlockFromDisk(vchBuffer, pos, Params().MessageStart())) {
+                fComplete = false;
+                break;
+            }
+            if (vchBuffer.size() >= REST_STREAM_CHUNK_SIZE && !WriteStreamChunk(req, rf, vchBuffer)) {
+                fOk = false;
+                break;
+            }
+        }
+    }
+    if (!fComplete) {
+        // Do not end the reply normally, so the client does not take what it
+        // got for the whole range
+        req->WriteReplyAbort();
+        return true;
+    }
+    if (fOk && !vchBuffer.empty())
+        fOk = WriteStreamChunk(req, rf, vchBuffer);
+    if (fOk && rf == RF_HEX)
+        req->WriteReplyChunk("\n", 1);
+    req->WriteReplyEnd();
+    return true;
+}
+
+static bool rest_headers_by_height(HTTPRequest* req,
+                                   const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    int nStartHeight;
+    const CBlockIndex* pindexStop;
+    if (!ParseHeightRange(req, param, "/rest/headersbyheight/<start height>/<count>.<ext>", MAX_REST_HEADERS_RANGE, nStartHeight, pindexStop))
+        return false;
+
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+
+    // Headers come from the block index in memory, which does not change for
+    // blocks that are already in it
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    std::vector<unsigned char> vchBuffer;
+    bool fOk = true;
+    for (int nHeight = nStartHeight; fOk && nHeight <= pindexStop->nHeight; ) {
+        int nBatchEnd = std::min(nHeight + REST_STREAM_BATCH - 1, pindexStop->nHeight);
+        std::vector<const CBlockIndex*> vBlocks;
+        for (const CBlockIndex* pindex = pindexStop->GetAncestor(nBatchEnd); pindex && pindex->nHeight >= nHeight; pindex = pindex->pprev)
+            vBlocks.push_back(pindex);
+        for (int i = vBlocks.size() - 1; i >= 0; i--)
+            ssHeader << vBlocks[i]->GetBlockHeader();
+        vchBuffer.assign(ssHeader.begin(), ssHeader.end());
+        ssHeader.clear();
+        fOk = WriteStreamChunk(req, rf, vchBuffer);
+        nHeight = nBatchEnd + 1;
+    }
+    if (fOk && rf == RF_HEX)
+        req->WriteReplyChunk("\n", 1);
+    req->WriteReplyEnd();
+    return true;
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -247,10 +487,9 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPJSONWriter writer(req);
+        blockToJSONStream(writer, block, pblockindex, showTxDetails);
+        writer.Finish();
         return true;
     }
 
@@ -335,11 +574,9 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPJSONWriter writer(req);
+        mempoolToJSONStream(writer, true);
+        writer.Finish();
         return true;
     }
     default: {
@@ -403,6 +640,286 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_addressdeltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() < 2 || path.size() > 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/addressdeltas/<count>/<address or script>[/<cursor>].<ext>.");
+
+    if (!paddressindex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled (use -addressindex)");
+
+    long nCount = strtol(path[0].c_str(), NULL, 10);
+    if (nCount < 1 || (unsigned long)nCount > MAX_ADDRESSINDEX_RESULTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Entry count out of range: %s", path[0]));
+
+    CScript script;
+    if (!DecodeIndexedScript(path[1], script))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address or script: " + path[1]);
+
+    CAddressIndexKey keyStart;
+    keyStart.hashScript = GetScriptHash(script);
+    if (path.size() == 3) {
+        CAddressIndexKey keyCursor;
+        if (!DecodeAddressIndexCursor(path[2], keyCursor) || keyCursor.hashScript != keyStart.hashScript)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[2]);
+        keyStart = keyCursor;
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    bool fMore;
+    CAddressIndexKey keyNext;
+    if (!paddressindex->FindEntries(keyStart, nCount, vEntries, fMore, keyNext))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Unable to read address index");
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssDeltas(SER_NETWORK, PROTOCOL_VERSION);
+        ssDeltas << vEntries << fMore;
+        if (fMore)
+            ssDeltas << keyNext;
+
+        if (rf == RF_BINARY) {
+            string binaryDeltas = ssDeltas.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binaryDeltas);
+        } else {
+            string strHex = HexStr(ssDeltas.begin(), ssDeltas.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON = addressDeltasToJSON(vEntries, fMore, keyNext).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_spent(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    if (!pspentindex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled (use -spentindex)");
+
+    size_t pos = param.find('-');
+    uint256 txid;
+    if (pos == std::string::npos || !ParseHashStr(param.substr(0, pos), txid))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/spent/<txid>-<n>.<ext>.");
+    int32_t nOutput;
+    if (!ParseInt32(param.substr(pos + 1), &nOutput) || nOutput < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid output number: " + param.substr(pos + 1));
+
+    CSpentIndexValue value;
+    if (!pspentindex->FindSpender(COutPoint(txid, nOutput), value))
+        return RESTERR(req, HTTP_NOT_FOUND, param + " not spent");
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssSpent(SER_NETWORK, PROTOCOL_VERSION);
+        ssSpent << value;
+
+        if (rf == RF_BINARY) {
+            string binarySpent = ssSpent.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binarySpent);
+        } else {
+            string strHex = HexStr(ssSpent.begin(), ssSpent.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON = spentInfoToJSON(value).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockfilter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!pblockfilterindex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Block filter index not enabled (use -blockfilterindex)");
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        pindex = it->second;
+    }
+
+    CBlockFilter filter;
+    uint256 hashHeader;
+    if (!pblockfilterindex->LookupFilter(pindex, filter) || !pblockfilterindex->LookupFilterHeader(pindex, hashHeader))
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter of " + hashStr + " not found");
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssFilter(SER_NETWORK, PROTOCOL_VERSION);
+        ssFilter << filter << hashHeader;
+
+        if (rf == RF_BINARY) {
+            string binaryFilter = ssFilter.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binaryFilter);
+        } else {
+            string strHex = HexStr(ssFilter.begin(), ssFilter.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON = blockFilterToJSON(filter, hashHeader).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockfilterheaders(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/blockfilterheaders/<count>/<hash>.<ext>.");
+
+    if (!pblockfilterindex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Block filter index not enabled (use -blockfilterindex)");
+
+    long count = strtol(path[0].c_str(), NULL, 10);
+    if (count < 1 || count > (long)MAX_GETCFHEADERS_SIZE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
+
+    string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    std::vector<const CBlockIndex *> blocks;
+    blocks.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex *pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            blocks.push_back(pindex);
+            if (blocks.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    std::vector<uint256> vHeaders(blocks.size());
+    for (unsigned int i = 0; i < blocks.size(); i++) {
+        if (!pblockfilterindex->LookupFilterHeader(blocks[i], vHeaders[i])) {
+            // Not indexed yet: return the headers up to here
+            vHeaders.resize(i);
+            break;
+        }
+    }
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH(const uint256& hashHeader, vHeaders) {
+        ssHeader << hashHeader;
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        for (unsigned int i = 0; i < vHeaders.size(); i++) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("blockhash", blocks[i]->GetBlockHash().GetHex()));
+            entry.push_back(Pair("header", vHeaders[i].GetHex()));
+            jsonHeaders.push_back(entry);
+        }
+        string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -599,6 +1116,94 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_sendtxs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "Invalid URI format. Expected /rest/sendtxs.<ext>");
+
+    std::string strRequest = req->ReadBody();
+    if (strRequest.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Error: empty request");
+
+    // Each transaction is sent as its own byte vector, so they can be
+    // decoded in parallel without parsing the ones before
+    std::vector<std::vector<unsigned char> > vRawTx;
+    switch (rf) {
+    case RF_HEX: {
+        std::vector<unsigned char> vRequest = ParseHex(strRequest);
+        strRequest.assign(vRequest.begin(), vRequest.end());
+    }
+
+    case RF_BINARY: {
+        try {
+            CDataStream ssRequest(strRequest.data(), strRequest.data() + strRequest.size(), SER_NETWORK, PROTOCOL_VERSION);
+            ssRequest >> vRawTx;
+        } catch (const std::ios_base::failure& e) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        }
+        break;
+    }
+
+    case RF_JSON: {
+        UniValue txs;
+        if (!txs.read(strRequest) || !txs.isArray())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Error: expected a JSON array of hex strings");
+        vRawTx.resize(txs.size());
+        for (size_t i = 0; i < txs.size(); i++) {
+            if (!txs[i].isStr())
+                return RESTERR(req, HTTP_BAD_REQUEST, "Error: expected a JSON array of hex strings");
+            if (IsHex(txs[i].get_str()))
+                vRawTx[i] = ParseHex(txs[i].get_str());
+        }
+        break;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    if (vRawTx.size() > MAX_SUBMIT_TRANSACTIONS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max transactions exceeded (max: %d, tried: %d)", MAX_SUBMIT_TRANSACTIONS, vRawTx.size()));
+
+    std::vector<CTxSubmitResult> vResults;
+    SubmitTransactions(vRawTx, maxTxFee, vResults);
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        std::vector<CTxSubmitResultEntry> vEntries(vResults.size());
+        for (size_t i = 0; i < vResults.size(); i++) {
+            vEntries[i].hash = vResults[i].hash;
+            vEntries[i].nStatus = vResults[i].status;
+            vEntries[i].nRejectCode = vResults[i].nRejectCode;
+            vEntries[i].strRejectReason = vResults[i].strRejectReason;
+        }
+        CDataStream ssResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssResponse << vEntries;
+
+        if (rf == RF_BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssResponse.str());
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(ssResponse.begin(), ssResponse.end()) + "\n");
+        }
+        return true;
+    }
+
+    default: {
+        string strJSON = txSubmitResultsToJSON(vResults).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    }
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -610,7 +1215,15 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/headersbyheight/", rest_headers_by_height},
+      {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/blocks/", rest_blocks},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/sendtxs", rest_sendtxs},
+      {"/rest/addressdeltas/", rest_addressdeltas},
+      {"/rest/spent/", rest_spent},
+      {"/rest/blockfilter/", rest_blockfilter},
+      {"/rest/blockfilterheaders/", rest_blockfilterheaders},
 };
 
 bool StartREST()
@@ -4,15 +4,21 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "index/addressindex.h"
+#include "index/blockfilterindex.h"
+#include "index/spentindex.h"
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
+#include "script/standard.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -90,7 +96,8 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** Fields of blockToJSON before the transaction list */
+static UniValue blockHeadToJSON(const CBlock& block, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
@@ -106,6 +113,31 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+    return result;
+}
+
+/** Fields of blockToJSON after the transaction list */
+static UniValue blockTailToJSON(const CBlock& block, const CBlockIndex* blockindex)
+{
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("time", block.GetBlockTime()));
+    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+
+    if (blockindex->pprev)
+        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+    CBlockIndex *pnext = chainActive.Next(blockindex);
+    if (pnext)
+        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+    return result;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result = blockHeadToJSON(block, blockindex);
     UniValue txs(UniValue::VARR);
     BOOST_FOREACH(const CTransaction&tx, block.vtx)
     {
@@ -119,21 +151,45 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
             txs.push_back(tx.GetHash().GetHex());
     }
     result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
-
-    if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
-    if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+    result.pushKVs(blockTailToJSON(block, blockindex));
     return result;
 }
 
+/**
+ * Write the same document as blockToJSON, one transaction at a time. Takes
+ * cs_main only for the fields that need it, and flushes outside of it.
+ */
+void blockToJSONStream(CJSONWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue head, tail;
+    {
+        LOCK(cs_main);
+        head = blockHeadToJSON(block, blockindex);
+        tail = blockTailToJSON(block, blockindex);
+    }
+
+    writer.BeginObject();
+    writer.Members(head);
+    writer.Key("tx");
+    writer.BeginArray();
+    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    {
+        if(txDetails)
+        {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(), objTx);
+            writer.Value(objTx);
+        }
+        else
+            writer.Value(tx.GetHash().GetHex());
+        if (!writer.MaybeFlush())
+            return;
+    }
+    writer.EndArray();
+    writer.Members(tail);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -205,10 +261,8 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e, const set<string>& setDepends)
 {
-    AssertLockHeld(mempool.cs);
-
     info.push_back(Pair("size", (int)e.GetTxSize()));
     info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
     info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
@@ -222,13 +276,6 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
     info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
     info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    const CTransaction& tx = e.GetTx();
-    set<string> setDepends;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-    {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
-    }
 
     UniValue depends(UniValue::VARR);
     BOOST_FOREACH(const string& dep, setDepends)
@@ -239,32 +286,46 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("depends", depends));
 }
 
-UniValue mempoolToJSON(bool fVerbose = false)
+void entryToJSON(UniValue &info, const CTxMemPoolSnapshot::Entry &snapshotEntry)
 {
-    if (fVerbose)
-    {
-        LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
-        {
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
-            o.push_back(Pair(hash.ToString(), info));
-        }
-        return o;
-    }
-    else
-    {
-        vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
+    set<string> setDepends;
+    BOOST_FOREACH(const uint256& hashParent, snapshotEntry.vParents)
+        setDepends.insert(hashParent.ToString());
+    entryToJSON(info, snapshotEntry.entry, setDepends);
+}
 
+/** The JSON of a list of snapshot entries: their txids, or an object of their entries if fVerbose */
+static UniValue snapshotEntriesToJSON(const std::vector<const CTxMemPoolSnapshot::Entry*>& vEntries, bool fVerbose)
+{
+    if (!fVerbose) {
         UniValue a(UniValue::VARR);
-        BOOST_FOREACH(const uint256& hash, vtxid)
-            a.push_back(hash.ToString());
-
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry* pEntry, vEntries)
+            a.push_back(pEntry->GetHash().ToString());
         return a;
     }
+
+    UniValue o(UniValue::VOBJ);
+    BOOST_FOREACH(const CTxMemPoolSnapshot::Entry* pEntry, vEntries) {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, *pEntry);
+        o.push_back(Pair(pEntry->GetHash().ToString(), info));
+    }
+    return o;
+}
+
+/**
+ * The mempool, read from a snapshot of it, so that building the JSON does
+ * not hold the mempool lock. It may miss the most recent changes, see
+ * CTxMemPool::GetSnapshot().
+ */
+UniValue mempoolToJSON(bool fVerbose = false)
+{
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+    std::vector<const CTxMemPoolSnapshot::Entry*> vEntries;
+    vEntries.reserve(snapshot->size());
+    BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& entry, snapshot->GetEntries())
+        vEntries.push_back(&entry);
+    return snapshotEntriesToJSON(vEntries, fVerbose);
 }
 
 UniValue getrawmempool(const UniValue& params, bool fHelp)
@@ -298,6 +359,48 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+/**
+ * Write the same document as mempoolToJSON, from one snapshot of the
+ * mempool, so the mempool lock is not held while writing.
+ */
+void mempoolToJSONStream(CJSONWriter& writer, bool fVerbose = false)
+{
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+
+    if (!fVerbose) {
+        writer.BeginArray();
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& entry, snapshot->GetEntries()) {
+            writer.Value(entry.GetHash().ToString());
+            if (!writer.MaybeFlush())
+                return;
+        }
+        writer.EndArray();
+        return;
+    }
+
+    writer.BeginObject();
+    BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& entry, snapshot->GetEntries()) {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, entry);
+        writer.KeyValue(entry.GetHash().ToString(), info);
+        if (!writer.MaybeFlush())
+            return;
+    }
+    writer.EndObject();
+}
+
+static void getrawmempoolStream(const UniValue& params, CJSONWriter& writer)
+{
+    if (params.size() > 1)
+        getrawmempool(params, true); // throws the help text
+
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    mempoolToJSONStream(writer, fVerbose);
+}
+
 UniValue getmempoolancestors(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2) {
@@ -330,36 +433,12 @@ UniValue getmempoolancestors(const UniValue& params, bool fHelp)
 
     uint256 hash = ParseHashV(params[0], "parameter 1");
 
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+    if (!snapshot->Find(hash)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
-
-    if (!fVerbose) {
-        UniValue o(UniValue::VARR);
-        BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
-        }
-
-        return o;
-    } else {
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
-            o.push_back(Pair(hash.ToString(), info));
-        }
-        return o;
-    }
+    return snapshotEntriesToJSON(snapshot->GetAncestors(hash), fVerbose);
 }
 
 UniValue getmempooldescendants(const UniValue& params, bool fHelp)
@@ -394,36 +473,12 @@ UniValue getmempooldescendants(const UniValue& params, bool fHelp)
 
     uint256 hash = ParseHashV(params[0], "parameter 1");
 
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+    if (!snapshot->Find(hash)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
-
-    if (!fVerbose) {
-        UniValue o(UniValue::VARR);
-        BOOST_FOREACH(CTxMemPool::txiter descendantIt, setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
-        }
-
-        return o;
-    } else {
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(CTxMemPool::txiter descendantIt, setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
-            o.push_back(Pair(hash.ToString(), info));
-        }
-        return o;
-    }
+    return snapshotEntriesToJSON(snapshot->GetDescendants(hash), fVerbose);
 }
 
 UniValue getmempoolentry(const UniValue& params, bool fHelp)
@@ -446,16 +501,14 @@ UniValue getmempoolentry(const UniValue& params, bool fHelp)
 
     uint256 hash = ParseHashV(params[0], "parameter 1");
 
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+    const CTxMemPoolSnapshot::Entry* pEntry = snapshot->Find(hash);
+    if (!pEntry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(info, e);
+    entryToJSON(info, *pEntry);
     return info;
 }
 
@@ -543,6 +596,28 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+/** Look up and read the block getblock asks for */
+static CBlockIndex* ReadBlockForRPC(const UniValue& param, CBlock& block)
+{
+    AssertLockHeld(cs_main);
+
+    std::string strHash = param.get_str();
+    uint256 hash(uint256S(strHash));
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -584,26 +659,13 @@ UniValue getblock(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
-    std::string strHash = params[0].get_str();
-    uint256 hash(uint256S(strHash));
-
     bool fVerbose = true;
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
+    LOCK(cs_main);
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = ReadBlockForRPC(params[0], block);
 
     if (!fVerbose)
     {
@@ -616,6 +678,33 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+static void getblockStream(const UniValue& params, CJSONWriter& writer)
+{
+    if (params.size() < 1 || params.size() > 2)
+        getblock(params, true); // throws the help text
+
+    bool fVerbose = true;
+    if (params.size() > 1)
+        fVerbose = params[1].get_bool();
+
+    CBlock block;
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        pblockindex = ReadBlockForRPC(params[0], block);
+    }
+
+    if (!fVerbose)
+    {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+        ssBlock << block;
+        writer.Value(HexStr(ssBlock.begin(), ssBlock.end()));
+        return;
+    }
+
+    blockToJSONStream(writer, block, pblockindex);
+}
+
 struct CCoinsStats
 {
     int nHeight;
@@ -790,6 +879,219 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     return ret;
 }
 
+/** Accept either an address or a hex-encoded scriptPubKey for the index lookups */
+bool DecodeIndexedScript(const std::string& str, CScript& script)
+{
+    CBitcoinAddress address(str);
+    if (address.IsValid()) {
+        script = GetScriptForDestination(address.Get());
+        return true;
+    }
+    if (!str.empty() && IsHex(str)) {
+        std::vector<unsigned char> data(ParseHex(str));
+        script = CScript(data.begin(), data.end());
+        return true;
+    }
+    return false;
+}
+
+std::string EncodeAddressIndexCursor(const CAddressIndexKey& key)
+{
+    CDataStream ssKey(SER_NETWORK, PROTOCOL_VERSION);
+    ssKey << key;
+    return HexStr(ssKey.begin(), ssKey.end());
+}
+
+bool DecodeAddressIndexCursor(const std::string& str, CAddressIndexKey& key)
+{
+    if (!IsHex(str))
+        return false;
+    std::vector<unsigned char> data(ParseHex(str));
+    CDataStream ssKey(data, SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ssKey >> key;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return ssKey.empty();
+}
+
+UniValue addressDeltasToJSON(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vEntries, bool fMore, const CAddressIndexKey& keyNext)
+{
+    UniValue deltas(UniValue::VARR);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vEntries.begin(); it != vEntries.end(); ++it) {
+        const CAddressIndexKey& key = it->first;
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("txid", key.txid.GetHex()));
+        delta.push_back(Pair(key.fSpending ? "vin" : "vout", (int)key.n));
+        delta.push_back(Pair("height", (int)key.nHeight));
+        delta.push_back(Pair("amount", ValueFromAmount(it->second)));
+        deltas.push_back(delta);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("deltas", deltas));
+    if (fMore)
+        ret.push_back(Pair("next", EncodeAddressIndexCursor(keyNext)));
+    return ret;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddressdeltas \"address\" ( count \"cursor\" )\n"
+            "\nReturns the outputs paying to an address or script, and the inputs spending them,\n"
+            "ordered by block height, then txid.\n"
+            "Requires -addressindex. Only confirmed transactions are returned.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The skeincoin address, or a hex-encoded scriptPubKey\n"
+            "2. count          (numeric, optional, default=100) The maximum number of entries to return (at most " + strprintf("%u", MAX_ADDRESSINDEX_RESULTS) + ")\n"
+            "3. \"cursor\"     (string, optional) Continue from the \"next\" value of a previous call\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"deltas\" : [\n"
+            "    {\n"
+            "      \"txid\" : \"hash\",  (string) The transaction id\n"
+            "      \"vout\" : n,         (numeric) The output index, for outputs paying to the script\n"
+            "      \"vin\" : n,          (numeric) The input index, for inputs spending from the script\n"
+            "      \"height\" : n,       (numeric) The height of the block containing the transaction\n"
+            "      \"amount\" : x.xxx    (numeric) The amount in " + CURRENCY_UNIT + ", negative for spends\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"   (string) Only present if there are more entries\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "\"mipcBbFg9gMiCh81Kj8tqqdgoZub1ZJRfn\" 10")
+            + HelpExampleRpc("getaddressdeltas", "\"mipcBbFg9gMiCh81Kj8tqqdgoZub1ZJRfn\", 10")
+        );
+
+    if (!paddressindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled (use -addressindex)");
+
+    CScript script;
+    if (!DecodeIndexedScript(params[0].get_str(), script))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script");
+
+    int nCount = 100;
+    if (params.size() > 1)
+        nCount = params[1].get_int();
+    if (nCount <= 0 || (unsigned int)nCount > MAX_ADDRESSINDEX_RESULTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count");
+
+    CAddressIndexKey keyStart;
+    keyStart.hashScript = GetScriptHash(script);
+    if (params.size() > 2) {
+        CAddressIndexKey keyCursor;
+        if (!DecodeAddressIndexCursor(params[2].get_str(), keyCursor) || keyCursor.hashScript != keyStart.hashScript)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        keyStart = keyCursor;
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    bool fMore;
+    CAddressIndexKey keyNext;
+    if (!paddressindex->FindEntries(keyStart, nCount, vEntries, fMore, keyNext))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    return addressDeltasToJSON(vEntries, fMore, keyNext);
+}
+
+UniValue spentInfoToJSON(const CSpentIndexValue& value)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txid", value.txid.GetHex()));
+    ret.push_back(Pair("vin", (int)value.nIn));
+    ret.push_back(Pair("height", value.nHeight));
+    return ret;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the input spending a transaction output in the active chain, or null if it is unspent.\n"
+            "Requires -spentindex.\n"
+            "\nArguments:\n"
+            "1. \"txid\"       (string, required) The transaction id\n"
+            "2. n              (numeric, required) vout number\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",    (string) The spending transaction id\n"
+            "  \"vin\" : n,           (numeric) The index of the spending input\n"
+            "  \"height\" : n         (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "\"txid\" 1")
+            + HelpExampleRpc("getspentinfo", "\"txid\", 1")
+        );
+
+    if (!pspentindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled (use -spentindex)");
+
+    uint256 hash = ParseHashV(params[0], "txid");
+    int n = params[1].get_int();
+    if (n < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid vout number");
+
+    CSpentIndexValue value;
+    if (!pspentindex->FindSpender(COutPoint(hash, n), value))
+        return NullUniValue;
+
+    return spentInfoToJSON(value);
+}
+
+UniValue blockFilterToJSON(const CBlockFilter& filter, const uint256& hashHeader)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", hashHeader.GetHex()));
+    return ret;
+}
+
+UniValue getblockfilter(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getblockfilter \"hash\"\n"
+            "\nReturns the basic compact filter (BIP 158) of a block and its filter header.\n"
+            "Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"hash\"       (string, required) The block hash\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",    (string) The hex-encoded filter data\n"
+            "  \"header\" : \"hex\"     (string) The hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+        );
+
+    if (!pblockfilterindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filter index not enabled (use -blockfilterindex)");
+
+    uint256 hash = ParseHashV(params[0], "blockhash");
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pindex = mi->second;
+    }
+
+    CBlockFilter filter;
+    uint256 hashHeader;
+    if (!pblockfilterindex->LookupFilter(pindex, filter) || !pblockfilterindex->LookupFilterHeader(pindex, hashHeader)) {
+        if (!pblockfilterindex->IsSynced())
+            throw JSONRPCError(RPC_MISC_ERROR, "Filter not found (block filter index is still being built)");
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Filter not found");
+    }
+
+    return blockFilterToJSON(filter, hashHeader);
+}
+
 UniValue verifychain(const UniValue& params, bool fHelp)
 {
     int nCheckLevel = GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -1187,12 +1489,13 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  stream actor
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------
+    { "blockchain",         "getaddressdeltas",       &getaddressdeltas,       true  },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
+    { "blockchain",         "getblock",               &getblock,               true,       &getblockStream        },
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
@@ -1201,7 +1504,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,       &getrawmempoolStream   },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           true  },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
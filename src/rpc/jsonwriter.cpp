@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+
+#include <assert.h>
+
+void CJSONWriter::Separator()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vFirst.empty()) {
+        if (!vFirst.back())
+            strBuffer += ',';
+        vFirst.back() = false;
+    }
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separator();
+    strBuffer += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strBuffer += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separator();
+    strBuffer += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strBuffer += ']';
+}
+
+void CJSONWriter::Key(const std::string& key)
+{
+    assert(!fAfterKey);
+    Separator();
+    // Let UniValue take care of escaping
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONWriter::Value(const UniValue& value)
+{
+    Separator();
+    strBuffer += value.write();
+}
+
+void CJSONWriter::Members(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++)
+        KeyValue(keys[i], values[i]);
+}
+
+bool CJSONWriter::Flush()
+{
+    if (!fFailed && !strBuffer.empty())
+        fFailed = !WriteOut(strBuffer, false);
+    strBuffer.clear();
+    return !fFailed;
+}
+
+bool CJSONWriter::Finish()
+{
+    // Writers give up half way through once the destination went away
+    if (fFailed)
+        return false;
+    assert(vFirst.empty() && !fAfterKey);
+    strBuffer += '\n';
+    if (!fFailed)
+        fFailed = !WriteOut(strBuffer, true);
+    strBuffer.clear();
+    return !fFailed;
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONWRITER_H
+#define BITCOIN_RPC_JSONWRITER_H
+
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/**
+ * Writes a JSON document piece by piece, so that large results need not be
+ * built as one UniValue tree and serialized into one string. Arrays and
+ * objects are opened and closed explicitly; their elements are written as
+ * small UniValue values.
+ *
+ * Output is buffered and only passed on by MaybeFlush, Flush and Finish, so
+ * callers decide where that happens: never while holding a lock, as passing
+ * output on may block until a slow client has caught up.
+ */
+class CJSONWriter
+{
+private:
+    std::string strBuffer;
+    //! For each open array or object, whether no element has been written to it yet
+    std::vector<bool> vFirst;
+    bool fAfterKey;
+    bool fFailed;
+
+    void Separator();
+
+protected:
+    /**
+     * Pass a piece of the document on; fLast is set for the final piece.
+     * Returns false if the destination can take no more.
+     */
+    virtual bool WriteOut(const std::string& str, bool fLast) = 0;
+
+public:
+    //! Buffered size above which MaybeFlush passes output on
+    static const size_t FLUSH_SIZE = 64 * 1024;
+
+    CJSONWriter() : fAfterKey(false), fFailed(false) {}
+    virtual ~CJSONWriter() {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write the key of the next object member */
+    void Key(const std::string& key);
+    /** Write a value: an array element, an object member after Key, or the whole document */
+    void Value(const UniValue& value);
+    /** Write an object member */
+    void KeyValue(const std::string& key, const UniValue& value) { Key(key); Value(value); }
+    /** Write all members of obj into the current object */
+    void Members(const UniValue& obj);
+
+    /** Pass the buffered output on if there is enough of it. Returns false once the destination went away. */
+    bool MaybeFlush() { return strBuffer.size() < FLUSH_SIZE ? !fFailed : Flush(); }
+    /** Pass all buffered output on */
+    bool Flush();
+    /** End the document with a newline and pass it on */
+    bool Finish();
+
+    /** Whether the destination went away; later output is discarded */
+    bool IsFailed() const { return fFailed; }
+};
+
+/** JSON writer collecting the document in a string */
+class CStringJSONWriter : public CJSONWriter
+{
+private:
+    std::string strOut;
+
+protected:
+    bool WriteOut(const std::string& str, bool fLast) { strOut += str; return true; }
+
+public:
+    const std::string& GetString() const { return strOut; }
+};
+
+#endif // BITCOIN_RPC_JSONWRITER_H
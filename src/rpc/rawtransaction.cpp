@@ -8,6 +8,7 @@
 #include "coins.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "keystore.h"
 #include "main.h"
@@ -206,8 +207,11 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     CTransaction tx;
     uint256 hashBlock;
-    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
+    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true)) {
+        if (ptxindex && !ptxindex->IsSynced())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction (transaction index is still being built)");
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
+    }
 
     string strHex = EncodeHexTx(tx, RPCSerializationFlags());
 
@@ -904,6 +908,88 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
     return hashTx.GetHex();
 }
 
+UniValue txSubmitResultsToJSON(const std::vector<CTxSubmitResult>& vResults)
+{
+    UniValue results(UniValue::VARR);
+    BOOST_FOREACH(const CTxSubmitResult& result, vResults) {
+        UniValue entry(UniValue::VOBJ);
+        if (result.status != CTxSubmitResult::DECODE_FAILED)
+            entry.push_back(Pair("txid", result.hash.GetHex()));
+        switch (result.status) {
+        case CTxSubmitResult::DECODE_FAILED:
+            entry.push_back(Pair("error", JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed")));
+            break;
+        case CTxSubmitResult::REJECTED:
+            entry.push_back(Pair("error", JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%i: %s", result.nRejectCode, result.strRejectReason))));
+            break;
+        case CTxSubmitResult::MISSING_INPUTS:
+            entry.push_back(Pair("error", JSONRPCError(RPC_TRANSACTION_ERROR, "Missing inputs")));
+            break;
+        case CTxSubmitResult::FAILED:
+            entry.push_back(Pair("error", JSONRPCError(RPC_TRANSACTION_ERROR, result.strRejectReason)));
+            break;
+        case CTxSubmitResult::ALREADY_IN_CHAIN:
+            entry.push_back(Pair("error", JSONRPCError(RPC_TRANSACTION_ALREADY_IN_CHAIN, "transaction already in block chain")));
+            break;
+        case CTxSubmitResult::ACCEPTED:
+            break;
+        }
+        results.push_back(entry);
+    }
+    return results;
+}
+
+UniValue sendrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The transactions are accepted in order, so one may spend the outputs of an earlier one.\n"
+            "A transaction that is not accepted does not stop the others.\n"
+            "\nArguments:\n"
+            "1. [\"hexstring\",...]  (array, required) The hex strings of the raw transactions, at most 10000\n"
+            "2. allowhighfees       (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                      (array) One object per transaction, in the same order\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",     (string) The transaction hash in hex, unless it could not be decoded\n"
+            "    \"error\" : {          (object) Only if the transaction was not accepted\n"
+            "      \"code\" : n,        (numeric) The error code sendrawtransaction would fail with\n"
+            "      \"message\" : \"...\" (string) The error message sendrawtransaction would fail with\n"
+            "    }\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    const UniValue& txs = params[0].get_array();
+    if (txs.size() > MAX_SUBMIT_TRANSACTIONS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions (max: %u, tried: %u)", MAX_SUBMIT_TRANSACTIONS, txs.size()));
+    std::vector<std::vector<unsigned char> > vRawTx(txs.size());
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (!txs[i].isStr())
+            throw JSONRPCError(RPC_TYPE_ERROR, "Expected an array of hex strings");
+        // Anything that is not hex fails to decode as an empty transaction
+        if (IsHex(txs[i].get_str()))
+            vRawTx[i] = ParseHex(txs[i].get_str());
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (params.size() > 1 && params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    std::vector<CTxSubmitResult> vResults;
+    SubmitTransactions(vRawTx, nMaxRawTxFee, vResults);
+    return txSubmitResultsToJSON(vResults);
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -912,6 +998,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
     { "rawtransactions",    "decodescript",           &decodescript,           true  },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
 
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
@@ -32,6 +32,7 @@ namespace RPCServer
 }
 
 class CBlockIndex;
+class CJSONWriter;
 class CNetAddr;
 
 /** Wrapper for UniValue::VType, which includes typeAny:
@@ -125,6 +126,8 @@ void RPCUnsetTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+/** Writes the result of a command into a JSON writer instead of returning it as one UniValue */
+typedef void(*rpcstreamfn_type)(const UniValue& params, CJSONWriter& writer);
 
 class CRPCCommand
 {
@@ -133,6 +136,7 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    rpcstreamfn_type streamActor; //!< Optional, for commands with large results
 };
 
 /**
@@ -156,6 +160,15 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method that has a stream actor, writing the whole JSON-RPC
+     * reply object for it into writer (without calling Finish).
+     * @returns false, having written nothing, if the method has no stream actor.
+     * @throws an exception (UniValue) when an error happens. Part of the
+     * reply may have been written already.
+     */
+    bool executeStream(const std::string &method, const UniValue &params, const UniValue &id, CJSONWriter &writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
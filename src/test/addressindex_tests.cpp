@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "index/addressindex.h"
+#include "index/spentindex.h"
+#include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestChain100Setup)
+
+static void WaitForSync(const CBaseIndex& index)
+{
+    int64_t nTimeout = GetTimeMillis() + 10 * 1000;
+    while (!index.IsSynced()) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(50);
+    }
+}
+
+static std::vector<std::pair<CAddressIndexKey, CAmount> > FindAll(CAddressIndex& index, const CScript& script)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    CAddressIndexKey keyStart, keyNext;
+    keyStart.hashScript = GetScriptHash(script);
+    bool fMore;
+    BOOST_CHECK(index.FindEntries(keyStart, MAX_ADDRESSINDEX_RESULTS, vEntries, fMore, keyNext));
+    BOOST_CHECK(!fMore);
+    return vEntries;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_spentindex)
+{
+    CScript scriptCoinbase = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPayee = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // Spend the first coinbase to a new script
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = scriptPayee;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptCoinbase, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    std::vector<CMutableTransaction> txns(1, spend);
+    CBlock block = CreateAndProcessBlock(txns, scriptCoinbase);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    int nSpendHeight = chainActive.Height();
+
+    CAddressIndex addressindex(1 << 20, true);
+    CSpentIndex spentindex(1 << 20, true);
+    BOOST_REQUIRE(addressindex.Start());
+    BOOST_REQUIRE(spentindex.Start());
+    WaitForSync(addressindex);
+    WaitForSync(spentindex);
+
+    // The payee received one output
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries = FindAll(addressindex, scriptPayee);
+    BOOST_REQUIRE_EQUAL(vEntries.size(), 1U);
+    BOOST_CHECK(vEntries[0].first.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(vEntries[0].first.nHeight, (unsigned int)nSpendHeight);
+    BOOST_CHECK(!vEntries[0].first.fSpending);
+    BOOST_CHECK_EQUAL(vEntries[0].second, spend.vout[0].nValue);
+
+    // The coinbase script has one entry per coinbase plus the spend, by height
+    vEntries = FindAll(addressindex, scriptCoinbase);
+    BOOST_REQUIRE_EQUAL(vEntries.size(), coinbaseTxns.size() + 2);
+    for (unsigned int i = 1; i < vEntries.size(); i++)
+        BOOST_CHECK(vEntries[i - 1].first.nHeight <= vEntries[i].first.nHeight);
+    BOOST_CHECK(vEntries[0].first.txid == coinbaseTxns[0].GetHash());
+    CAmount nBalance = 0;
+    int nSpends = 0;
+    for (unsigned int i = 0; i < vEntries.size(); i++) {
+        nBalance += vEntries[i].second;
+        if (vEntries[i].first.fSpending) {
+            nSpends++;
+            BOOST_CHECK_EQUAL(vEntries[i].second, -coinbaseTxns[0].vout[0].nValue);
+        }
+    }
+    BOOST_CHECK_EQUAL(nSpends, 1);
+    // What is left is every coinbase output but the spent one
+    CAmount nExpectedBalance = block.vtx[0].vout[0].nValue;
+    for (unsigned int i = 1; i < coinbaseTxns.size(); i++)
+        nExpectedBalance += coinbaseTxns[i].vout[0].nValue;
+    BOOST_CHECK_EQUAL(nBalance, nExpectedBalance);
+
+    // Pages of two entries chain to the same result
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vPaged;
+    CAddressIndexKey keyStart, keyNext;
+    keyStart.hashScript = GetScriptHash(scriptCoinbase);
+    bool fMore = true;
+    while (fMore) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vPage;
+        BOOST_REQUIRE(addressindex.FindEntries(keyStart, 2, vPage, fMore, keyNext));
+        BOOST_REQUIRE(vPage.size() == 2 || (!fMore && vPage.size() > 0));
+        vPaged.insert(vPaged.end(), vPage.begin(), vPage.end());
+        keyStart = keyNext;
+    }
+    BOOST_REQUIRE_EQUAL(vPaged.size(), vEntries.size());
+    for (unsigned int i = 0; i < vPaged.size(); i++)
+        BOOST_CHECK(vPaged[i].first.txid == vEntries[i].first.txid && vPaged[i].first.fSpending == vEntries[i].first.fSpending);
+
+    // The spender of the coinbase output is known, unspent outputs have none
+    CSpentIndexValue value;
+    BOOST_REQUIRE(spentindex.FindSpender(spend.vin[0].prevout, value));
+    BOOST_CHECK(value.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(value.nIn, 0U);
+    BOOST_CHECK_EQUAL(value.nHeight, nSpendHeight);
+    BOOST_CHECK(!spentindex.FindSpender(COutPoint(spend.GetHash(), 0), value));
+
+    // Entries of a block leaving the chain are removed once the tip moves on
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    mempool.clear();
+    std::vector<CMutableTransaction> noTxns;
+    CreateAndProcessBlock(noTxns, scriptCoinbase);
+    int64_t nTimeout = GetTimeMillis() + 10 * 1000;
+    while (!FindAll(addressindex, scriptPayee).empty() || spentindex.FindSpender(spend.vin[0].prevout, value)) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(50);
+    }
+
+    addressindex.Stop();
+    spentindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
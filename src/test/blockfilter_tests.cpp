@@ -0,0 +1,172 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "index/blockfilterindex.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "undo.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    CGCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        CGCSFilter::Element element1(32);
+        GetRandBytes(element1.data(), element1.size());
+        included.insert(element1);
+
+        CGCSFilter::Element element2(32);
+        GetRandBytes(element2.data(), element2.size());
+        excluded.insert(element2);
+    }
+
+    CGCSFilter filter(0, 0, 10, 1 << 10, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (CGCSFilter::ElementSet::const_iterator it = included.begin(); it != included.end(); ++it)
+        BOOST_CHECK(filter.Match(*it));
+
+    // Excluded elements match only as false positives, at a rate of about 1/M each
+    int nFalsePositives = 0;
+    for (CGCSFilter::ElementSet::const_iterator it = excluded.begin(); it != excluded.end(); ++it)
+        nFalsePositives += filter.Match(*it);
+    BOOST_CHECK(nFalsePositives < 5);
+
+    CGCSFilter::ElementSet query = excluded;
+    query.insert(*included.begin());
+    BOOST_CHECK(filter.MatchAny(query));
+
+    // A filter decoded from the encoding behaves the same
+    CGCSFilter decoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    BOOST_CHECK(decoded.MatchAny(included));
+
+    // Truncated encodings are rejected
+    std::vector<unsigned char> vchTruncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 20);
+    BOOST_CHECK_THROW(CGCSFilter(0, 0, 10, 1 << 10, vchTruncated), std::ios_base::failure);
+
+    // The empty filter matches nothing
+    CGCSFilter empty(0, 0, 10, 1 << 10, CGCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript scriptIncluded1 = CScript() << OP_1 << std::vector<unsigned char>(40, 1);
+    CScript scriptIncluded2 = CScript() << OP_2 << std::vector<unsigned char>(40, 2);
+    CScript scriptPrevout = CScript() << OP_3 << std::vector<unsigned char>(40, 3);
+    CScript scriptOpReturn = CScript() << OP_RETURN << std::vector<unsigned char>(40, 4);
+    CScript scriptSpent = CScript() << OP_5 << std::vector<unsigned char>(40, 5);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(4);
+    tx.vout[0].scriptPubKey = scriptIncluded1;
+    tx.vout[1].scriptPubKey = scriptIncluded2;
+    tx.vout[2].scriptPubKey = scriptOpReturn;
+    tx.vout[3].scriptPubKey = CScript();
+
+    CBlock block;
+    block.vtx.push_back(CTransaction()); // coinbase placeholder
+    block.vtx.push_back(tx);
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(100, scriptPrevout)));
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(100, CScript())));
+
+    CBlockFilter blockfilter(block, blockundo);
+    const CGCSFilter& filter = blockfilter.GetFilter();
+    BOOST_CHECK(blockfilter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(filter.GetN(), 3U);
+    BOOST_CHECK(filter.Match(CGCSFilter::Element(scriptIncluded1.begin(), scriptIncluded1.end())));
+    BOOST_CHECK(filter.Match(CGCSFilter::Element(scriptIncluded2.begin(), scriptIncluded2.end())));
+    BOOST_CHECK(filter.Match(CGCSFilter::Element(scriptPrevout.begin(), scriptPrevout.end())));
+    BOOST_CHECK(!filter.Match(CGCSFilter::Element(scriptOpReturn.begin(), scriptOpReturn.end())));
+    BOOST_CHECK(!filter.Match(CGCSFilter::Element(scriptSpent.begin(), scriptSpent.end())));
+
+    // Round trip through the cfilter serialization
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << blockfilter;
+    CBlockFilter decoded;
+    ss >> decoded;
+    BOOST_CHECK(decoded.GetBlockHash() == blockfilter.GetBlockHash());
+    BOOST_CHECK(decoded.GetEncodedFilter() == blockfilter.GetEncodedFilter());
+    BOOST_CHECK(decoded.GetHash() == blockfilter.GetHash());
+    BOOST_CHECK(decoded.ComputeHeader(uint256()) == blockfilter.ComputeHeader(uint256()));
+}
+
+static bool CheckFilterLookups(CBlockFilterIndex& index, const CBlockIndex* pindex, uint256& hashLastHeader)
+{
+    CBlock block;
+    CBlockUndo blockundo;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    if (pindex->pprev)
+        BOOST_REQUIRE(UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()));
+    CBlockFilter expected(block, blockundo);
+
+    CBlockFilter filter;
+    uint256 hashHeader;
+    if (!index.LookupFilter(pindex, filter) || !index.LookupFilterHeader(pindex, hashHeader))
+        return false;
+    BOOST_CHECK(filter.GetEncodedFilter() == expected.GetEncodedFilter());
+    BOOST_CHECK(hashHeader == expected.ComputeHeader(hashLastHeader));
+    hashLastHeader = hashHeader;
+    return true;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_initial_sync, TestChain100Setup)
+{
+    CBlockFilterIndex index(1 << 20, true);
+
+    CBlockFilter filter;
+    BOOST_CHECK(!index.LookupFilter(chainActive.Tip(), filter));
+
+    BOOST_REQUIRE(index.Start());
+    int64_t nTimeout = GetTimeMillis() + 10 * 1000;
+    while (!index.IsSynced()) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(100);
+    }
+
+    // Every block, including the genesis block, has its filter and a chained filter header
+    uint256 hashLastHeader;
+    for (int nHeight = 0; nHeight <= chainActive.Height(); nHeight++)
+        BOOST_CHECK(CheckFilterLookups(index, chainActive[nHeight], hashLastHeader));
+
+    std::vector<CBlockFilter> vFilters;
+    std::vector<uint256> vHashes;
+    BOOST_CHECK(index.LookupFilterRange(10, chainActive.Tip(), vFilters));
+    BOOST_CHECK(index.LookupFilterHashRange(10, chainActive.Tip(), vHashes));
+    BOOST_REQUIRE_EQUAL(vFilters.size(), (size_t)chainActive.Height() - 9);
+    BOOST_REQUIRE_EQUAL(vHashes.size(), vFilters.size());
+    for (unsigned int i = 0; i < vFilters.size(); i++) {
+        BOOST_CHECK(vFilters[i].GetBlockHash() == chainActive[10 + i]->GetBlockHash());
+        BOOST_CHECK(vHashes[i] == vFilters[i].GetHash());
+    }
+
+    // New blocks are indexed as they arrive
+    std::vector<CMutableTransaction> noTxns;
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(noTxns, scriptPubKey);
+    nTimeout = GetTimeMillis() + 10 * 1000;
+    while (!CheckFilterLookups(index, chainActive.Tip(), hashLastHeader)) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(100);
+    }
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
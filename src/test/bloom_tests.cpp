@@ -6,9 +6,11 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "hash.h"
 #include "key.h"
 #include "merkleblock.h"
 #include "random.h"
+#include "script/standard.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
@@ -471,6 +473,150 @@ static std::vector<unsigned char> RandomData()
     return std::vector<unsigned char>(r.begin(), r.end());
 }
 
+// IsRelevantAndUpdate as it was before elements were extracted and matched in batches
+static bool ReferenceIsRelevantAndUpdate(CBloomFilter& filter, const CTransaction& tx, unsigned char nFlags)
+{
+    bool fFound = filter.contains(tx.GetHash());
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CScript& scriptPubKey = tx.vout[i].scriptPubKey;
+        CScript::const_iterator pc = scriptPubKey.begin();
+        vector<unsigned char> data;
+        opcodetype opcode;
+        while (pc < scriptPubKey.end() && scriptPubKey.GetOp(pc, opcode, data)) {
+            if (data.size() != 0 && filter.contains(data)) {
+                fFound = true;
+                txnouttype type;
+                vector<vector<unsigned char> > vSolutions;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL ||
+                        ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY && Solver(scriptPubKey, type, vSolutions) &&
+                         (type == TX_PUBKEY || type == TX_MULTISIG)))
+                    filter.insert(COutPoint(tx.GetHash(), i));
+                break;
+            }
+        }
+    }
+    if (fFound)
+        return true;
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        if (filter.contains(tx.vin[i].prevout))
+            return true;
+        const CScript& scriptSig = tx.vin[i].scriptSig;
+        CScript::const_iterator pc = scriptSig.begin();
+        vector<unsigned char> data;
+        opcodetype opcode;
+        while (pc < scriptSig.end() && scriptSig.GetOp(pc, opcode, data)) {
+            if (data.size() != 0 && filter.contains(data))
+                return true;
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(bloom_match_batch)
+{
+    // Hashing under many seeds at once gives the same hashes as one at a time
+    for (unsigned int nSize = 0; nSize < 40; nSize++) {
+        vector<unsigned char> data(nSize);
+        for (unsigned int i = 0; i < nSize; i++)
+            data[i] = insecure_rand();
+        uint32_t seeds[7], hashes[7];
+        for (int j = 0; j < 7; j++)
+            seeds[j] = insecure_rand();
+        MurmurHash3Multi(seeds, 7, data.data(), data.size(), hashes);
+        for (int j = 0; j < 7; j++)
+            BOOST_CHECK_EQUAL(hashes[j], MurmurHash3(seeds[j], data));
+    }
+
+    // A chain of transactions, each spending outputs of the previous one,
+    // with pay-to-pubkey and pay-to-pubkeyhash outputs
+    vector<vector<unsigned char> > vKeys;
+    for (int i = 0; i < 20; i++) {
+        vector<unsigned char> vKey = RandomData();
+        vKey.insert(vKey.end(), vKey.begin(), vKey.end());
+        vKey[0] = 0x04;
+        vKey.push_back(insecure_rand());
+        vKeys.push_back(vKey);
+    }
+    vector<CTransaction> vTxs;
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    for (int n = 0; n < 10; n++) {
+        mtx.vout.resize(3);
+        for (int i = 0; i < 3; i++) {
+            const vector<unsigned char>& vKey = vKeys[insecure_rand() % vKeys.size()];
+            if (i == 0)
+                mtx.vout[i].scriptPubKey = CScript() << vKey << OP_CHECKSIG;
+            else
+                mtx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(vKey.begin(), vKey.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        for (unsigned int i = 0; i < mtx.vin.size(); i++)
+            mtx.vin[i].scriptSig = CScript() << RandomData() << vKeys[insecure_rand() % vKeys.size()];
+        vTxs.push_back(CTransaction(mtx));
+        mtx.vin.resize(1 + insecure_rand() % 3);
+        for (unsigned int i = 0; i < mtx.vin.size(); i++)
+            mtx.vin[i].prevout = COutPoint(vTxs.back().GetHash(), i);
+    }
+
+    // Filters with all update flags, each watching a few keys, txids or
+    // outpoints, plus a full and an empty one
+    vector<CBloomFilter> vFilters;
+    vector<unsigned char> vFlags;
+    for (int f = 0; f < 200; f++) {
+        unsigned char nFlags = f % 3;
+        CBloomFilter filter(1 + insecure_rand() % 20, 0.01, insecure_rand(), nFlags);
+        int nWatched = insecure_rand() % 4;
+        for (int i = 0; i < nWatched; i++) {
+            switch (insecure_rand() % 4) {
+            case 0:
+                filter.insert(vKeys[insecure_rand() % vKeys.size()]);
+                break;
+            case 1: {
+                const vector<unsigned char>& vKey = vKeys[insecure_rand() % vKeys.size()];
+                filter.insert(vector<unsigned char>(vKey.begin(), vKey.begin() + 20));
+                break;
+            }
+            case 2:
+                filter.insert(vTxs[insecure_rand() % vTxs.size()].GetHash());
+                break;
+            case 3:
+                filter.insert(COutPoint(vTxs[insecure_rand() % vTxs.size()].GetHash(), insecure_rand() % 3));
+                break;
+            }
+        }
+        if (nWatched == 0)
+            filter.clear();
+        vFilters.push_back(filter);
+        vFlags.push_back(nFlags);
+    }
+    vFilters.push_back(CBloomFilter());
+    vFlags.push_back(0);
+
+    vector<CBloomFilter> vReference(vFilters);
+    vector<CBloomFilter*> vpFilters;
+    for (unsigned int f = 0; f < vFilters.size(); f++)
+        vpFilters.push_back(&vFilters[f]);
+
+    int nMatches = 0;
+    for (unsigned int n = 0; n < vTxs.size(); n++) {
+        vector<bool> vMatch;
+        CBloomFilter::MatchBatch(CBloomTxElements(vTxs[n]), vpFilters, vMatch);
+        BOOST_CHECK_EQUAL(vMatch.size(), vFilters.size());
+        for (unsigned int f = 0; f < vFilters.size(); f++) {
+            BOOST_CHECK_EQUAL(vMatch[f], ReferenceIsRelevantAndUpdate(vReference[f], vTxs[n], vFlags[f]));
+            nMatches += vMatch[f];
+        }
+    }
+    // Matching updated the filters in the same way
+    for (unsigned int f = 0; f < vFilters.size(); f++) {
+        CDataStream ssBatch(SER_NETWORK, PROTOCOL_VERSION), ssReference(SER_NETWORK, PROTOCOL_VERSION);
+        ssBatch << vFilters[f];
+        ssReference << vReference[f];
+        BOOST_CHECK(ssBatch.str() == ssReference.str());
+    }
+    BOOST_CHECK(nMatches > (int)vTxs.size());
+}
+
 BOOST_AUTO_TEST_CASE(rolling_bloom)
 {
     // last-100-entry, 1% false positive:
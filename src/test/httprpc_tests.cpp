@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "httprpc.h"
+#include "httpserver.h"
+#include "netbase.h"
+#include "rpc/jsonwriter.h"
+#include "rpc/server.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "test/test_bitcoin.h"
+
+#include <stdexcept>
+#include <string>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+/** Streams a result larger than one flush, then fails if params[0] is true */
+static void streamtest(const UniValue& params, CJSONWriter& writer)
+{
+    writer.BeginArray();
+    for (int i = 0; i < 10000; i++) {
+        writer.Value(std::string(64, 'a'));
+        writer.MaybeFlush();
+    }
+    if (params[0].get_bool())
+        throw std::runtime_error("streamtest failed");
+    writer.EndArray();
+}
+
+static UniValue streamtest_actor(const UniValue& params, bool fHelp)
+{
+    throw std::runtime_error("streamtest only streams");
+}
+
+static const CRPCCommand streamtestCommand = { "test", "streamtest", &streamtest_actor, true, &streamtest };
+
+/** A loopback port nothing listens on */
+static int GetFreePort()
+{
+    SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    BOOST_REQUIRE(hSocket != INVALID_SOCKET);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    BOOST_REQUIRE(bind(hSocket, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    BOOST_REQUIRE(getsockname(hSocket, (struct sockaddr*)&addr, &len) == 0);
+    CloseSocket(hSocket);
+    return ntohs(addr.sin_port);
+}
+
+/** Send an HTTP request to the loopback port and return everything received until the server closed the connection */
+static std::string HTTPExchange(int nPort, const std::string& strRequest)
+{
+    SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    BOOST_REQUIRE(hSocket != INVALID_SOCKET);
+    struct timeval timeout = {30, 0};
+    setsockopt(hSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(nPort);
+    BOOST_REQUIRE(connect(hSocket, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    BOOST_REQUIRE(send(hSocket, strRequest.data(), strRequest.size(), MSG_NOSIGNAL) == (int)strRequest.size());
+
+    std::string strResponse;
+    char buf[4096];
+    int nBytes;
+    while ((nBytes = recv(hSocket, buf, sizeof(buf), 0)) > 0)
+        strResponse.append(buf, nBytes);
+    BOOST_CHECK(nBytes == 0);
+    CloseSocket(hSocket);
+    return strResponse;
+}
+
+static std::string StreamTestRequest(bool fFail)
+{
+    std::string strBody = strprintf("{\"method\":\"streamtest\",\"params\":[%s],\"id\":1}", fFail ? "true" : "false");
+    return "POST / HTTP/1.1\r\n"
+           "Host: 127.0.0.1\r\n"
+           "Connection: close\r\n"
+           "Authorization: Basic " + EncodeBase64("user:pass") + "\r\n"
+           "Content-Type: application/json\r\n" +
+           strprintf("Content-Length: %u\r\n\r\n", strBody.size()) + strBody;
+}
+
+BOOST_FIXTURE_TEST_SUITE(httprpc_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(httprpc_stream_abort)
+{
+    int nPort = GetFreePort();
+    mapArgs["-rpcport"] = strprintf("%d", nPort);
+    mapArgs["-rpcuser"] = "user";
+    mapArgs["-rpcpassword"] = "pass";
+    BOOST_REQUIRE(tableRPC.appendCommand("streamtest", &streamtestCommand));
+    if (RPCIsInWarmup(NULL))
+        SetRPCWarmupFinished();
+    BOOST_REQUIRE(InitHTTPServer());
+    BOOST_REQUIRE(StartHTTPRPC());
+    BOOST_REQUIRE(StartHTTPServer());
+
+    // A streamed reply ends with the final empty chunk
+    std::string strResponse = HTTPExchange(nPort, StreamTestRequest(false));
+    BOOST_CHECK(boost::starts_with(strResponse, "HTTP/1.1 200"));
+    BOOST_CHECK(strResponse.size() > CJSONWriter::FLUSH_SIZE);
+    BOOST_CHECK(boost::ends_with(strResponse, "\r\n0\r\n\r\n"));
+
+    // A reply failing after its first chunk went out is broken off without it
+    strResponse = HTTPExchange(nPort, StreamTestRequest(true));
+    BOOST_CHECK(boost::starts_with(strResponse, "HTTP/1.1 200"));
+    BOOST_CHECK(strResponse.size() > CJSONWriter::FLUSH_SIZE);
+    BOOST_CHECK(!boost::ends_with(strResponse, "\r\n0\r\n\r\n"));
+
+    InterruptHTTPServer();
+    StopHTTPRPC();
+    StopHTTPServer();
+    mapArgs.erase("-rpcport");
+    mapArgs.erase("-rpcuser");
+    mapArgs.erase("-rpcpassword");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
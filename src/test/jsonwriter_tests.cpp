@@ -0,0 +1,130 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+/** Collects the pieces passed on, failing after nFailAfter of them */
+class CTestJSONWriter : public CJSONWriter
+{
+public:
+    std::vector<std::string> vPieces;
+    bool fLastSeen;
+    size_t nFailAfter;
+
+    CTestJSONWriter(size_t nFailAfterIn = std::numeric_limits<size_t>::max()) : fLastSeen(false), nFailAfter(nFailAfterIn) {}
+
+protected:
+    bool WriteOut(const std::string& str, bool fLast)
+    {
+        if (vPieces.size() >= nFailAfter)
+            return false;
+        vPieces.push_back(str);
+        fLastSeen = fLast;
+        return true;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(jsonwriter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsonwriter_matches_univalue)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("a \"quoted\"\nkey", "value\twith\\escapes"));
+    inner.push_back(Pair("number", 42));
+    inner.push_back(Pair("null", NullUniValue));
+    UniValue arr(UniValue::VARR);
+    arr.push_back(1.5);
+    arr.push_back(true);
+    arr.push_back(inner);
+    arr.push_back(UniValue(UniValue::VARR));
+    arr.push_back(UniValue(UniValue::VOBJ));
+
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("first", arr));
+    expected.pushKVs(inner);
+    expected.push_back(Pair("empty", UniValue(UniValue::VARR)));
+
+    CStringJSONWriter writer;
+    writer.BeginObject();
+    writer.Key("first");
+    writer.BeginArray();
+    writer.Value(1.5);
+    writer.Value(true);
+    writer.BeginObject();
+    writer.Members(inner);
+    writer.EndObject();
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Value(UniValue(UniValue::VOBJ));
+    writer.EndArray();
+    writer.Members(inner);
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.EndObject();
+    BOOST_CHECK(writer.GetString().empty());
+    BOOST_CHECK(writer.Finish());
+
+    BOOST_CHECK_EQUAL(writer.GetString(), expected.write() + "\n");
+    UniValue parsed;
+    BOOST_CHECK(parsed.read(writer.GetString()));
+    BOOST_CHECK_EQUAL(parsed.write(), expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_flush)
+{
+    UniValue expected(UniValue::VARR);
+    CTestJSONWriter writer;
+    writer.BeginArray();
+    for (int i = 0; i < 100000; i++) {
+        expected.push_back(i);
+        writer.Value(i);
+        BOOST_CHECK(writer.MaybeFlush());
+    }
+    writer.EndArray();
+    BOOST_CHECK(writer.Finish());
+    BOOST_CHECK(writer.fLastSeen);
+
+    // Passed on in pieces of about FLUSH_SIZE
+    BOOST_CHECK(writer.vPieces.size() > 1);
+    std::string str;
+    for (size_t i = 0; i < writer.vPieces.size(); i++) {
+        if (i + 1 < writer.vPieces.size())
+            BOOST_CHECK(writer.vPieces[i].size() >= CJSONWriter::FLUSH_SIZE);
+        str += writer.vPieces[i];
+    }
+    BOOST_CHECK_EQUAL(str, expected.write() + "\n");
+
+    // A small document is passed on as a single last piece
+    CTestJSONWriter small;
+    small.Value("abc");
+    BOOST_CHECK(small.MaybeFlush());
+    BOOST_CHECK(small.Finish());
+    BOOST_CHECK_EQUAL(small.vPieces.size(), 1U);
+    BOOST_CHECK(small.fLastSeen);
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_failure)
+{
+    CTestJSONWriter writer(1);
+    writer.BeginArray();
+    int i = 0;
+    while (writer.MaybeFlush())
+        writer.Value(i++);
+    BOOST_CHECK(writer.IsFailed());
+    BOOST_CHECK_EQUAL(writer.vPieces.size(), 1U);
+
+    // Nothing more is passed on, and an unfinished document may be abandoned
+    writer.Value(i);
+    BOOST_CHECK(!writer.Flush());
+    BOOST_CHECK(!writer.Finish());
+    BOOST_CHECK_EQUAL(writer.vPieces.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
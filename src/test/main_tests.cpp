@@ -58,6 +58,41 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, 1679856446307600ULL);
 }
 
+BOOST_AUTO_TEST_CASE(block_download_share_test)
+{
+    // Peers not measured yet get the default
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(0), DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER);
+    // Otherwise BLOCK_DOWNLOAD_TARGET_TIME worth of blocks
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(1000000), BLOCK_DOWNLOAD_TARGET_TIME);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(100000), BLOCK_DOWNLOAD_TARGET_TIME * 10);
+    // Within bounds however fast or slow the peer is
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(1), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(10000), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(BLOCK_DOWNLOAD_TARGET_TIME * 1000000), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitPerPeer(3600 * 1000000LL), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_straggler_test)
+{
+    // A peer taking 0.5s per block and usually answering in 1s holds a
+    // block; we ask whether a peer taking 0.1s per block should fetch it
+    const int64_t nResponse = 1000000, nHolderInterval = 500000, nInterval = 100000;
+    BOOST_CHECK(!IsStragglingBlock(BLOCK_STRAGGLER_MIN_TIME - 1, nResponse, nHolderInterval, nInterval));
+    BOOST_CHECK(IsStragglingBlock(BLOCK_STRAGGLER_MIN_TIME, nResponse, nHolderInterval, nInterval));
+
+    // Not before twice the holder's usual response time
+    BOOST_CHECK(!IsStragglingBlock(6 * nResponse - 1, 3 * nResponse, nHolderInterval, nInterval));
+    BOOST_CHECK(IsStragglingBlock(6 * nResponse, 3 * nResponse, nHolderInterval, nInterval));
+
+    // Only from a faster peer
+    BOOST_CHECK(!IsStragglingBlock(10 * nResponse, nResponse, nHolderInterval, nHolderInterval));
+    BOOST_CHECK(!IsStragglingBlock(10 * nResponse, nResponse, nHolderInterval, nHolderInterval + 1));
+    BOOST_CHECK(!IsStragglingBlock(10 * nResponse, nResponse, nHolderInterval, 0));
+    // A holder that never delivered a block counts as slower than anyone measured
+    BOOST_CHECK(!IsStragglingBlock(BLOCK_STRAGGLER_MIN_TIME - 1, 0, 0, nInterval));
+    BOOST_CHECK(IsStragglingBlock(BLOCK_STRAGGLER_MIN_TIME, 0, 0, nInterval));
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
@@ -3,12 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "policy/policy.h"
+#include "random.h"
 #include "txmempool.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <limits>
 #include <list>
 #include <vector>
 
@@ -191,6 +193,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     tx7.vout[1].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx7.vout[1].nValue = 1 * COIN;
 
+    LOCK(pool.cs);
     CTxMemPool::setEntries setAncestorsCalculated;
     std::string dummy;
     BOOST_CHECK_EQUAL(pool.CalculateMemPoolAncestors(entry.Fee(2000000LL).FromTx(tx7), setAncestorsCalculated, 100, 1000000, 1000, 1000000, dummy), true);
@@ -423,6 +426,107 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest)
+{
+    // A random graph of transactions, a block mining some of them along with
+    // their ancestors, and a block transaction conflicting with another one
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<CTransaction> vTxs;
+    std::vector<COutPoint> vUnspent;
+    std::map<uint256, std::set<uint256> > mapParents;
+    for (int i = 0; i < 100; i++) {
+        CMutableTransaction tx;
+        int nInputs = 1 + insecure_rand() % 2;
+        for (int j = 0; j < nInputs; j++) {
+            tx.vin.resize(j + 1);
+            if (vUnspent.empty() || insecure_rand() % 4 == 0) {
+                tx.vin[j].prevout = COutPoint(GetRandHash(), 0);
+            } else {
+                size_t n = insecure_rand() % vUnspent.size();
+                tx.vin[j].prevout = vUnspent[n];
+                vUnspent.erase(vUnspent.begin() + n);
+            }
+            tx.vin[j].scriptSig = CScript() << OP_11;
+        }
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; j++) {
+            tx.vout[j].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+            tx.vout[j].nValue = COIN;
+        }
+        CTransaction t(tx);
+        for (unsigned int j = 0; j < t.vin.size(); j++) {
+            if (pool.exists(t.vin[j].prevout.hash))
+                mapParents[t.GetHash()].insert(t.vin[j].prevout.hash);
+        }
+        pool.addUnchecked(t.GetHash(), entry.Fee(1000 + insecure_rand() % 10000).SigOpsCost(insecure_rand() % 20).FromTx(t));
+        vTxs.push_back(t);
+        vUnspent.push_back(COutPoint(t.GetHash(), 0));
+        vUnspent.push_back(COutPoint(t.GetHash(), 1));
+    }
+
+    std::set<uint256> setMined;
+    for (int i = 0; i < 10; i++) {
+        std::vector<uint256> vStack(1, vTxs[insecure_rand() % vTxs.size()].GetHash());
+        while (!vStack.empty()) {
+            uint256 hash = vStack.back();
+            vStack.pop_back();
+            if (setMined.insert(hash).second)
+                vStack.insert(vStack.end(), mapParents[hash].begin(), mapParents[hash].end());
+        }
+    }
+    std::vector<CTransaction> vtx;
+    BOOST_FOREACH(const CTransaction& tx, vTxs) {
+        if (setMined.count(tx.GetHash()))
+            vtx.push_back(tx);
+    }
+    const CTransaction* pConflicted = NULL;
+    BOOST_FOREACH(const CTransaction& tx, vTxs) {
+        if (!setMined.count(tx.GetHash()) && mapParents[tx.GetHash()].empty()) {
+            pConflicted = &tx;
+            break;
+        }
+    }
+    BOOST_REQUIRE(pConflicted);
+    CMutableTransaction txConflict;
+    txConflict.vin.resize(1);
+    txConflict.vin[0].prevout = pConflicted->vin[0].prevout;
+    txConflict.vout.resize(1);
+    txConflict.vout[0].nValue = COIN;
+    vtx.push_back(txConflict);
+
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts, false);
+    BOOST_CHECK(!conflicts.empty());
+    BOOST_FOREACH(const CTransaction& tx, conflicts)
+        BOOST_CHECK(!pool.exists(tx.GetHash()));
+    BOOST_CHECK(!pool.exists(pConflicted->GetHash()));
+    BOOST_CHECK_EQUAL(pool.size() + setMined.size() + conflicts.size(), vTxs.size());
+
+    // The remaining entries have the same state as in a mempool they were
+    // added to from scratch
+    CTxMemPool poolExpected(CFeeRate(0));
+    BOOST_FOREACH(CTransaction& tx, vTxs) {
+        CTxMemPool::txiter it = pool.mapTx.find(tx.GetHash());
+        if (it != pool.mapTx.end())
+            poolExpected.addUnchecked(tx.GetHash(), entry.Fee(it->GetFee()).SigOpsCost(it->GetSigOpCost()).FromTx(tx));
+    }
+    BOOST_CHECK_EQUAL(poolExpected.size(), pool.size());
+    BOOST_FOREACH(const CTxMemPoolEntry& e, poolExpected.mapTx) {
+        CTxMemPool::txiter it = pool.mapTx.find(e.GetTx().GetHash());
+        BOOST_REQUIRE(it != pool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), e.GetCountWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), e.GetSizeWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), e.GetModFeesWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetSigOpCostWithAncestors(), e.GetSigOpCostWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), e.GetCountWithDescendants());
+        BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), e.GetSizeWithDescendants());
+        BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), e.GetModFeesWithDescendants());
+        BOOST_CHECK(pool.GetMemPoolParents(it).size() == poolExpected.GetMemPoolParents(poolExpected.mapTx.find(e.GetTx().GetHash())).size());
+        BOOST_CHECK(pool.GetMemPoolChildren(it).size() == poolExpected.GetMemPoolChildren(poolExpected.mapTx.find(e.GetTx().GetHash())).size());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(1000));
@@ -578,4 +682,89 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+
+    // A chain parent -> child -> grandchild, and an unrelated transaction
+    CMutableTransaction txs[4];
+    for (int i = 0; i < 4; i++) {
+        txs[i].vin.resize(1);
+        txs[i].vin[0].scriptSig = CScript() << OP_11;
+        if (i > 0 && i < 3) {
+            txs[i].vin[0].prevout.hash = txs[i - 1].GetHash();
+            txs[i].vin[0].prevout.n = 0;
+        }
+        txs[i].vout.resize(1);
+        txs[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txs[i].vout[0].nValue = 10000LL - i;
+    }
+
+    std::shared_ptr<const CTxMemPoolSnapshot> empty = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(empty->size(), 0);
+    BOOST_CHECK(pool.GetSnapshot() == empty);
+
+    for (int i = 0; i < 4; i++)
+        pool.addUnchecked(txs[i].GetHash(), entry.Fee(1000LL * (i + 1)).FromTx(txs[i], &pool));
+    BOOST_CHECK_EQUAL(empty->size(), 0);
+
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = pool.GetSnapshot();
+    BOOST_CHECK(snapshot != empty);
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+    BOOST_CHECK_EQUAL(snapshot->size(), 4);
+    // In the order of queryHashes, so parents come before their children
+    std::vector<uint256> vHashes;
+    pool.queryHashes(vHashes);
+    BOOST_REQUIRE_EQUAL(vHashes.size(), snapshot->size());
+    for (size_t i = 0; i < snapshot->size(); i++)
+        BOOST_CHECK(snapshot->GetEntries()[i].GetHash() == vHashes[i]);
+
+    const CTxMemPoolSnapshot::Entry* pChild = snapshot->Find(txs[1].GetHash());
+    BOOST_REQUIRE(pChild);
+    BOOST_CHECK_EQUAL(pChild->entry.GetFee(), 2000LL);
+    BOOST_CHECK_EQUAL(pChild->entry.GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(pChild->entry.GetCountWithDescendants(), 2);
+    BOOST_CHECK(pChild->vParents == std::vector<uint256>(1, txs[0].GetHash()));
+    BOOST_CHECK(pChild->vChildren == std::vector<uint256>(1, txs[2].GetHash()));
+    BOOST_CHECK(!snapshot->Find(txs[0].vin[0].prevout.hash));
+
+    std::vector<const CTxMemPoolSnapshot::Entry*> vAncestors = snapshot->GetAncestors(txs[2].GetHash());
+    BOOST_CHECK_EQUAL(vAncestors.size(), 2);
+    BOOST_CHECK(vAncestors[0] == snapshot->Find(std::min(txs[0].GetHash(), txs[1].GetHash())));
+    BOOST_CHECK(vAncestors[1] == snapshot->Find(std::max(txs[0].GetHash(), txs[1].GetHash())));
+    BOOST_CHECK_EQUAL(snapshot->GetDescendants(txs[0].GetHash()).size(), 2);
+    BOOST_CHECK_EQUAL(snapshot->GetDescendants(txs[2].GetHash()).size(), 0);
+    BOOST_CHECK_EQUAL(snapshot->GetAncestors(txs[3].GetHash()).size(), 0);
+
+    // Changes of modified fees are seen by the next snapshot only
+    pool.PrioritiseTransaction(txs[2].GetHash(), txs[2].GetHash().ToString(), 0, 500LL);
+    std::shared_ptr<const CTxMemPoolSnapshot> prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL(snapshot->Find(txs[0].GetHash())->entry.GetModFeesWithDescendants(), 6000LL);
+    BOOST_CHECK_EQUAL(prioritised->Find(txs[0].GetHash())->entry.GetModFeesWithDescendants(), 6500LL);
+
+    // Removals too, while the older snapshots stay intact
+    std::list<CTransaction> removed;
+    pool.removeRecursive(txs[1], removed);
+    std::shared_ptr<const CTxMemPoolSnapshot> trimmed = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(trimmed->size(), 2);
+    BOOST_CHECK(!trimmed->Find(txs[2].GetHash()));
+    BOOST_CHECK(trimmed->Find(txs[0].GetHash())->vChildren.empty());
+    BOOST_CHECK_EQUAL(prioritised->size(), 4);
+    BOOST_CHECK_EQUAL(prioritised->GetDescendants(txs[0].GetHash()).size(), 2);
+
+    // Within the snapshot interval readers share the last snapshot, even
+    // after the pool changed
+    pool.setSnapshotInterval(std::numeric_limits<int64_t>::max());
+    pool.addUnchecked(txs[1].GetHash(), entry.Fee(2000LL).FromTx(txs[1], &pool));
+    BOOST_CHECK(pool.GetSnapshot() == trimmed);
+    BOOST_CHECK(!pool.GetSnapshot()->Find(txs[1].GetHash()));
+    pool.setSnapshotInterval(0);
+    BOOST_CHECK(pool.GetSnapshot()->Find(txs[1].GetHash()));
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->size(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "streams.h"
 #include "net.h"
 #include "chainparams.h"
+#include "random.h"
 
 using namespace std;
 
@@ -164,4 +165,180 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+static void AppendMessage(std::vector<char>& vData, const std::string& strCommand, const std::vector<char>& vPayload)
+{
+    CMessageHeader hdr(Params().MessageStart(), strCommand.c_str(), vPayload.size());
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    hdr.nChecksum = ReadLE32(hash.begin());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    vData.insert(vData.end(), ss.begin(), ss.end());
+    vData.insert(vData.end(), vPayload.begin(), vPayload.end());
+}
+
+BOOST_AUTO_TEST_CASE(cnode_receive_checksum)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CNode node(INVALID_SOCKET, CAddress(CService(ipv4Addr, 7777), NODE_NETWORK), "", true);
+
+    std::vector<char> vLarge(300000), vSmall(100), vEmpty;
+    GetRandBytes((unsigned char*)&vLarge[0], vLarge.size());
+    GetRandBytes((unsigned char*)&vSmall[0], vSmall.size());
+
+    // Twice, the second time with the large buffer coming from the pool
+    for (int nRound = 0; nRound < 2; nRound++) {
+        std::vector<char> vData;
+        AppendMessage(vData, "block", vLarge);
+        AppendMessage(vData, "ping", vEmpty);
+        AppendMessage(vData, "tx", vSmall);
+
+        // Arrive in odd-sized pieces that split headers and data
+        LOCK(node.cs_vRecvMsg);
+        for (size_t nPos = 0; nPos < vData.size(); nPos += 997)
+            BOOST_CHECK(node.ReceiveMsgBytes(&vData[nPos], std::min<size_t>(997, vData.size() - nPos)));
+
+        BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 3U);
+        const std::vector<char>* vPayloads[] = {&vLarge, &vEmpty, &vSmall};
+        for (size_t i = 0; i < 3; i++) {
+            const CNetMessage& msg = node.vRecvMsg[i];
+            BOOST_CHECK(msg.complete());
+            BOOST_CHECK(std::vector<char>(msg.vRecv.begin(), msg.vRecv.end()) == *vPayloads[i]);
+            BOOST_CHECK(msg.GetMessageHash() == Hash(vPayloads[i]->begin(), vPayloads[i]->end()));
+            BOOST_CHECK_EQUAL(ReadLE32(msg.GetMessageHash().begin()), msg.hdr.nChecksum);
+        }
+        node.vRecvMsg.clear();
+    }
+}
+
+static CTxAnnounceQueue::Entry AnnounceEntry(const uint256& hash, int64_t nTime)
+{
+    CTxAnnounceQueue::Entry entry;
+    entry.hash = hash;
+    entry.nFeePerK = 1000;
+    entry.nTime = nTime;
+    return entry;
+}
+
+BOOST_AUTO_TEST_CASE(tx_announce_queue)
+{
+    CTxAnnounceQueue queue;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 10; i++)
+        vHashes.push_back(GetRandHash());
+
+    // Pushed transactions wait until they are taken and appended in order
+    uint64_t nCursorA = queue.End();
+    for (int i = 0; i < 5; i++)
+        queue.Push(vHashes[i]);
+    std::vector<uint256> vPending;
+    queue.TakePending(vPending);
+    BOOST_CHECK(vPending == std::vector<uint256>(vHashes.begin(), vHashes.begin() + 5));
+    queue.TakePending(vPending);
+    BOOST_CHECK(vPending.empty());
+
+    std::vector<CTxAnnounceQueue::Entry> vEntries;
+    for (int i = 0; i < 5; i++)
+        vEntries.push_back(AnnounceEntry(vHashes[i], 1000));
+    queue.Append(vEntries, 1000);
+    uint64_t nCursorB = queue.End();
+    BOOST_CHECK_EQUAL(nCursorB, 5U);
+
+    // Each reader walks from its own cursor, at most nMax entries at a time
+    std::vector<CTxAnnounceQueue::Entry> vRead;
+    queue.Read(nCursorA, 3, vRead);
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+    BOOST_CHECK_EQUAL(nCursorA, 3U);
+    queue.Read(nCursorA, 3, vRead);
+    BOOST_CHECK_EQUAL(vRead.size(), 5U);
+    BOOST_CHECK_EQUAL(nCursorA, 5U);
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK(vRead[i].hash == vHashes[i]);
+    vRead.clear();
+    queue.Read(nCursorB, 3, vRead);
+    BOOST_CHECK(vRead.empty());
+
+    // Expired entries are dropped, and a cursor behind them skips ahead
+    vEntries.clear();
+    for (int i = 5; i < 10; i++)
+        vEntries.push_back(AnnounceEntry(vHashes[i], 1000 + TX_ANNOUNCE_EXPIRY + 1));
+    queue.Append(vEntries, 1000 + TX_ANNOUNCE_EXPIRY + 1);
+    BOOST_CHECK_EQUAL(queue.End(), 10U);
+    uint64_t nCursorC = 2;
+    queue.Read(nCursorC, 100, vRead);
+    BOOST_CHECK_EQUAL(vRead.size(), 5U);
+    BOOST_CHECK_EQUAL(nCursorC, 10U);
+    BOOST_CHECK(vRead[0].hash == vHashes[5]);
+    queue.Read(nCursorB, 100, vRead);
+    BOOST_CHECK_EQUAL(vRead.size(), 10U);
+    BOOST_CHECK_EQUAL(nCursorB, 10U);
+}
+
+#ifndef WIN32
+/** Read whatever is available on the socket */
+static void ReadAvailable(SOCKET hSocket, std::vector<char>& vData)
+{
+    char pchBuf[0x10000];
+    ssize_t nBytes;
+    while ((nBytes = recv(hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT)) > 0)
+        vData.insert(vData.end(), pchBuf, pchBuf + nBytes);
+}
+
+BOOST_AUTO_TEST_CASE(cnode_send_shared_messages)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+
+    std::vector<char> vLarge(1000000);
+    GetRandBytes((unsigned char*)&vLarge[0], vLarge.size());
+    CSerializeDataRef msgLarge = (CNetMessageBuilder("block", PROTOCOL_VERSION) << vLarge).Finish();
+    CSerializeDataRef msgSmall = (CNetMessageBuilder("ping", PROTOCOL_VERSION) << (uint64_t)42).Finish();
+
+    // The builder produces the same bytes as pushing through ssSend
+    std::vector<char> vExpected;
+    AppendMessage(vExpected, "ping", std::vector<char>(msgSmall->begin() + CMessageHeader::HEADER_SIZE, msgSmall->end()));
+    BOOST_CHECK(std::vector<char>(msgSmall->begin(), msgSmall->end()) == vExpected);
+    std::vector<char> vLargePayload(msgLarge->begin() + CMessageHeader::HEADER_SIZE, msgLarge->end());
+    AppendMessage(vExpected, "block", vLargePayload);
+    AppendMessage(vExpected, "pong", std::vector<char>(msgSmall->begin() + CMessageHeader::HEADER_SIZE, msgSmall->end()));
+
+    int fds[2][2];
+    CNode* pnodes[2];
+    for (int i = 0; i < 2; i++) {
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]) == 0);
+        pnodes[i] = new CNode(fds[i][0], addr, "", true);
+    }
+
+    // The same buffers are queued to both peers without copies
+    for (int i = 0; i < 2; i++) {
+        pnodes[i]->PushSerializedMessage("ping", msgSmall);
+        pnodes[i]->PushSerializedMessage("block", msgLarge);
+        pnodes[i]->PushMessage("pong", (uint64_t)42);
+    }
+    BOOST_CHECK(msgLarge.use_count() > 1);
+
+    // Drain the send queues in as many writes as the socket buffers need
+    std::vector<char> vReceived[2];
+    for (int i = 0; i < 2; i++) {
+        while (true) {
+            ReadAvailable(fds[i][1], vReceived[i]);
+            LOCK(pnodes[i]->cs_vSend);
+            if (pnodes[i]->vSendMsg.empty())
+                break;
+            SocketSendData(pnodes[i]);
+        }
+        ReadAvailable(fds[i][1], vReceived[i]);
+        BOOST_CHECK_EQUAL(pnodes[i]->nSendSize, 0U);
+        BOOST_CHECK(vReceived[i] == vExpected);
+    }
+    BOOST_CHECK_EQUAL(msgLarge.use_count(), 1);
+
+    for (int i = 0; i < 2; i++) {
+        delete pnodes[i];
+        close(fds[i][1]);
+    }
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
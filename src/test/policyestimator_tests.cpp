@@ -222,4 +222,46 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(EstimateCachedAcrossNewTx)
+{
+    CBlockPolicyEstimator estimator(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    // Every block confirms the transactions that entered at the height before
+    // it, so there is enough data to estimate low targets
+    unsigned int blocknum = 0;
+    while (blocknum < 100) {
+        std::vector<CTxMemPoolEntry> block;
+        for (int j = 0; j < 10; j++) {
+            tx.vin[0].prevout.n = 100 * blocknum + j;
+            CTxMemPoolEntry txEntry = entry.Fee(20000).Height(blocknum).HadNoDependencies(true).FromTx(tx);
+            estimator.processTransaction(txEntry, true);
+            block.push_back(txEntry);
+        }
+        estimator.processBlock(++blocknum, block, true);
+        for (unsigned int i = 0; i < block.size(); i++)
+            estimator.removeTx(block[i].GetTx().GetHash());
+    }
+
+    CFeeRate est = estimator.estimateFee(2);
+    BOOST_CHECK(est > CFeeRate(0));
+    BOOST_CHECK(estimator.IsFeeEstimateCached(2));
+
+    // A transaction entering at the current height counts against no target
+    tx.vin[0].prevout.n = 100 * blocknum;
+    CTxMemPoolEntry txEntry = entry.Fee(20000).Height(blocknum).HadNoDependencies(true).FromTx(tx);
+    estimator.processTransaction(txEntry, true);
+    BOOST_CHECK(estimator.IsFeeEstimateCached(2));
+    BOOST_CHECK(estimator.estimateFee(2) == est);
+
+    // The next block makes it count against the targets
+    std::vector<CTxMemPoolEntry> empty;
+    estimator.processBlock(++blocknum, empty, true);
+    BOOST_CHECK(!estimator.IsFeeEstimateCached(2));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "index/txindex.h"
+#include "main.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestChain100Setup)
+
+static bool HaveTxIndexEntry(const uint256& txid)
+{
+    CDiskTxPos pos;
+    return pblocktree->ReadTxIndex(txid, pos);
+}
+
+BOOST_AUTO_TEST_CASE(txindex_initial_sync)
+{
+    CTxIndex txindex;
+
+    // Nothing is indexed until the index has been started
+    BOOST_CHECK(!HaveTxIndexEntry(coinbaseTxns[0].GetHash()));
+    BOOST_CHECK(!txindex.IsSynced());
+
+    BOOST_REQUIRE(txindex.Start());
+
+    // Let the background thread catch up with the existing chain
+    int64_t nTimeout = GetTimeMillis() + 10 * 1000;
+    while (!txindex.IsSynced()) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(100);
+    }
+
+    // Every transaction is located through the index
+    fTxIndex = true;
+    BOOST_FOREACH(const CTransaction& tx, coinbaseTxns) {
+        CTransaction txOut;
+        uint256 hashBlock;
+        BOOST_CHECK(GetTransaction(tx.GetHash(), txOut, Params().GetConsensus(), hashBlock, false));
+        BOOST_CHECK(txOut.GetHash() == tx.GetHash());
+        BOOST_CHECK(!hashBlock.IsNull());
+    }
+
+    // New blocks are picked up through tip notifications
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CMutableTransaction> noTxns;
+    CBlock block = CreateAndProcessBlock(noTxns, scriptPubKey);
+    nTimeout = GetTimeMillis() + 10 * 1000;
+    while (!HaveTxIndexEntry(block.vtx[0].GetHash())) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(100);
+    }
+    fTxIndex = false;
+
+    txindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
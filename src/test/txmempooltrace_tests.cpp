@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txmempooltrace.h"
+#include "clientversion.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <stdio.h>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txmempooltrace_tests, BasicTestingSetup)
+
+static CMempoolTraceRecord MakeTxRecord(uint32_t nHeight)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1000;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    CMempoolTraceRecord record;
+    record.nType = MEMPOOL_TRACE_TX;
+    record.nTime = 1500000000 + nHeight;
+    record.nHeight = nHeight;
+    record.tx = tx;
+    record.nFee = 2000;
+    record.dPriority = 1.5;
+    record.inChainInputValue = 5000;
+    record.fSpendsCoinbase = true;
+    record.nSigOpsCost = 4;
+    return record;
+}
+
+/** A temporary file holding a trace header, to append records to */
+static FILE* StartTrace()
+{
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    file << CMempoolTraceHeader(300000000, 72 * 60 * 60);
+    return file.release();
+}
+
+BOOST_AUTO_TEST_CASE(mempooltrace_roundtrip)
+{
+    CAutoFile file(StartTrace(), SER_DISK, CLIENT_VERSION);
+    CMempoolTraceRecord txRecord = MakeTxRecord(10);
+    file << txRecord;
+
+    CMempoolTraceRecord block;
+    block.nType = MEMPOOL_TRACE_BLOCK;
+    block.nTime = 1500000100;
+    block.nHeight = 11;
+    block.vtx.push_back(txRecord.tx);
+    file << block;
+
+    CMempoolTraceRecord disconnect;
+    disconnect.nType = MEMPOOL_TRACE_DISCONNECT;
+    disconnect.nTime = 1500000200;
+    disconnect.nHeight = 10;
+    disconnect.vHashUpdate.push_back(txRecord.tx.GetHash());
+    file << disconnect;
+
+    rewind(file.Get());
+    CMempoolTraceHeader header;
+    std::vector<CMempoolTraceRecord> vRecords;
+    ReadMempoolTrace(file, header, vRecords);
+
+    BOOST_CHECK_EQUAL(header.nMaxMempoolSize, 300000000);
+    BOOST_CHECK_EQUAL(header.nMempoolExpiry, 72 * 60 * 60);
+    BOOST_REQUIRE_EQUAL(vRecords.size(), 3U);
+
+    const CMempoolTraceRecord& tx = vRecords[0];
+    BOOST_CHECK_EQUAL(tx.nType, MEMPOOL_TRACE_TX);
+    BOOST_CHECK_EQUAL(tx.nTime, txRecord.nTime);
+    BOOST_CHECK_EQUAL(tx.nHeight, 10U);
+    BOOST_CHECK(tx.tx == txRecord.tx);
+    BOOST_CHECK_EQUAL(tx.nFee, 2000);
+    BOOST_CHECK_EQUAL(tx.dPriority, 1.5);
+    BOOST_CHECK_EQUAL(tx.inChainInputValue, 5000);
+    BOOST_CHECK(tx.fSpendsCoinbase);
+    BOOST_CHECK_EQUAL(tx.nSigOpsCost, 4);
+
+    BOOST_CHECK_EQUAL(vRecords[1].nType, MEMPOOL_TRACE_BLOCK);
+    BOOST_CHECK_EQUAL(vRecords[1].nHeight, 11U);
+    BOOST_REQUIRE_EQUAL(vRecords[1].vtx.size(), 1U);
+    BOOST_CHECK(vRecords[1].vtx[0] == txRecord.tx);
+
+    BOOST_CHECK_EQUAL(vRecords[2].nType, MEMPOOL_TRACE_DISCONNECT);
+    BOOST_CHECK_EQUAL(vRecords[2].nTime, 1500000200);
+    BOOST_REQUIRE_EQUAL(vRecords[2].vHashUpdate.size(), 1U);
+    BOOST_CHECK(vRecords[2].vHashUpdate[0] == txRecord.tx.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(mempooltrace_truncated)
+{
+    // The node stopped in the middle of writing the second record
+    CAutoFile file(StartTrace(), SER_DISK, CLIENT_VERSION);
+    file << MakeTxRecord(10);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << MakeTxRecord(11);
+    file.write(&ss[0], ss.size() / 2);
+
+    rewind(file.Get());
+    CMempoolTraceHeader header;
+    std::vector<CMempoolTraceRecord> vRecords;
+    ReadMempoolTrace(file, header, vRecords);
+    BOOST_REQUIRE_EQUAL(vRecords.size(), 1U);
+    BOOST_CHECK_EQUAL(vRecords[0].nHeight, 10U);
+}
+
+static bool IsSecondRecordError(const std::runtime_error& e)
+{
+    return std::string(e.what()).find("record 1:") == 0;
+}
+
+BOOST_AUTO_TEST_CASE(mempooltrace_unknown_type)
+{
+    // A record of an unknown type followed by a valid one
+    CAutoFile file(StartTrace(), SER_DISK, CLIENT_VERSION);
+    file << MakeTxRecord(10);
+    file << (uint8_t)9 << (int64_t)1500000000 << (uint32_t)10;
+    file << MakeTxRecord(11);
+
+    rewind(file.Get());
+    CMempoolTraceHeader header;
+    std::vector<CMempoolTraceRecord> vRecords;
+    BOOST_CHECK_EXCEPTION(ReadMempoolTrace(file, header, vRecords), std::runtime_error, IsSecondRecordError);
+}
+
+BOOST_AUTO_TEST_CASE(mempooltrace_bad_header)
+{
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    file << MEMPOOL_TRACE_MAGIC << (uint32_t)(MEMPOOL_TRACE_VERSION + 1) << (int64_t)0 << (int64_t)0;
+
+    rewind(file.Get());
+    CMempoolTraceHeader header;
+    std::vector<CMempoolTraceRecord> vRecords;
+    BOOST_CHECK_THROW(ReadMempoolTrace(file, header, vRecords), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txorphanage_tests, BasicTestingSetup)
+
+/** A transaction spending the given outpoints, with nOutputs outputs */
+static CTransaction MakeTx(const std::vector<COutPoint>& vPrevouts, unsigned int nOutputs = 1)
+{
+    CMutableTransaction tx;
+    for (size_t i = 0; i < vPrevouts.size(); i++)
+        tx.vin.push_back(CTxIn(vPrevouts[i]));
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = i + 1;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return tx;
+}
+
+static CTransaction MakeTx(const COutPoint& prevout, unsigned int nOutputs = 1)
+{
+    return MakeTx(std::vector<COutPoint>(1, prevout), nOutputs);
+}
+
+BOOST_AUTO_TEST_CASE(txorphanage_peers_and_expiry)
+{
+    CTxOrphanage orphanage;
+    std::vector<CTransaction> vTxs;
+    for (int i = 0; i < 10; i++) {
+        vTxs.push_back(MakeTx(COutPoint(GetRandHash(), 0)));
+        BOOST_CHECK(orphanage.AddTx(vTxs.back(), i % 2, 1000 + i));
+    }
+    BOOST_CHECK(!orphanage.AddTx(vTxs[0], 3, 2000));
+    orphanage.SanityCheck();
+    BOOST_CHECK_EQUAL(orphanage.Size(), 10U);
+    BOOST_CHECK_EQUAL(orphanage.Count(0), 5U);
+    BOOST_CHECK_EQUAL(orphanage.Count(1), 5U);
+    BOOST_CHECK_EQUAL(orphanage.Weight(0), 5 * (size_t)GetTransactionWeight(vTxs[0]));
+
+    // Expiry erases the oldest ones only
+    BOOST_CHECK_EQUAL(orphanage.EraseExpired(999), 0);
+    BOOST_CHECK_EQUAL(orphanage.EraseExpired(1003), 4);
+    orphanage.SanityCheck();
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK_EQUAL(orphanage.HaveTx(vTxs[i].GetHash()), i > 3);
+    BOOST_CHECK_EQUAL(orphanage.Count(0), 3U);
+
+    // Disconnecting peers
+    BOOST_CHECK_EQUAL(orphanage.EraseForPeer(1), 3);
+    BOOST_CHECK_EQUAL(orphanage.EraseForPeer(1), 0);
+    orphanage.SanityCheck();
+    BOOST_CHECK_EQUAL(orphanage.Count(1), 0U);
+    BOOST_CHECK_EQUAL(orphanage.Weight(1), 0U);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 3U);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(vTxs[4].GetHash()), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(vTxs[4].GetHash()), 0);
+    orphanage.SanityCheck();
+    BOOST_CHECK_EQUAL(orphanage.Size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(txorphanage_limit)
+{
+    // The peer holding the most orphans is evicted from first
+    CTxOrphanage orphanage;
+    for (int i = 0; i < 30; i++)
+        orphanage.AddTx(MakeTx(COutPoint(GetRandHash(), 0)), 1, 1000);
+    for (int i = 0; i < 5; i++) {
+        orphanage.AddTx(MakeTx(COutPoint(GetRandHash(), 0)), 2, 1000);
+        orphanage.AddTx(MakeTx(COutPoint(GetRandHash(), 0)), 3, 1000);
+    }
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(40), 0U);
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(20), 20U);
+    orphanage.SanityCheck();
+    BOOST_CHECK_EQUAL(orphanage.Count(1), 10U);
+    BOOST_CHECK_EQUAL(orphanage.Count(2), 5U);
+    BOOST_CHECK_EQUAL(orphanage.Count(3), 5U);
+
+    // Then all of them in turn
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(12), 8U);
+    BOOST_CHECK_EQUAL(orphanage.Count(1), 4U);
+    BOOST_CHECK_EQUAL(orphanage.Count(2), 4U);
+    BOOST_CHECK_EQUAL(orphanage.Count(3), 4U);
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(0), 12U);
+    orphanage.SanityCheck();
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txorphanage_children)
+{
+    CTxOrphanage orphanage;
+    const CTransaction parent = MakeTx(COutPoint(GetRandHash(), 0), 3);
+    const uint256 hashParent = parent.GetHash();
+
+    // Children spending one or several outputs of the parent, arriving in this order
+    std::vector<CTransaction> vChildren;
+    vChildren.push_back(MakeTx(COutPoint(hashParent, 2)));
+    std::vector<COutPoint> vPrevouts;
+    vPrevouts.push_back(COutPoint(hashParent, 0));
+    vPrevouts.push_back(COutPoint(hashParent, 1));
+    vPrevouts.push_back(COutPoint(GetRandHash(), 0));
+    vChildren.push_back(MakeTx(vPrevouts));
+    vChildren.push_back(MakeTx(COutPoint(hashParent, 0)));
+    for (size_t i = 0; i < vChildren.size(); i++)
+        orphanage.AddTx(vChildren[i], i, 1000);
+    // A grandchild and an unrelated orphan
+    const CTransaction grandchild = MakeTx(COutPoint(vChildren[0].GetHash(), 0));
+    orphanage.AddTx(grandchild, 0, 1000);
+    orphanage.AddTx(MakeTx(COutPoint(GetRandHash(), 0)), 0, 1000);
+
+    std::vector<const COrphanTx*> vFound = orphanage.GetChildren(hashParent);
+    BOOST_CHECK_EQUAL(vFound.size(), vChildren.size());
+    for (size_t i = 0; i < vFound.size() && i < vChildren.size(); i++) {
+        BOOST_CHECK(vFound[i]->hash == vChildren[i].GetHash());
+        BOOST_CHECK_EQUAL(vFound[i]->fromPeer, (NodeId)i);
+    }
+    vFound = orphanage.GetChildren(vChildren[0].GetHash());
+    BOOST_CHECK_EQUAL(vFound.size(), 1U);
+    BOOST_CHECK(vFound.size() == 1 && vFound[0]->hash == grandchild.GetHash());
+    BOOST_CHECK(orphanage.GetChildren(grandchild.GetHash()).empty());
+
+    // A block spending the parent's first output erases the orphans conflicting with it
+    CBlock block;
+    block.vtx.push_back(MakeTx(COutPoint(hashParent, 0)));
+    BOOST_CHECK_EQUAL(orphanage.EraseForBlock(block), 2);
+    orphanage.SanityCheck();
+    BOOST_CHECK(!orphanage.HaveTx(vChildren[1].GetHash()));
+    BOOST_CHECK(!orphanage.HaveTx(vChildren[2].GetHash()));
+    BOOST_CHECK_EQUAL(orphanage.GetChildren(hashParent).size(), 1U);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
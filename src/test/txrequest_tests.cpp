@@ -0,0 +1,177 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrequest.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txrequest_tests, BasicTestingSetup)
+
+//! Fake clock, in microseconds
+static const int64_t SECOND = 1000000;
+
+static std::vector<uint256> Requestable(CTxRequestTracker& tracker, NodeId peer, int64_t nNow)
+{
+    std::vector<uint256> vTxids = tracker.GetRequestable(peer, nNow);
+    tracker.SanityCheck();
+    return vTxids;
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_delay_and_timeout)
+{
+    CTxRequestTracker tracker;
+    const uint256 txid = GetRandHash();
+    int64_t nNow = 1000 * SECOND;
+
+    // A non-preferred peer's announcement waits for its request time
+    tracker.ReceivedInv(1, txid, false, nNow + 2 * SECOND);
+    BOOST_CHECK(Requestable(tracker, 1, nNow).empty());
+    BOOST_CHECK(Requestable(tracker, 1, nNow + 2 * SECOND) == std::vector<uint256>(1, txid));
+    nNow += 2 * SECOND;
+
+    // A repeated announcement changes nothing
+    tracker.ReceivedInv(1, txid, false, nNow + 100 * SECOND);
+    BOOST_CHECK_EQUAL(tracker.Count(1), 1U);
+
+    tracker.RequestedTx(1, txid, nNow + 60 * SECOND);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(1), 1U);
+    BOOST_CHECK(Requestable(tracker, 1, nNow).empty());
+
+    // Another peer announces it meanwhile, and gets it requested once the first request times out
+    tracker.ReceivedInv(2, txid, false, nNow + 2 * SECOND);
+    BOOST_CHECK(Requestable(tracker, 2, nNow + 59 * SECOND).empty());
+    BOOST_CHECK(Requestable(tracker, 2, nNow + 60 * SECOND) == std::vector<uint256>(1, txid));
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(1), 0U);
+    BOOST_CHECK(Requestable(tracker, 1, nNow + 60 * SECOND).empty());
+
+    // Once the second peer responds without it, no one is left to ask
+    tracker.RequestedTx(2, txid, nNow + 120 * SECOND);
+    tracker.ReceivedResponse(2, txid);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(1), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(2), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_preferred_peers)
+{
+    CTxRequestTracker tracker;
+    const uint256 txid = GetRandHash();
+    int64_t nNow = 1000 * SECOND;
+
+    // A preferred peer announcing later is still asked first
+    tracker.ReceivedInv(1, txid, false, nNow);
+    tracker.ReceivedInv(2, txid, true, nNow);
+    tracker.ReceivedInv(3, txid, true, nNow);
+    BOOST_CHECK(Requestable(tracker, 1, nNow).empty());
+    BOOST_CHECK(Requestable(tracker, 2, nNow) == std::vector<uint256>(1, txid));
+    BOOST_CHECK(Requestable(tracker, 3, nNow).empty());
+
+    // A notfound moves on to the next peer straight away
+    tracker.RequestedTx(2, txid, nNow + 60 * SECOND);
+    tracker.ReceivedResponse(2, txid);
+    BOOST_CHECK(Requestable(tracker, 3, nNow) == std::vector<uint256>(1, txid));
+
+    // So does the disconnection of the peer it was requested from
+    tracker.RequestedTx(3, txid, nNow + 60 * SECOND);
+    tracker.DisconnectedPeer(3);
+    BOOST_CHECK(Requestable(tracker, 1, nNow) == std::vector<uint256>(1, txid));
+
+    // Requesting from a peer other than the chosen one is allowed
+    tracker.ReceivedInv(4, txid, false, nNow);
+    tracker.RequestedTx(4, txid, nNow + 60 * SECOND);
+    BOOST_CHECK(Requestable(tracker, 1, nNow).empty());
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(4), 1U);
+
+    // Once the transaction is received, all announcements are forgotten
+    tracker.ForgetTxHash(txid);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(4), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_disconnect_forgets_completed)
+{
+    CTxRequestTracker tracker;
+    const uint256 txid = uint256S("0x1");
+    int64_t nNow = 1000 * SECOND;
+
+    // Peer 2 answers notfound, so its completed announcement follows peer 1's
+    // in the by_peer index, and goes when peer 1 disconnects with the request
+    tracker.ReceivedInv(2, txid, true, nNow);
+    tracker.ReceivedInv(1, txid, true, nNow);
+    tracker.RequestedTx(2, txid, nNow + 60 * SECOND);
+    tracker.ReceivedResponse(2, txid);
+    tracker.RequestedTx(1, txid, nNow + 60 * SECOND);
+    tracker.DisconnectedPeer(1);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(1), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(2), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_announcement_order)
+{
+    CTxRequestTracker tracker;
+    int64_t nNow = 1000 * SECOND;
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 10; i++) {
+        vTxids.push_back(GetRandHash());
+        tracker.ReceivedInv(1, vTxids.back(), true, nNow);
+    }
+    BOOST_CHECK(Requestable(tracker, 1, nNow) == vTxids);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_random)
+{
+    // Random operations on a few peers and transactions, checking the invariants throughout
+    CTxRequestTracker tracker;
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 8; i++)
+        vTxids.push_back(GetRandHash());
+    int64_t nNow = 1000 * SECOND;
+
+    for (int i = 0; i < 20000; i++) {
+        NodeId peer = insecure_rand() % 6;
+        const uint256& txid = vTxids[insecure_rand() % vTxids.size()];
+        switch (insecure_rand() % 7) {
+        case 0:
+        case 1:
+            tracker.ReceivedInv(peer, txid, insecure_rand() % 2, nNow + (insecure_rand() % 3) * SECOND);
+            break;
+        case 2: {
+            std::vector<uint256> vRequestable = tracker.GetRequestable(peer, nNow);
+            if (!vRequestable.empty())
+                tracker.RequestedTx(peer, vRequestable[0], nNow + (insecure_rand() % 10) * SECOND);
+            break;
+        }
+        case 3:
+            tracker.ReceivedResponse(peer, txid);
+            break;
+        case 4:
+            if (insecure_rand() % 10 == 0)
+                tracker.ForgetTxHash(txid);
+            else
+                nNow += (insecure_rand() % 2) * SECOND;
+            break;
+        case 5:
+            if (insecure_rand() % 10 == 0)
+                tracker.DisconnectedPeer(peer);
+            break;
+        case 6:
+            tracker.RequestedTx(peer, txid, nNow + (insecure_rand() % 10) * SECOND);
+            break;
+        }
+        tracker.SanityCheck();
+    }
+
+    for (NodeId peer = 0; peer < 6; peer++)
+        tracker.DisconnectedPeer(peer);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
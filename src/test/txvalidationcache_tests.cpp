@@ -83,4 +83,70 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    // Transactions with many inputs have their scripts checked on the
+    // script-checking threads, and must be accepted or rejected exactly as
+    // they would be serially.
+    BOOST_CHECK(nScriptCheckThreads > 0);
+    const size_t nInputs = 2 * MIN_PARALLEL_SCRIPT_CHECK_INPUTS;
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Split a mature coinbase into enough outputs
+    CMutableTransaction fanout;
+    fanout.vin.resize(1);
+    fanout.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    fanout.vin[0].prevout.n = 0;
+    fanout.vout.resize(nInputs);
+    for (size_t i = 0; i < nInputs; i++) {
+        fanout.vout[i].nValue = (coinbaseTxns[0].vout[0].nValue - CENT) / nInputs;
+        fanout.vout[i].scriptPubKey = scriptPubKey;
+    }
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, fanout, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    fanout.vin[0].scriptSig << vchSig;
+    BOOST_CHECK(ToMemPool(fanout));
+
+    // Spend all of them at once
+    CMutableTransaction spend;
+    spend.vin.resize(nInputs);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = fanout.vout[0].nValue * nInputs - CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    for (size_t i = 0; i < nInputs; i++) {
+        spend.vin[i].prevout.hash = fanout.GetHash();
+        spend.vin[i].prevout.n = i;
+    }
+    for (size_t i = 0; i < nInputs; i++) {
+        hash = SignatureHash(scriptPubKey, spend, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        vchSig.clear();
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[i].scriptSig = CScript() << vchSig;
+    }
+
+    // A bad signature on one input is rejected
+    CMutableTransaction badSpend = spend;
+    hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    vchSig.clear();
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    badSpend.vin[nInputs - 1].scriptSig = CScript() << vchSig;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, badSpend, false, NULL, true, 0));
+        BOOST_CHECK_EQUAL(state.GetRejectCode(), REJECT_INVALID);
+        BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+    }
+    BOOST_CHECK(!mempool.exists(badSpend.GetHash()));
+
+    BOOST_CHECK(ToMemPool(spend));
+    BOOST_CHECK(mempool.exists(spend.GetHash()));
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
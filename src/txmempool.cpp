@@ -44,6 +44,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+    nEpochMarker = 0;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -83,39 +84,48 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    std::vector<txiter>& stage = StartWalk();
+    std::vector<txiter> vAllDescendants;
+    BOOST_FOREACH(const txiter childEntry, GetMemPoolChildren(updateIt)) {
+        Visited(childEntry);
+        stage.push_back(childEntry);
+    }
 
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
+    while (!stage.empty()) {
+        const txiter cit = stage.back();
+        stage.pop_back();
+        vAllDescendants.push_back(cit);
         const setEntries &setChildren = GetMemPoolChildren(cit);
         BOOST_FOREACH(const txiter childEntry, setChildren) {
+            if (Visited(childEntry))
+                continue;
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
+                vAllDescendants.push_back(childEntry);
                 BOOST_FOREACH(const txiter cacheEntry, cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!Visited(cacheEntry))
+                        vAllDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stage.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    BOOST_FOREACH(txiter cit, setAllDescendants) {
+    std::vector<txiter>& vCached = cachedDescendants[updateIt];
+    BOOST_FOREACH(txiter cit, vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            vCached.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
@@ -131,6 +141,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     LOCK(cs);
+    nSnapshotSequence++;
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
@@ -173,18 +184,23 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
+    std::vector<txiter>& stage = StartWalk();
     const CTransaction &tx = entry.GetTx();
 
+    // Ancestors already in setAncestors are not walked again
+    BOOST_FOREACH(const txiter &ancestorIt, setAncestors)
+        Visited(ancestorIt);
+    const size_t nKnown = setAncestors.size();
+
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
         // GetMemPoolParents() is only valid for entries in the mempool, so we
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
-                if (parentHashes.size() + 1 > limitAncestorCount) {
+            if (piter != mapTx.end() && !Visited(piter)) {
+                stage.push_back(piter);
+                if (stage.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
                 }
@@ -194,16 +210,21 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        BOOST_FOREACH(const txiter &piter, GetMemPoolParents(it)) {
+            if (!Visited(piter))
+                stage.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
+    size_t nAncestors = 0;
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+    while (!stage.empty()) {
+        txiter stageit = stage.back();
+        stage.pop_back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        nAncestors++;
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -220,10 +241,10 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!Visited(phash)) {
+                stage.push_back(phash);
             }
-            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            if (stage.size() + nKnown + nAncestors + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
@@ -349,7 +370,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nEpoch(0), nSnapshotSequence(0), nSnapshotInterval(0)
 {
     _clear(); //lock free clear
 
@@ -441,6 +462,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
+    nSnapshotSequence++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
 
@@ -471,6 +493,7 @@ void CTxMemPool::removeUnchecked(txiter it)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    nSnapshotSequence++;
     minerPolicyEstimator->removeTx(hash);
 }
 
@@ -482,22 +505,25 @@ void CTxMemPool::removeUnchecked(txiter it)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
-    }
+    std::vector<txiter>& stage = StartWalk();
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
-    // already been walked, or will be walked in this iteration).
+    // already been walked, or will be walked in this iteration). Only look them up
+    // if there are any.
+    const bool fCheckKnown = !setDescendants.empty();
+    if (fCheckKnown && setDescendants.count(entryit))
+        return;
+    Visited(entryit);
+    stage.push_back(entryit);
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         BOOST_FOREACH(const txiter &childiter, setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!Visited(childiter) && !(fCheckKnown && setDescendants.count(childiter))) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -573,24 +599,6 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
     }
 }
 
-void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed)
-{
-    // Remove transactions which depend on inputs of tx, recursively
-    list<CTransaction> result;
-    LOCK(cs);
-    BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-        auto it = mapNextTx.find(txin.prevout);
-        if (it != mapNextTx.end()) {
-            const CTransaction &txConflict = *it->second;
-            if (txConflict != tx)
-            {
-                removeRecursive(txConflict, removed);
-                ClearPrioritisation(txConflict.GetHash());
-            }
-        }
-    }
-}
-
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
@@ -598,26 +606,43 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
                                 std::list<CTransaction>& conflicts, bool fCurrentEstimate)
 {
     LOCK(cs);
+    // Find the block's transactions in the mempool, and the in-mempool
+    // transactions spending the same inputs, in one pass over the block
     std::vector<CTxMemPoolEntry> entries;
+    setEntries setMined;
+    setEntries setConflicts;
     BOOST_FOREACH(const CTransaction& tx, vtx)
     {
-        uint256 hash = tx.GetHash();
-
-        indexed_transaction_set::iterator i = mapTx.find(hash);
-        if (i != mapTx.end())
-            entries.push_back(*i);
-    }
-    BOOST_FOREACH(const CTransaction& tx, vtx)
-    {
-        txiter it = mapTx.find(tx.GetHash());
+        const uint256 hash = tx.GetHash();
+        txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true);
+            entries.push_back(*it);
+            setMined.insert(it);
         }
-        removeConflicts(tx, conflicts);
-        ClearPrioritisation(tx.GetHash());
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            auto itConflict = mapNextTx.find(txin.prevout);
+            if (itConflict == mapNextTx.end() || *itConflict->second == tx)
+                continue;
+            txiter conflictit = mapTx.find(itConflict->second->GetHash());
+            assert(conflictit != mapTx.end());
+            setConflicts.insert(conflictit);
+            mapDeltas.erase(conflictit->GetTx().GetHash());
+        }
+        mapDeltas.erase(hash);
     }
+
+    // The conflicts are removed with all their descendants
+    setEntries stage;
+    BOOST_FOREACH(txiter it, setConflicts) {
+        if (!setMined.count(it))
+            CalculateDescendants(it, stage);
+    }
+    BOOST_FOREACH(txiter it, stage) {
+        conflicts.push_back(it->GetTx());
+    }
+    stage.insert(setMined.begin(), setMined.end());
+    RemoveStagedBatch(stage, setMined);
+
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
     lastRollingFeeUpdate = GetTime();
@@ -635,6 +660,7 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++nSnapshotSequence;
 }
 
 void CTxMemPool::clear()
@@ -860,6 +886,116 @@ TxMempoolInfo CTxMemPool::info(const uint256& hash) const
     return TxMempoolInfo{i->GetSharedTx(), i->GetTime(), CFeeRate(i->GetFee(), i->GetTxSize())};
 }
 
+/** Whether snapshot can still be served, see CTxMemPool::GetSnapshot() */
+static bool IsSnapshotPublished(const std::shared_ptr<const CTxMemPoolSnapshot>& snapshot, uint64_t nSequence, int64_t nInterval)
+{
+    return snapshot && (snapshot->GetSequence() == nSequence || GetTimeMillis() - snapshot->GetTimeMillis() < nInterval);
+}
+
+std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    {
+        LOCK(csSnapshot);
+        if (IsSnapshotPublished(snapshot, nSnapshotSequence, nSnapshotInterval))
+            return snapshot;
+    }
+
+    LOCK(csSnapshotBuild);
+    {
+        // Another reader may have taken it while we waited
+        LOCK(csSnapshot);
+        if (IsSnapshotPublished(snapshot, nSnapshotSequence, nSnapshotInterval))
+            return snapshot;
+    }
+
+    std::shared_ptr<CTxMemPoolSnapshot> newSnapshot = std::make_shared<CTxMemPoolSnapshot>();
+    std::vector<CTxMemPoolSnapshot::Entry>& vEntries = newSnapshot->vEntries;
+    {
+        LOCK(cs);
+        newSnapshot->nSequence = nSnapshotSequence;
+        newSnapshot->nTimeMillis = GetTimeMillis();
+        std::vector<indexed_transaction_set::const_iterator> iters = GetSortedDepthAndScore();
+        vEntries.reserve(iters.size());
+        BOOST_FOREACH(txiter it, iters) {
+            vEntries.push_back(CTxMemPoolSnapshot::Entry(*it));
+            CTxMemPoolSnapshot::Entry& entry = vEntries.back();
+            const TxLinks& links = mapLinks.find(it)->second;
+            entry.vParents.reserve(links.parents.size());
+            BOOST_FOREACH(txiter parentIt, links.parents)
+                entry.vParents.push_back(parentIt->GetTx().GetHash());
+            entry.vChildren.reserve(links.children.size());
+            BOOST_FOREACH(txiter childIt, links.children)
+                entry.vChildren.push_back(childIt->GetTx().GetHash());
+        }
+    }
+    std::vector<uint32_t>& vByTxid = newSnapshot->vByTxid;
+    vByTxid.resize(vEntries.size());
+    for (uint32_t i = 0; i < vByTxid.size(); i++)
+        vByTxid[i] = i;
+    std::sort(vByTxid.begin(), vByTxid.end(), [&vEntries](uint32_t a, uint32_t b) {
+        return vEntries[a].GetHash() < vEntries[b].GetHash();
+    });
+
+    {
+        LOCK(csSnapshot);
+        snapshot = newSnapshot;
+    }
+    return newSnapshot;
+}
+
+const CTxMemPoolSnapshot::Entry* CTxMemPoolSnapshot::Find(const uint256& hash) const
+{
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(vByTxid.begin(), vByTxid.end(), hash, [this](uint32_t nPos, const uint256& hashFind) {
+        return vEntries[nPos].GetHash() < hashFind;
+    });
+    if (it == vByTxid.end() || vEntries[*it].GetHash() != hash)
+        return NULL;
+    return &vEntries[*it];
+}
+
+/** The entries reachable from hash through the links chosen by pLinks, excluding hash itself */
+static std::vector<const CTxMemPoolSnapshot::Entry*> WalkSnapshot(const CTxMemPoolSnapshot& snapshot, const uint256& hash,
+                                                                  std::vector<uint256> CTxMemPoolSnapshot::Entry::*pLinks)
+{
+    std::vector<const CTxMemPoolSnapshot::Entry*> vReached;
+    const CTxMemPoolSnapshot::Entry* pStart = snapshot.Find(hash);
+    if (!pStart)
+        return vReached;
+
+    // Entries are marked by their position
+    const CTxMemPoolSnapshot::Entry* pFirst = &snapshot.GetEntries()[0];
+    std::vector<bool> vSeen(snapshot.size(), false);
+    vSeen[pStart - pFirst] = true;
+    std::vector<const CTxMemPoolSnapshot::Entry*> vStack(1, pStart);
+    while (!vStack.empty()) {
+        const CTxMemPoolSnapshot::Entry* pEntry = vStack.back();
+        vStack.pop_back();
+        BOOST_FOREACH(const uint256& hashLink, pEntry->*pLinks) {
+            const CTxMemPoolSnapshot::Entry* pLink = snapshot.Find(hashLink);
+            assert(pLink);
+            if (vSeen[pLink - pFirst])
+                continue;
+            vSeen[pLink - pFirst] = true;
+            vReached.push_back(pLink);
+            vStack.push_back(pLink);
+        }
+    }
+    std::sort(vReached.begin(), vReached.end(), [](const CTxMemPoolSnapshot::Entry* a, const CTxMemPoolSnapshot::Entry* b) {
+        return a->GetHash() < b->GetHash();
+    });
+    return vReached;
+}
+
+std::vector<const CTxMemPoolSnapshot::Entry*> CTxMemPoolSnapshot::GetAncestors(const uint256& hash) const
+{
+    return WalkSnapshot(*this, hash, &Entry::vParents);
+}
+
+std::vector<const CTxMemPoolSnapshot::Entry*> CTxMemPoolSnapshot::GetDescendants(const uint256& hash) const
+{
+    return WalkSnapshot(*this, hash, &Entry::vChildren);
+}
+
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
     LOCK(cs);
@@ -925,6 +1061,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         deltas.second += nFeeDelta;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
+            nSnapshotSequence++;
             mapTx.modify(it, update_fee_delta(deltas.second));
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
@@ -996,6 +1133,81 @@ void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants) {
     }
 }
 
+namespace {
+/** A combined change to the ancestor or descendant state of an entry */
+struct StateDelta
+{
+    int64_t nSize;
+    CAmount nFee;
+    int64_t nCount;
+    int64_t nSigOpsCost;
+
+    StateDelta() : nSize(0), nFee(0), nCount(0), nSigOpsCost(0) {}
+};
+}
+
+void CTxMemPool::RemoveStagedBatch(const setEntries &stage, const setEntries &setMined) {
+    AssertLockHeld(cs);
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+
+    // Sum the changes to each entry that stays, before any link is severed
+    std::map<txiter, StateDelta, CompareIteratorByHash> mapAncestorDeltas;
+    std::map<txiter, StateDelta, CompareIteratorByHash> mapDescendantDeltas;
+    BOOST_FOREACH(txiter removeIt, setMined) {
+        setEntries setDescendants;
+        CalculateDescendants(removeIt, setDescendants);
+        BOOST_FOREACH(txiter dit, setDescendants) {
+            if (stage.count(dit))
+                continue;
+            StateDelta& delta = mapAncestorDeltas[dit];
+            delta.nSize -= removeIt->GetTxSize();
+            delta.nFee -= removeIt->GetModifiedFee();
+            delta.nCount--;
+            delta.nSigOpsCost -= removeIt->GetSigOpCost();
+        }
+    }
+    BOOST_FOREACH(txiter removeIt, stage) {
+        // See UpdateForRemoveFromMempool for why the ancestors are those
+        // reachable through mapLinks
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*removeIt, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        BOOST_FOREACH(txiter ait, setAncestors) {
+            if (stage.count(ait))
+                continue;
+            StateDelta& delta = mapDescendantDeltas[ait];
+            delta.nSize -= removeIt->GetTxSize();
+            delta.nFee -= removeIt->GetModifiedFee();
+            delta.nCount--;
+        }
+    }
+
+    for (std::map<txiter, StateDelta, CompareIteratorByHash>::const_iterator it = mapAncestorDeltas.begin(); it != mapAncestorDeltas.end(); ++it) {
+        const StateDelta& delta = it->second;
+        mapTx.modify(it->first, update_ancestor_state(delta.nSize, delta.nFee, delta.nCount, delta.nSigOpsCost));
+    }
+    for (std::map<txiter, StateDelta, CompareIteratorByHash>::const_iterator it = mapDescendantDeltas.begin(); it != mapDescendantDeltas.end(); ++it) {
+        const StateDelta& delta = it->second;
+        mapTx.modify(it->first, update_descendant_state(delta.nSize, delta.nFee, delta.nCount));
+    }
+
+    // Sever the links between the removed entries and the ones that stay
+    BOOST_FOREACH(txiter removeIt, stage) {
+        BOOST_FOREACH(txiter pit, GetMemPoolParents(removeIt)) {
+            if (!stage.count(pit))
+                UpdateChild(pit, removeIt, false);
+        }
+        BOOST_FOREACH(txiter cit, GetMemPoolChildren(removeIt)) {
+            if (!stage.count(cit))
+                UpdateParent(cit, removeIt, false);
+        }
+    }
+
+    BOOST_FOREACH(txiter it, stage) {
+        removeUnchecked(it);
+    }
+}
+
 int CTxMemPool::Expire(int64_t time) {
     LOCK(cs);
     indexed_transaction_set::index<entry_time>::type::iterator it = mapTx.get<entry_time>().begin();
@@ -1090,12 +1302,15 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining, std::vector<std::shared_ptr<const CTransaction> >* pvEvicted) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        // One package at a time: staging several per pass costs more in
+        // bookkeeping than it saves (see MempoolEvictFlood), as each evicted
+        // transaction still has to update the ancestors that stay.
         indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
@@ -1117,6 +1332,10 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
             BOOST_FOREACH(txiter it, stage)
                 txn.push_back(it->GetTx());
         }
+        if (pvEvicted) {
+            BOOST_FOREACH(txiter it, stage)
+                pvEvicted->push_back(it->GetSharedTx());
+        }
         RemoveStaged(stage, false);
         if (pvNoSpendsRemaining) {
             BOOST_FOREACH(const CTransaction& tx, txn) {
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <set>
@@ -146,6 +147,7 @@ public:
     CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
+    CAmount GetInChainInputValue() const { return inChainInputValue; }
 
     uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
     uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
@@ -153,6 +155,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpochMarker; //!< Last walk of the mempool that reached this entry, see CTxMemPool::Visited()
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -327,6 +330,54 @@ struct TxMempoolInfo
     CFeeRate feeRate;
 };
 
+/**
+ * An immutable copy of the mempool entries and the links between them, for
+ * read-only queries. A snapshot is shared by every reader until a newer one
+ * is published (see CTxMemPool::GetSnapshot()), and can be read without any
+ * lock.
+ */
+class CTxMemPoolSnapshot
+{
+public:
+    struct Entry
+    {
+        CTxMemPoolEntry entry;
+        std::vector<uint256> vParents;  //!< In-mempool transactions this one spends
+        std::vector<uint256> vChildren; //!< In-mempool transactions spending this one
+
+        Entry(const CTxMemPoolEntry& _entry) : entry(_entry) {}
+        const uint256& GetHash() const { return entry.GetTx().GetHash(); }
+    };
+
+private:
+    uint64_t nSequence;
+    int64_t nTimeMillis;
+    std::vector<Entry> vEntries; //!< Sorted by ancestor count, then by mining score
+    std::vector<uint32_t> vByTxid; //!< Positions in vEntries, sorted by txid
+
+    friend class CTxMemPool;
+
+public:
+    CTxMemPoolSnapshot() : nSequence(0), nTimeMillis(0) {}
+
+    /** The mempool change this snapshot was taken after, see CTxMemPool::GetSnapshot() */
+    uint64_t GetSequence() const { return nSequence; }
+    /** When this snapshot was taken, in milliseconds */
+    int64_t GetTimeMillis() const { return nTimeMillis; }
+    size_t size() const { return vEntries.size(); }
+    /** The entries in the order of CTxMemPool::queryHashes(), parents before their children */
+    const std::vector<Entry>& GetEntries() const { return vEntries; }
+
+    /** The entry of hash, or NULL if it was not in the mempool */
+    const Entry* Find(const uint256& hash) const;
+
+    /** All in-mempool ancestors of hash, not including itself, sorted by txid */
+    std::vector<const Entry*> GetAncestors(const uint256& hash) const;
+
+    /** All in-mempool descendants of hash, not including itself, sorted by txid */
+    std::vector<const Entry*> GetDescendants(const uint256& hash) const;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -474,7 +525,34 @@ public:
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
+
+    /**
+     * Walks over the ancestors or descendants of an entry mark the entries
+     * they reach with their epoch rather than collecting them in a set to
+     * know which ones they have seen, and keep the entries left to visit in
+     * a reused vector, so they do not allocate per entry. Walks must not
+     * nest. Protected by cs.
+     */
+    mutable uint64_t nEpoch;
+    mutable std::vector<txiter> vWalkStack;
+
+    /** Start a new walk, in which no entry has been reached yet */
+    std::vector<txiter>& StartWalk() const
+    {
+        AssertLockHeld(cs);
+        ++nEpoch;
+        vWalkStack.clear();
+        return vWalkStack;
+    }
+    /** Whether the current walk reached it already. Marks it reached. */
+    bool Visited(txiter it) const
+    {
+        if (it->nEpochMarker == nEpoch)
+            return true;
+        it->nEpochMarker = nEpoch;
+        return false;
+    }
 
     struct TxLinks {
         setEntries parents;
@@ -484,6 +562,17 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    /**
+     * Bumped by every change visible in a snapshot, while holding cs. Atomic
+     * so that GetSnapshot() can tell whether the last snapshot is current
+     * without taking cs.
+     */
+    std::atomic<uint64_t> nSnapshotSequence;
+    mutable CCriticalSection csSnapshot;
+    mutable CCriticalSection csSnapshotBuild; //!< Held while taking a snapshot, so readers wait for one copy
+    mutable std::shared_ptr<const CTxMemPoolSnapshot> snapshot; //!< Protected by csSnapshot
+    int64_t nSnapshotInterval; //!< Set before the mempool is shared, see setSnapshotInterval()
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -509,6 +598,8 @@ public:
      */
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(double dFrequency = 1.0) { nCheckFrequency = dFrequency * 4294967295.0; }
+    /** Publish a new snapshot at most every nMillis milliseconds, see GetSnapshot() */
+    void setSnapshotInterval(int64_t nMillis) { nSnapshotInterval = nMillis; }
 
     // addUnchecked must updated state for all ancestors of a given transaction,
     // to track size/count of descendant transactions.  First version of
@@ -519,7 +610,6 @@ public:
 
     void removeRecursive(const CTransaction &tx, std::list<CTransaction>& removed);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
-    void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void clear();
@@ -550,6 +640,15 @@ public:
      */
     void RemoveStaged(setEntries &stage, bool updateDescendants);
 
+    /** Remove a set of transactions from the mempool in one pass.
+     *  The transactions in setMined were in a block: their in-mempool
+     *  descendants outside of stage have their ancestor state updated. Every
+     *  other transaction in stage must have all its in-mempool descendants in
+     *  stage. Each remaining entry whose ancestor or descendant state changes
+     *  is updated once with the combined change.
+     */
+    void RemoveStagedBatch(const setEntries &stage, const setEntries &setMined);
+
     /** When adding transactions from a disconnected block back to the mempool,
      *  new mempool entries may have children in the mempool (which is generally
      *  not the case when otherwise adding transactions).
@@ -589,8 +688,9 @@ public:
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
       *  pvNoSpendsRemaining, if set, will be populated with the list of transactions
       *  which are not in mempool which no longer have any spends in this mempool.
+      *  pvEvicted, if set, will be populated with the transactions removed.
       */
-    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL);
+    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL, std::vector<std::shared_ptr<const CTransaction> >* pvEvicted=NULL);
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -620,6 +720,17 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
+    /**
+     * An immutable snapshot of the mempool. The last one is returned without
+     * locking cs as long as the mempool has not changed since it was taken,
+     * or it was taken less than the snapshot interval ago, so that a busy pool
+     * is copied at most once per interval however many readers there are.
+     * Otherwise the entries are copied under cs and the new snapshot replaces
+     * it. Readers must accept a snapshot up to one interval stale. Must not be
+     * called with cs held.
+     */
+    std::shared_ptr<const CTxMemPoolSnapshot> GetSnapshot() const;
+
     /** Estimate fee rate needed to get into the next nBlocks
      *  If no answer can be given at nBlocks, return an estimate
      *  at the lowest number of blocks where one can be given
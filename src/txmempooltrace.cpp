@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txmempooltrace.h"
+
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <stdexcept>
+
+CMempoolRecorder* pmempoolRecorder = NULL;
+
+CMempoolRecorder::CMempoolRecorder(FILE* filestr, int64_t nMaxMempoolSize, int64_t nMempoolExpiry) : file(filestr, SER_DISK, CLIENT_VERSION)
+{
+    try {
+        file << CMempoolTraceHeader(nMaxMempoolSize, nMempoolExpiry);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to start the mempool trace: %s\n", e.what());
+        file.fclose();
+    }
+}
+
+void CMempoolRecorder::Record(const CMempoolTraceRecord& record)
+{
+    LOCK(cs);
+    if (file.IsNull())
+        return;
+    try {
+        file << record;
+        // A block is a good point for the trace on disk to be complete
+        if (record.nType != MEMPOOL_TRACE_TX)
+            fflush(file.Get());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to write the mempool trace, no longer recording: %s\n", e.what());
+        file.fclose();
+    }
+}
+
+void CMempoolRecorder::RecordTransaction(const CTxMemPoolEntry& entry)
+{
+    CMempoolTraceRecord record;
+    record.nType = MEMPOOL_TRACE_TX;
+    record.nTime = entry.GetTime();
+    record.nHeight = entry.GetHeight();
+    record.tx = entry.GetTx();
+    record.nFee = entry.GetFee();
+    // At its entry height the priority has not aged yet
+    record.dPriority = entry.GetPriority(entry.GetHeight());
+    record.inChainInputValue = entry.GetInChainInputValue();
+    record.fSpendsCoinbase = entry.GetSpendsCoinbase();
+    record.nSigOpsCost = entry.GetSigOpCost();
+    Record(record);
+}
+
+void CMempoolRecorder::RecordBlock(const CBlock& block, unsigned int nHeight)
+{
+    CMempoolTraceRecord record;
+    record.nType = MEMPOOL_TRACE_BLOCK;
+    record.nTime = GetTime();
+    record.nHeight = nHeight;
+    record.vtx = block.vtx;
+    Record(record);
+}
+
+void CMempoolRecorder::RecordDisconnect(unsigned int nHeight, const std::vector<uint256>& vHashUpdate)
+{
+    CMempoolTraceRecord record;
+    record.nType = MEMPOOL_TRACE_DISCONNECT;
+    record.nTime = GetTime();
+    record.nHeight = nHeight;
+    record.vHashUpdate = vHashUpdate;
+    Record(record);
+}
+
+void ReadMempoolTrace(CAutoFile& file, CMempoolTraceHeader& header, std::vector<CMempoolTraceRecord>& vRecords)
+{
+    try {
+        file >> header;
+    } catch (const std::ios_base::failure& e) {
+        throw std::runtime_error(strprintf("header: %s", e.what()));
+    }
+    while (true) {
+        CMempoolTraceRecord record;
+        try {
+            file >> record;
+        } catch (const std::ios_base::failure& e) {
+            if (feof(file.Get()))
+                break;
+            throw std::runtime_error(strprintf("record %u: %s", vRecords.size(), e.what()));
+        }
+        vRecords.push_back(record);
+    }
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXMEMPOOLTRACE_H
+#define BITCOIN_TXMEMPOOLTRACE_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <ios>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+class CBlock;
+class CTxMemPoolEntry;
+
+/**
+ * A mempool trace is what a node's mempool saw, in order, so that it can be
+ * replayed against the mempool, the block assembler and the fee estimator
+ * without the chain that produced it.
+ *
+ * The trace starts with a CMempoolTraceHeader, followed by records up to the
+ * end of the file:
+ * - MEMPOOL_TRACE_TX: a transaction entered the mempool, with what its entry
+ *   needs besides the transaction: fee, priority and value of its inputs
+ *   already in the chain, whether it spends a coinbase, and its sigop cost.
+ *   Transactions resurrected by a reorg or loaded from mempool.dat are
+ *   recorded like any other.
+ * - MEMPOOL_TRACE_BLOCK: a block was connected, with all its transactions.
+ * - MEMPOOL_TRACE_DISCONNECT: the tip was disconnected, after the
+ *   transactions of its block went back to the mempool, with the txids
+ *   whose in-mempool descendants were updated.
+ * Every record has the time it was made and the height of the chain tip:
+ * for a transaction the height it entered at, for a block its own height,
+ * and for a disconnect the height of the new tip.
+ */
+static const uint32_t MEMPOOL_TRACE_MAGIC = 0x7274706d; // "mptr"
+static const uint32_t MEMPOOL_TRACE_VERSION = 2;
+
+/** The mempool limits of the node that recorded a trace, for the replay to use */
+class CMempoolTraceHeader
+{
+public:
+    uint32_t nMagic;
+    uint32_t nVersion;
+    int64_t nMaxMempoolSize; //!< -maxmempool, in bytes
+    int64_t nMempoolExpiry;  //!< -mempoolexpiry, in seconds
+
+    CMempoolTraceHeader() : nMagic(0), nVersion(0), nMaxMempoolSize(0), nMempoolExpiry(0) {}
+    CMempoolTraceHeader(int64_t nMaxMempoolSizeIn, int64_t nMempoolExpiryIn) :
+        nMagic(MEMPOOL_TRACE_MAGIC), nVersion(MEMPOOL_TRACE_VERSION),
+        nMaxMempoolSize(nMaxMempoolSizeIn), nMempoolExpiry(nMempoolExpiryIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion_) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        if (nMagic != MEMPOOL_TRACE_MAGIC || nVersion != MEMPOOL_TRACE_VERSION)
+            throw std::ios_base::failure("Not a mempool trace of a known version");
+        READWRITE(nMaxMempoolSize);
+        READWRITE(nMempoolExpiry);
+    }
+};
+
+enum MempoolTraceType
+{
+    MEMPOOL_TRACE_TX = 1,
+    MEMPOOL_TRACE_BLOCK = 2,
+    MEMPOOL_TRACE_DISCONNECT = 3,
+};
+
+class CMempoolTraceRecord
+{
+public:
+    uint8_t nType;
+    int64_t nTime;
+    uint32_t nHeight;
+
+    // MEMPOOL_TRACE_TX
+    CTransaction tx;
+    CAmount nFee;
+    double dPriority;
+    CAmount inChainInputValue;
+    bool fSpendsCoinbase;
+    int64_t nSigOpsCost;
+
+    // MEMPOOL_TRACE_BLOCK
+    std::vector<CTransaction> vtx;
+
+    // MEMPOOL_TRACE_DISCONNECT
+    std::vector<uint256> vHashUpdate;
+
+    CMempoolTraceRecord() : nType(0), nTime(0), nHeight(0), nFee(0), dPriority(0), inChainInputValue(0), fSpendsCoinbase(false), nSigOpsCost(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType_, int nVersion) {
+        READWRITE(nType);
+        READWRITE(nTime);
+        READWRITE(nHeight);
+        switch (nType) {
+        case MEMPOOL_TRACE_TX:
+            READWRITE(tx);
+            READWRITE(nFee);
+            READWRITE(dPriority);
+            READWRITE(inChainInputValue);
+            READWRITE(fSpendsCoinbase);
+            READWRITE(nSigOpsCost);
+            break;
+        case MEMPOOL_TRACE_BLOCK:
+            READWRITE(vtx);
+            break;
+        case MEMPOOL_TRACE_DISCONNECT:
+            READWRITE(vHashUpdate);
+            break;
+        default:
+            throw std::ios_base::failure("Unknown mempool trace record type");
+        }
+    }
+};
+
+/**
+ * Appends what the mempool sees to a trace file. Enabled by -mempoolrecord;
+ * a write error ends the recording but not the node.
+ */
+class CMempoolRecorder
+{
+private:
+    CCriticalSection cs;
+    CAutoFile file;
+
+    void Record(const CMempoolTraceRecord& record);
+
+public:
+    /**
+     * Start a trace in filestr, which the recorder takes ownership of, for a
+     * mempool limited to nMaxMempoolSize bytes and nMempoolExpiry seconds
+     */
+    CMempoolRecorder(FILE* filestr, int64_t nMaxMempoolSize, int64_t nMempoolExpiry);
+
+    bool IsNull() const { return file.IsNull(); }
+
+    void RecordTransaction(const CTxMemPoolEntry& entry);
+    void RecordBlock(const CBlock& block, unsigned int nHeight);
+    void RecordDisconnect(unsigned int nHeight, const std::vector<uint256>& vHashUpdate);
+};
+
+/** The recorder of the node's mempool, or NULL if not recording */
+extern CMempoolRecorder* pmempoolRecorder;
+
+/**
+ * Read a trace from file into header and vRecords. Reading stops at the end
+ * of the file, including in the middle of a record that was cut short because
+ * the node stopped while writing it. Throws if file does not start with a
+ * trace header of a known version, or on a record that cannot be read
+ * otherwise.
+ */
+void ReadMempoolTrace(CAutoFile& file, CMempoolTraceHeader& header, std::vector<CMempoolTraceRecord>& vRecords);
+
+#endif // BITCOIN_TXMEMPOOLTRACE_H
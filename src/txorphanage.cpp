@@ -0,0 +1,206 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+
+#include "primitives/block.h"
+#include "random.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#include "boost/foreach.hpp"
+#include "boost/tuple/tuple.hpp"
+
+void CTxOrphanage::Erase(TxidIter it)
+{
+    BOOST_FOREACH(const CTxIn& txin, it->tx.vin) {
+        std::map<COutPoint, std::set<uint256> >::iterator itPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itPrev == mapOrphansByPrev.end())
+            continue;
+        itPrev->second.erase(it->hash);
+        if (itPrev->second.empty())
+            mapOrphansByPrev.erase(itPrev);
+    }
+    std::map<NodeId, PeerInfo>::iterator itInfo = mapPeerInfo.find(it->fromPeer);
+    assert(itInfo != mapPeerInfo.end());
+    itInfo->second.nWeight -= it->nWeight;
+    if (--itInfo->second.nCount == 0)
+        mapPeerInfo.erase(itInfo);
+    setOrphans.erase(it);
+}
+
+bool CTxOrphanage::AddTx(const CTransaction& tx, NodeId peer, int64_t nTimeExpire)
+{
+    const uint256& hash = tx.GetHash();
+    if (HaveTx(hash))
+        return false;
+
+    COrphanTx orphan;
+    orphan.tx = tx;
+    orphan.hash = hash;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = nTimeExpire;
+    orphan.nWeight = GetTransactionWeight(tx);
+    orphan.nSequence = nNextSequence++;
+    setOrphans.insert(orphan);
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        mapOrphansByPrev[txin.prevout].insert(hash);
+    PeerInfo& info = mapPeerInfo[peer];
+    info.nCount++;
+    info.nWeight += orphan.nWeight;
+    return true;
+}
+
+bool CTxOrphanage::HaveTx(const uint256& txid) const
+{
+    return setOrphans.get<by_txid>().count(txid);
+}
+
+int CTxOrphanage::EraseTx(const uint256& txid)
+{
+    TxidIter it = setOrphans.get<by_txid>().find(txid);
+    if (it == setOrphans.get<by_txid>().end())
+        return 0;
+    Erase(it);
+    return 1;
+}
+
+int CTxOrphanage::EraseForPeer(NodeId peer)
+{
+    int nErased = 0;
+    OrphanSet::index<by_peer>::type& index = setOrphans.get<by_peer>();
+    OrphanSet::index<by_peer>::type::iterator it = index.lower_bound(boost::make_tuple(peer));
+    while (it != index.end() && it->fromPeer == peer) {
+        // Erasing one orphan does not invalidate the iterators to the others
+        TxidIter itErase = setOrphans.project<by_txid>(it++);
+        Erase(itErase);
+        nErased++;
+    }
+    return nErased;
+}
+
+int CTxOrphanage::EraseExpired(int64_t nNow)
+{
+    int nErased = 0;
+    OrphanSet::index<by_expiry>::type& index = setOrphans.get<by_expiry>();
+    while (!index.empty() && index.begin()->nTimeExpire <= nNow) {
+        Erase(setOrphans.project<by_txid>(index.begin()));
+        nErased++;
+    }
+    return nErased;
+}
+
+int CTxOrphanage::EraseForBlock(const CBlock& block)
+{
+    std::set<uint256> setErase;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            std::map<COutPoint, std::set<uint256> >::const_iterator itPrev = mapOrphansByPrev.find(txin.prevout);
+            if (itPrev != mapOrphansByPrev.end())
+                setErase.insert(itPrev->second.begin(), itPrev->second.end());
+        }
+    }
+    int nErased = 0;
+    BOOST_FOREACH(const uint256& hash, setErase)
+        nErased += EraseTx(hash);
+    return nErased;
+}
+
+unsigned int CTxOrphanage::LimitOrphans(unsigned int nMaxOrphans)
+{
+    unsigned int nEvicted = 0;
+    while (setOrphans.size() > nMaxOrphans) {
+        // There are few peers, so finding the one holding the most is cheap
+        std::map<NodeId, PeerInfo>::const_iterator itMax = mapPeerInfo.begin();
+        for (std::map<NodeId, PeerInfo>::const_iterator itInfo = mapPeerInfo.begin(); itInfo != mapPeerInfo.end(); ++itInfo) {
+            if (itInfo->second.nCount > itMax->second.nCount ||
+                (itInfo->second.nCount == itMax->second.nCount && itInfo->second.nWeight > itMax->second.nWeight))
+                itMax = itInfo;
+        }
+        const NodeId peer = itMax->first;
+
+        // Evict a random orphan of that peer
+        OrphanSet::index<by_peer>::type& index = setOrphans.get<by_peer>();
+        OrphanSet::index<by_peer>::type::iterator it = index.lower_bound(boost::make_tuple(peer, GetRandHash()));
+        if (it == index.end() || it->fromPeer != peer)
+            it = index.lower_bound(boost::make_tuple(peer));
+        assert(it != index.end() && it->fromPeer == peer);
+        Erase(setOrphans.project<by_txid>(it));
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+std::vector<const COrphanTx*> CTxOrphanage::GetChildren(const uint256& txid) const
+{
+    // The outpoints of txid are adjacent in the map, so this is a single range
+    std::set<uint256> setChildren;
+    std::map<COutPoint, std::set<uint256> >::const_iterator itPrev = mapOrphansByPrev.lower_bound(COutPoint(txid, 0));
+    for (; itPrev != mapOrphansByPrev.end() && itPrev->first.hash == txid; ++itPrev)
+        setChildren.insert(itPrev->second.begin(), itPrev->second.end());
+
+    std::vector<const COrphanTx*> vChildren;
+    vChildren.reserve(setChildren.size());
+    const OrphanSet::index<by_txid>::type& index = setOrphans.get<by_txid>();
+    BOOST_FOREACH(const uint256& hash, setChildren) {
+        TxidIter it = index.find(hash);
+        assert(it != index.end());
+        vChildren.push_back(&*it);
+    }
+    std::sort(vChildren.begin(), vChildren.end(), [](const COrphanTx* a, const COrphanTx* b) {
+        return a->nSequence < b->nSequence;
+    });
+    return vChildren;
+}
+
+size_t CTxOrphanage::Count(NodeId peer) const
+{
+    std::map<NodeId, PeerInfo>::const_iterator it = mapPeerInfo.find(peer);
+    return it == mapPeerInfo.end() ? 0 : it->second.nCount;
+}
+
+size_t CTxOrphanage::Weight(NodeId peer) const
+{
+    std::map<NodeId, PeerInfo>::const_iterator it = mapPeerInfo.find(peer);
+    return it == mapPeerInfo.end() ? 0 : it->second.nWeight;
+}
+
+void CTxOrphanage::Clear()
+{
+    setOrphans.clear();
+    mapOrphansByPrev.clear();
+    mapPeerInfo.clear();
+}
+
+void CTxOrphanage::SanityCheck() const
+{
+    std::map<NodeId, PeerInfo> mapCounted;
+    const OrphanSet::index<by_txid>::type& index = setOrphans.get<by_txid>();
+    for (TxidIter it = index.begin(); it != index.end(); ++it) {
+        assert(it->hash == it->tx.GetHash());
+        PeerInfo& info = mapCounted[it->fromPeer];
+        info.nCount++;
+        info.nWeight += it->nWeight;
+        BOOST_FOREACH(const CTxIn& txin, it->tx.vin) {
+            std::map<COutPoint, std::set<uint256> >::const_iterator itPrev = mapOrphansByPrev.find(txin.prevout);
+            assert(itPrev != mapOrphansByPrev.end());
+            assert(itPrev->second.count(it->hash));
+        }
+    }
+    for (std::map<COutPoint, std::set<uint256> >::const_iterator itPrev = mapOrphansByPrev.begin(); itPrev != mapOrphansByPrev.end(); ++itPrev) {
+        assert(!itPrev->second.empty());
+        BOOST_FOREACH(const uint256& hash, itPrev->second)
+            assert(index.count(hash));
+    }
+
+    assert(mapCounted.size() == mapPeerInfo.size());
+    for (std::map<NodeId, PeerInfo>::const_iterator itInfo = mapCounted.begin(); itInfo != mapCounted.end(); ++itInfo) {
+        std::map<NodeId, PeerInfo>::const_iterator itStored = mapPeerInfo.find(itInfo->first);
+        assert(itStored != mapPeerInfo.end());
+        assert(itStored->second.nCount == itInfo->second.nCount);
+        assert(itStored->second.nWeight == itInfo->second.nWeight);
+    }
+}
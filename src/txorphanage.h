@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+#include "boost/multi_index/member.hpp"
+#include "boost/multi_index/composite_key.hpp"
+
+class CBlock;
+
+/** A transaction kept until its missing parents arrive */
+struct COrphanTx
+{
+    CTransaction tx;
+    uint256 hash;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nWeight;
+    uint64_t nSequence; //!< Order of arrival
+};
+
+/**
+ * The orphan transaction pool.
+ *
+ * Orphans are indexed by txid, by the peer that sent them and by expiry
+ * time, and the outpoints they spend are indexed separately, so looking
+ * them up, erasing the ones of a peer or the expired ones, and finding the
+ * ones spending a new transaction are all logarithmic in the number of
+ * orphans rather than scans of the whole pool. The pool also keeps count
+ * of the orphans and weight each peer holds, and evicts from the peer
+ * holding the most when it is full, so a peer flooding it with orphans
+ * mostly evicts its own. Times are passed in by the caller, in seconds.
+ */
+class CTxOrphanage
+{
+private:
+    struct by_txid {};
+    struct by_peer {};
+    struct by_expiry {};
+
+    typedef boost::multi_index_container<
+        COrphanTx,
+        boost::multi_index::indexed_by<
+            boost::multi_index::ordered_unique<
+                boost::multi_index::tag<by_txid>,
+                boost::multi_index::member<COrphanTx, uint256, &COrphanTx::hash>
+            >,
+            // (peer, txid): unique
+            boost::multi_index::ordered_unique<
+                boost::multi_index::tag<by_peer>,
+                boost::multi_index::composite_key<
+                    COrphanTx,
+                    boost::multi_index::member<COrphanTx, NodeId, &COrphanTx::fromPeer>,
+                    boost::multi_index::member<COrphanTx, uint256, &COrphanTx::hash>
+                >
+            >,
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<by_expiry>,
+                boost::multi_index::member<COrphanTx, int64_t, &COrphanTx::nTimeExpire>
+            >
+        >
+    > OrphanSet;
+
+    typedef OrphanSet::index<by_txid>::type::iterator TxidIter;
+
+    struct PeerInfo
+    {
+        size_t nCount;
+        size_t nWeight;
+        PeerInfo() : nCount(0), nWeight(0) {}
+    };
+
+    OrphanSet setOrphans;
+    /** The txids of the orphans spending each outpoint */
+    std::map<COutPoint, std::set<uint256> > mapOrphansByPrev;
+    std::map<NodeId, PeerInfo> mapPeerInfo;
+    uint64_t nNextSequence;
+
+    void Erase(TxidIter it);
+
+public:
+    CTxOrphanage() : nNextSequence(0) {}
+
+    /** Add an orphan received from peer. Returns false if it is already in the pool. */
+    bool AddTx(const CTransaction& tx, NodeId peer, int64_t nTimeExpire);
+
+    bool HaveTx(const uint256& txid) const;
+
+    /** Erase an orphan. Returns the number of orphans erased. */
+    int EraseTx(const uint256& txid);
+
+    /** Erase the orphans received from peer. Returns the number of orphans erased. */
+    int EraseForPeer(NodeId peer);
+
+    /** Erase the orphans expiring by nNow. Returns the number of orphans erased. */
+    int EraseExpired(int64_t nNow);
+
+    /** Erase the orphans spending an outpoint spent by the block: they are included or conflicted */
+    int EraseForBlock(const CBlock& block);
+
+    /**
+     * Evict orphans until at most nMaxOrphans are left, each time a random
+     * one of the peer holding the most. Returns the number evicted.
+     */
+    unsigned int LimitOrphans(unsigned int nMaxOrphans);
+
+    /**
+     * The orphans spending any output of txid, each once, in the order
+     * they arrived. The pointers are valid until the orphan is erased.
+     */
+    std::vector<const COrphanTx*> GetChildren(const uint256& txid) const;
+
+    /** Number of orphans received from a peer */
+    size_t Count(NodeId peer) const;
+
+    /** Total weight of the orphans received from a peer */
+    size_t Weight(NodeId peer) const;
+
+    size_t Size() const { return setOrphans.size(); }
+
+    void Clear();
+
+    /** Check the internal invariants, for tests */
+    void SanityCheck() const;
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
@@ -0,0 +1,272 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrequest.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#include "boost/tuple/tuple.hpp"
+
+/** Whether a is to be requested before b, if both are ready */
+static bool IsBetterCandidate(const CTxRequestTracker::Announcement& a, const CTxRequestTracker::Announcement& b)
+{
+    if (a.fPreferred != b.fPreferred)
+        return a.fPreferred;
+    return a.nSequence < b.nSequence;
+}
+
+CTxRequestTracker::PeerIter CTxRequestTracker::FindAnnouncement(NodeId peer, const uint256& txid) const
+{
+    const AnnouncementSet::index<by_peer>::type& index = setAnnouncements.get<by_peer>();
+    PeerIter it = index.find(boost::make_tuple(peer, false, txid));
+    if (it == index.end())
+        it = index.find(boost::make_tuple(peer, true, txid));
+    return it;
+}
+
+void CTxRequestTracker::ChangeState(TxidIter it, State state, int64_t nTime)
+{
+    PeerInfo& info = mapPeerInfo[it->peer];
+    if (it->state == REQUESTED)
+        info.nRequested--;
+    if (state == REQUESTED)
+        info.nRequested++;
+    setAnnouncements.get<by_txid>().modify(it, [state, nTime](Announcement& ann) {
+        ann.state = state;
+        ann.nTime = nTime;
+    });
+}
+
+void CTxRequestTracker::PromoteCandidateReady(TxidIter it)
+{
+    assert(it->state == CANDIDATE_READY);
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    TxidIter itOther = index.lower_bound(boost::make_tuple(it->txid, CANDIDATE_BEST));
+    if (itOther != index.end() && itOther->txid == it->txid) {
+        if (itOther->state == REQUESTED)
+            return;
+        if (itOther->state == CANDIDATE_BEST) {
+            if (IsBetterCandidate(*it, *itOther)) {
+                ChangeState(itOther, CANDIDATE_READY);
+                ChangeState(it, CANDIDATE_BEST);
+            }
+            return;
+        }
+    }
+    ChangeState(it, CANDIDATE_BEST);
+}
+
+void CTxRequestTracker::SelectBest(const uint256& txid)
+{
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    TxidIter it = index.lower_bound(boost::make_tuple(txid, CANDIDATE_BEST));
+    if (it != index.end() && it->txid == txid && (it->state == CANDIDATE_BEST || it->state == REQUESTED))
+        return;
+    // Ready candidates are ordered by preference, so the first one is the best
+    it = index.lower_bound(boost::make_tuple(txid, CANDIDATE_READY));
+    if (it != index.end() && it->txid == txid && it->state == CANDIDATE_READY)
+        ChangeState(it, CANDIDATE_BEST);
+}
+
+void CTxRequestTracker::Erase(TxidIter it)
+{
+    const uint256 txid = it->txid;
+    const State state = it->state;
+    std::map<NodeId, PeerInfo>::iterator itInfo = mapPeerInfo.find(it->peer);
+    assert(itInfo != mapPeerInfo.end());
+    if (state == REQUESTED)
+        itInfo->second.nRequested--;
+    if (--itInfo->second.nTotal == 0)
+        mapPeerInfo.erase(itInfo);
+    setAnnouncements.get<by_txid>().erase(it);
+    if (state == CANDIDATE_BEST || state == REQUESTED)
+        SelectBest(txid);
+}
+
+void CTxRequestTracker::EraseIfCompleted(const uint256& txid)
+{
+    // COMPLETED sorts last, so if the first announcement is COMPLETED all of them are
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    TxidIter it = index.lower_bound(boost::make_tuple(txid));
+    if (it == index.end() || it->txid != txid || it->state != COMPLETED)
+        return;
+    ForgetTxHash(txid);
+}
+
+void CTxRequestTracker::SetTimePoint(int64_t nNow)
+{
+    AnnouncementSet::index<by_time>::type& index = setAnnouncements.get<by_time>();
+    while (!index.empty()) {
+        AnnouncementSet::index<by_time>::type::iterator it = index.begin();
+        if (it->IsNotWaiting() || it->nTime > nNow)
+            break;
+        TxidIter itTxid = setAnnouncements.project<by_txid>(it);
+        if (it->state == CANDIDATE_DELAYED) {
+            ChangeState(itTxid, CANDIDATE_READY);
+            PromoteCandidateReady(itTxid);
+        } else {
+            // The request timed out
+            const uint256 txid = it->txid;
+            ChangeState(itTxid, COMPLETED);
+            SelectBest(txid);
+            EraseIfCompleted(txid);
+        }
+    }
+}
+
+void CTxRequestTracker::ReceivedInv(NodeId peer, const uint256& txid, bool fPreferred, int64_t nReqTime)
+{
+    if (FindAnnouncement(peer, txid) != setAnnouncements.get<by_peer>().end())
+        return;
+
+    Announcement ann;
+    ann.txid = txid;
+    ann.peer = peer;
+    ann.nTime = nReqTime;
+    ann.nSequence = nNextSequence++;
+    ann.fPreferred = fPreferred;
+    ann.state = CANDIDATE_DELAYED;
+    setAnnouncements.insert(ann);
+    mapPeerInfo[peer].nTotal++;
+}
+
+std::vector<uint256> CTxRequestTracker::GetRequestable(NodeId peer, int64_t nNow)
+{
+    SetTimePoint(nNow);
+
+    std::vector<const Announcement*> vSelected;
+    const AnnouncementSet::index<by_peer>::type& index = setAnnouncements.get<by_peer>();
+    for (PeerIter it = index.lower_bound(boost::make_tuple(peer, false)); it != index.end() && it->peer == peer && it->state == CANDIDATE_BEST; ++it)
+        vSelected.push_back(&*it);
+    std::sort(vSelected.begin(), vSelected.end(), [](const Announcement* a, const Announcement* b) {
+        return a->nSequence < b->nSequence;
+    });
+
+    std::vector<uint256> vTxids;
+    vTxids.reserve(vSelected.size());
+    for (size_t i = 0; i < vSelected.size(); i++)
+        vTxids.push_back(vSelected[i]->txid);
+    return vTxids;
+}
+
+void CTxRequestTracker::RequestedTx(NodeId peer, const uint256& txid, int64_t nExpiry)
+{
+    PeerIter it = FindAnnouncement(peer, txid);
+    if (it == setAnnouncements.get<by_peer>().end() || it->state == REQUESTED || it->state == COMPLETED)
+        return;
+
+    // A request to this peer supersedes the choice of any other
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    TxidIter itOther = index.lower_bound(boost::make_tuple(txid, CANDIDATE_BEST));
+    if (itOther != index.end() && itOther->txid == txid && itOther->peer != peer) {
+        if (itOther->state == CANDIDATE_BEST)
+            ChangeState(itOther, CANDIDATE_READY);
+        else if (itOther->state == REQUESTED)
+            ChangeState(itOther, COMPLETED);
+    }
+    ChangeState(setAnnouncements.project<by_txid>(it), REQUESTED, nExpiry);
+}
+
+void CTxRequestTracker::ReceivedResponse(NodeId peer, const uint256& txid)
+{
+    PeerIter it = FindAnnouncement(peer, txid);
+    if (it == setAnnouncements.get<by_peer>().end() || it->state == COMPLETED)
+        return;
+
+    const State state = it->state;
+    ChangeState(setAnnouncements.project<by_txid>(it), COMPLETED);
+    if (state == CANDIDATE_BEST || state == REQUESTED)
+        SelectBest(txid);
+    EraseIfCompleted(txid);
+}
+
+void CTxRequestTracker::ForgetTxHash(const uint256& txid)
+{
+    AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    TxidIter it = index.lower_bound(boost::make_tuple(txid));
+    while (it != index.end() && it->txid == txid) {
+        std::map<NodeId, PeerInfo>::iterator itInfo = mapPeerInfo.find(it->peer);
+        if (it->state == REQUESTED)
+            itInfo->second.nRequested--;
+        if (--itInfo->second.nTotal == 0)
+            mapPeerInfo.erase(itInfo);
+        it = index.erase(it);
+    }
+}
+
+void CTxRequestTracker::DisconnectedPeer(NodeId peer)
+{
+    // Forgetting a transaction erases other peers' announcements of it, which
+    // may be the next entry in the by_peer index, so collect the txids first
+    AnnouncementSet::index<by_peer>::type& index = setAnnouncements.get<by_peer>();
+    std::vector<uint256> vTxids;
+    for (PeerIter it = index.lower_bound(boost::make_tuple(peer)); it != index.end() && it->peer == peer; ++it)
+        vTxids.push_back(it->txid);
+    for (size_t i = 0; i < vTxids.size(); i++) {
+        const uint256& txid = vTxids[i];
+        PeerIter it = FindAnnouncement(peer, txid);
+        if (it == index.end())
+            continue;
+        Erase(setAnnouncements.project<by_txid>(it));
+        EraseIfCompleted(txid);
+    }
+}
+
+size_t CTxRequestTracker::Count(NodeId peer) const
+{
+    std::map<NodeId, PeerInfo>::const_iterator it = mapPeerInfo.find(peer);
+    return it == mapPeerInfo.end() ? 0 : it->second.nTotal;
+}
+
+size_t CTxRequestTracker::CountInFlight(NodeId peer) const
+{
+    std::map<NodeId, PeerInfo>::const_iterator it = mapPeerInfo.find(peer);
+    return it == mapPeerInfo.end() ? 0 : it->second.nRequested;
+}
+
+void CTxRequestTracker::SanityCheck() const
+{
+    std::map<NodeId, PeerInfo> mapCounted;
+    const AnnouncementSet::index<by_txid>::type& index = setAnnouncements.get<by_txid>();
+    TxidIter it = index.begin();
+    while (it != index.end()) {
+        const uint256 txid = it->txid;
+        size_t nReady = 0, nBestOrRequested = 0, nCompleted = 0, nTotal = 0;
+        const Announcement* pBest = NULL;
+        for (; it != index.end() && it->txid == txid; ++it) {
+            nTotal++;
+            PeerInfo& info = mapCounted[it->peer];
+            info.nTotal++;
+            if (it->state == CANDIDATE_READY)
+                nReady++;
+            if (it->state == CANDIDATE_BEST || it->state == REQUESTED) {
+                nBestOrRequested++;
+                pBest = &*it;
+            }
+            if (it->state == REQUESTED)
+                info.nRequested++;
+            if (it->state == COMPLETED)
+                nCompleted++;
+        }
+        // At most one best or requested, and ready candidates only wait for one
+        assert(nBestOrRequested <= 1);
+        assert(nReady == 0 || nBestOrRequested == 1);
+        // A transaction is forgotten once it has no announcements left to try
+        assert(nCompleted < nTotal);
+        if (pBest && pBest->state == CANDIDATE_BEST) {
+            TxidIter itReady = index.lower_bound(boost::make_tuple(txid, CANDIDATE_READY));
+            for (; itReady != index.end() && itReady->txid == txid && itReady->state == CANDIDATE_READY; ++itReady)
+                assert(!IsBetterCandidate(*itReady, *pBest));
+        }
+    }
+
+    assert(mapCounted.size() == mapPeerInfo.size());
+    for (std::map<NodeId, PeerInfo>::const_iterator itInfo = mapCounted.begin(); itInfo != mapCounted.end(); ++itInfo) {
+        std::map<NodeId, PeerInfo>::const_iterator itStored = mapPeerInfo.find(itInfo->first);
+        assert(itStored != mapPeerInfo.end());
+        assert(itStored->second.nTotal == itInfo->second.nTotal);
+        assert(itStored->second.nRequested == itInfo->second.nRequested);
+    }
+}
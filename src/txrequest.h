@@ -0,0 +1,177 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXREQUEST_H
+#define BITCOIN_TXREQUEST_H
+
+#include "net.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+#include "boost/multi_index/mem_fun.hpp"
+#include "boost/multi_index/member.hpp"
+#include "boost/multi_index/composite_key.hpp"
+
+/**
+ * Decides which peer to request each announced transaction from, and when.
+ *
+ * Every (peer, txid) announcement is tracked in one of these states:
+ * - CANDIDATE_DELAYED: not to be requested before its time.
+ * - CANDIDATE_READY: may be requested, but another announcement of the same
+ *   transaction is better or already requested.
+ * - CANDIDATE_BEST: the one to request the transaction from next. There is
+ *   at most one per transaction, and only if none is REQUESTED.
+ * - REQUESTED: requested, to be given up on at its time.
+ * - COMPLETED: the peer responded or the request timed out; kept so that
+ *   the transaction is not requested from that peer again.
+ *
+ * Among ready announcements, those from preferred peers are chosen first,
+ * then the earliest. The container is indexed by peer, by txid and by time,
+ * so all operations are logarithmic in the number of announcements; nothing
+ * is rescanned on every call. Times are passed in by the caller, in
+ * microseconds, so the logic does not depend on the clock.
+ */
+class CTxRequestTracker
+{
+public:
+    enum State {
+        CANDIDATE_DELAYED,
+        CANDIDATE_READY,
+        CANDIDATE_BEST,
+        REQUESTED,
+        COMPLETED,
+    };
+
+    struct Announcement
+    {
+        uint256 txid;
+        NodeId peer;
+        int64_t nTime; //!< Request time for CANDIDATE_DELAYED, expiry time for REQUESTED
+        uint64_t nSequence;
+        bool fPreferred;
+        State state;
+
+        //! Key of the by-peer index: the CANDIDATE_BEST ones of a peer come first
+        bool IsNotBest() const { return state != CANDIDATE_BEST; }
+        //! Key of the by-txid index: ready candidates in order of preference
+        bool IsNotPreferred() const { return !fPreferred; }
+        //! Key of the by-time index: the announcements waiting for a time come first
+        bool IsNotWaiting() const { return state != CANDIDATE_DELAYED && state != REQUESTED; }
+    };
+
+private:
+    struct by_peer {};
+    struct by_txid {};
+    struct by_time {};
+
+    typedef boost::multi_index_container<
+        Announcement,
+        boost::multi_index::indexed_by<
+            // (peer, is not best, txid): unique
+            boost::multi_index::ordered_unique<
+                boost::multi_index::tag<by_peer>,
+                boost::multi_index::composite_key<
+                    Announcement,
+                    boost::multi_index::member<Announcement, NodeId, &Announcement::peer>,
+                    boost::multi_index::const_mem_fun<Announcement, bool, &Announcement::IsNotBest>,
+                    boost::multi_index::member<Announcement, uint256, &Announcement::txid>
+                >
+            >,
+            // (txid, state, is not preferred, sequence)
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<by_txid>,
+                boost::multi_index::composite_key<
+                    Announcement,
+                    boost::multi_index::member<Announcement, uint256, &Announcement::txid>,
+                    boost::multi_index::member<Announcement, State, &Announcement::state>,
+                    boost::multi_index::const_mem_fun<Announcement, bool, &Announcement::IsNotPreferred>,
+                    boost::multi_index::member<Announcement, uint64_t, &Announcement::nSequence>
+                >
+            >,
+            // (is not waiting, time)
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<by_time>,
+                boost::multi_index::composite_key<
+                    Announcement,
+                    boost::multi_index::const_mem_fun<Announcement, bool, &Announcement::IsNotWaiting>,
+                    boost::multi_index::member<Announcement, int64_t, &Announcement::nTime>
+                >
+            >
+        >
+    > AnnouncementSet;
+
+    typedef AnnouncementSet::index<by_peer>::type::iterator PeerIter;
+    typedef AnnouncementSet::index<by_txid>::type::iterator TxidIter;
+
+    struct PeerInfo
+    {
+        size_t nTotal;
+        size_t nRequested;
+        PeerInfo() : nTotal(0), nRequested(0) {}
+    };
+
+    AnnouncementSet setAnnouncements;
+    std::map<NodeId, PeerInfo> mapPeerInfo;
+    uint64_t nNextSequence;
+
+    PeerIter FindAnnouncement(NodeId peer, const uint256& txid) const;
+    /** Change the state of an announcement, keeping the per-peer counts */
+    void ChangeState(TxidIter it, State state, int64_t nTime = 0);
+    /** Make the ready candidate it the best one for its transaction if it is better than the current one */
+    void PromoteCandidateReady(TxidIter it);
+    /** Choose a new best candidate for txid, if none is best or requested */
+    void SelectBest(const uint256& txid);
+    /** Erase an announcement, choosing a new best candidate if needed */
+    void Erase(TxidIter it);
+    /** Forget txid if all its announcements are COMPLETED */
+    void EraseIfCompleted(const uint256& txid);
+    /** Make the delayed candidates due by nNow ready, and time out the requests expired by nNow */
+    void SetTimePoint(int64_t nNow);
+
+public:
+    CTxRequestTracker() : nNextSequence(0) {}
+
+    /**
+     * A peer announced txid. It will not be requested from this peer before
+     * nReqTime. Does nothing if the peer announced it before.
+     */
+    void ReceivedInv(NodeId peer, const uint256& txid, bool fPreferred, int64_t nReqTime);
+
+    /**
+     * The transactions to request from peer at time nNow, in the order they
+     * were announced. Also times out the requests expired by nNow.
+     */
+    std::vector<uint256> GetRequestable(NodeId peer, int64_t nNow);
+
+    /** A request for txid was sent to peer. Give up on it at nExpiry. */
+    void RequestedTx(NodeId peer, const uint256& txid, int64_t nExpiry);
+
+    /** The peer sent txid, or a notfound for it */
+    void ReceivedResponse(NodeId peer, const uint256& txid);
+
+    /** Forget all announcements of txid, e.g. once it is in the mempool or rejected */
+    void ForgetTxHash(const uint256& txid);
+
+    /** Forget all announcements of a peer */
+    void DisconnectedPeer(NodeId peer);
+
+    /** Number of announcements of a peer being tracked */
+    size_t Count(NodeId peer) const;
+
+    /** Number of transactions requested from a peer and not yet received */
+    size_t CountInFlight(NodeId peer) const;
+
+    /** Total number of announcements tracked */
+    size_t Size() const { return setAnnouncements.size(); }
+
+    /** Check the internal invariants, for tests */
+    void SanityCheck() const;
+};
+
+#endif // BITCOIN_TXREQUEST_H